@@ -0,0 +1,106 @@
+// Compares the single-pass kline parsers with the nlohmann DOM path they replace.
+// Build with -DCHOMOSYNCER_BUILD_BENCH=ON, then run ./klineParserBench [iterations]
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "dtos/kline.h"
+#include "dtos/klineParser.h"
+
+namespace {
+
+const std::string WS_EVENT =
+    "{\"e\":\"kline\",\"E\":1672515782136,\"s\":\"BTCUSDT\",\"k\":{\"t\":1672515780000,\"T\":1672515839999,"
+    "\"s\":\"BTCUSDT\",\"i\":\"1m\",\"f\":2463021345,\"L\":2463022871,\"o\":\"16541.77000000\",\"c\":\"16544.76000000\","
+    "\"h\":\"16545.33000000\",\"l\":\"16539.66000000\",\"v\":\"80.27543000\",\"n\":1527,\"x\":true,"
+    "\"q\":\"1328097.06717970\",\"V\":\"40.32811000\",\"Q\":\"667178.65378570\",\"B\":\"0\"}}";
+
+std::string makeRestPage(size_t n) {
+    std::ostringstream oss;
+    oss << "[";
+    for (size_t i = 0; i < n; ++i) {
+        int64_t t = 1672515780000LL + static_cast<int64_t>(i) * 60000;
+        if (i) oss << ",";
+        oss << "[" << t << ",\"16541.77000000\",\"16545.33000000\",\"16539.66000000\",\"16544.76000000\",\"80.27543000\","
+            << (t + 59999) << ",\"1328097.06717970\"," << 1527 + i << ",\"40.32811000\",\"667178.65378570\",\"0\"]";
+    }
+    oss << "]";
+    return oss.str();
+}
+
+bool sameKline(const KlineResponseWs& a, const KlineResponseWs& b) {
+    return std::strcmp(a.EventType, b.EventType) == 0 && std::strcmp(a.Symbol, b.Symbol) == 0 && std::strcmp(a.Interval, b.Interval) == 0 &&
+        a.StartTime == b.StartTime && a.EndTime == b.EndTime && a.TradeNum == b.TradeNum && a.IsFinal == b.IsFinal &&
+        a.Open == b.Open && a.High == b.High && a.Low == b.Low && a.Close == b.Close && a.Volume == b.Volume &&
+        a.QuoteVolume == b.QuoteVolume && a.ActiveBuyVolume == b.ActiveBuyVolume && a.ActiveBuyQuoteVolume == b.ActiveBuyQuoteVolume;
+}
+
+template <typename F>
+double nsPerOp(size_t iterations, F&& f) {
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) f();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - begin).count() / static_cast<double>(iterations);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    size_t iterations = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 200000;
+    const std::string restPage = makeRestPage(1000);
+
+    // correctness first: both paths must produce the same DTOs
+    KlineResponseWs fast;
+    if (parseKlineEvent(WS_EVENT, fast) != KlineParseStatus::Ok ||
+        !sameKline(fast, KlineResponseWs::deserializeFromJson(nlohmann::json::parse(WS_EVENT)))) {
+        std::cerr << "ws event mismatch" << std::endl;
+        return 1;
+    }
+    std::vector<KlineResponseWs> fastPage, domPage;
+    parseKlineRestArray(restPage, "BTCUSDT", "1m", fastPage);
+    KlineResponseWs::parseKlineWs(restPage, "BTCUSDT", "1m", domPage);
+    if (fastPage.size() != domPage.size()) {
+        std::cerr << "rest page size mismatch" << std::endl;
+        return 1;
+    }
+    for (size_t i = 0; i < fastPage.size(); ++i) {
+        if (!sameKline(fastPage[i], domPage[i])) {
+            std::cerr << "rest page mismatch at " << i << std::endl;
+            return 1;
+        }
+    }
+
+    volatile int64_t sink = 0;
+    double domWs = nsPerOp(iterations, [&] {
+        auto k = KlineResponseWs::deserializeFromJson(nlohmann::json::parse(WS_EVENT));
+        sink = sink + k.StartTime;
+        });
+    KlineResponseWs reused;
+    double fastWs = nsPerOp(iterations, [&] {
+        parseKlineEvent(WS_EVENT, reused);
+        sink = sink + reused.StartTime;
+        });
+
+    size_t pageIterations = std::max<size_t>(1, iterations / 1000);
+    double domRest = nsPerOp(pageIterations, [&] {
+        std::vector<KlineResponseWs> out;
+        KlineResponseWs::parseKlineWs(restPage, "BTCUSDT", "1m", out);
+        sink = sink + static_cast<int64_t>(out.size());
+        });
+    double fastRest = nsPerOp(pageIterations, [&] {
+        std::vector<KlineResponseWs> out;
+        out.reserve(1000);
+        parseKlineRestArray(restPage, "BTCUSDT", "1m", out);
+        sink = sink + static_cast<int64_t>(out.size());
+        });
+
+    std::cout << "ws event   nlohmann: " << domWs << " ns/op, single-pass: " << fastWs << " ns/op, speedup x" << domWs / fastWs << std::endl;
+    std::cout << "rest page  nlohmann: " << domRest / 1000.0 << " us/page, single-pass: " << fastRest / 1000.0
+        << " us/page, speedup x" << domRest / fastRest << std::endl;
+    return 0;
+}
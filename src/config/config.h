@@ -34,6 +34,22 @@ public:
         return pt.get<std::string>("database.uri");
     }
 
+    std::string getDatabaseKlineLayout() const {
+        return pt.get<std::string>("database.kline_layout", "documents");
+    }
+
+    int64_t getDatabaseKlineBucketBars() const {
+        return pt.get<int64_t>("database.kline_bucket_bars", 1440);
+    }
+
+    std::string getDatabaseKlinePriceEncoding() const {
+        return pt.get<std::string>("database.kline_price_encoding", "string");
+    }
+
+    int getDatabaseKlineReadBatchSize() const {
+        return pt.get<int>("database.kline_read_batch_size", 1000);
+    }
+
     // redis info
     std::string getRedisHost() const {
         return pt.get<std::string>("redis.host");
@@ -47,6 +63,44 @@ public:
         return pt.get<std::string>("redis.password");
     }
 
+    // async producer of the global klines stream
+    size_t getRedisProducerQueueCapacity() const {
+        return pt.get<size_t>("redis.producer_queue_capacity", 65536);
+    }
+
+    size_t getRedisProducerBatchSize() const {
+        return pt.get<size_t>("redis.producer_batch_size", 256);
+    }
+
+    // block | drop_oldest_non_final | spill
+    std::string getRedisProducerOverflowPolicy() const {
+        return pt.get<std::string>("redis.producer_overflow_policy", "drop_oldest_non_final");
+    }
+
+    std::string getRedisProducerSpillPath() const {
+        return pt.get<std::string>("redis.producer_spill_path", "redis_spill.bin");
+    }
+
+    std::string getRedisGlobalStreamEncoding() const {
+        return pt.get<std::string>("redis.global_stream_encoding", "json");
+    }
+
+    std::string getRedisAssetStreamEncoding() const {
+        return pt.get<std::string>("redis.asset_stream_encoding", "json");
+    }
+
+    size_t getRedisConsumerBatchSize() const {
+        return pt.get<size_t>("redis.consumer_batch_size", 500);
+    }
+
+    int getRedisConsumerBlockMs() const {
+        return pt.get<int>("redis.consumer_block_ms", 100);
+    }
+
+    int64_t getRedisConsumerClaimIdleMs() const {
+        return pt.get<int64_t>("redis.consumer_claim_idle_ms", 60000);
+    }
+
     // market info
     // symbols, intervals, with ',' separated
     std::vector<std::string> getMarketSubInfo(std::string target) const {
@@ -63,6 +117,79 @@ public:
         return tokens;
     }
 
+    // io_context threads shared by all the websocket connections
+    size_t getMarketIoThreads() const {
+        return pt.get<size_t>("marketsub.io_threads", 1);
+    }
+
+    // binance caps the streams of one connection (1024), the subscription set is split into shards of this size
+    size_t getMarketStreamsPerConnection() const {
+        return pt.get<size_t>("marketsub.streams_per_connection", 200);
+    }
+
+    // persistence
+    bool getPersistenceInprocessHandoff() const {
+        return pt.get<bool>("persistence.inprocess_handoff", false);
+    }
+
+    size_t getPersistenceHandoffRingCapacity() const {
+        return pt.get<size_t>("persistence.handoff_ring_capacity", 65536);
+    }
+
+    size_t getPersistenceWriterThreads() const {
+        return pt.get<size_t>("persistence.writer_threads", 4);
+    }
+
+    std::string getPersistenceJournalDir() const {
+        return pt.get<std::string>("persistence.journal_dir", "");
+    }
+
+    size_t getPersistenceJournalSegmentMb() const {
+        return pt.get<size_t>("persistence.journal_segment_mb", 64);
+    }
+
+    size_t getPersistenceRecentCacheKlines() const {
+        return pt.get<size_t>("persistence.recent_cache_klines", 1000);
+    }
+
+    // archive
+    std::string getArchiveDir() const {
+        return pt.get<std::string>("archive.dir", "");
+    }
+
+    size_t getArchiveSegmentBars() const {
+        return pt.get<size_t>("archive.segment_bars", 8192);
+    }
+
+    bool getArchiveCompressSealed() const {
+        return pt.get<bool>("archive.compress_sealed", true);
+    }
+
+    // query service
+    int getQueryPort() const {
+        return pt.get<int>("query.port", 0);
+    }
+
+    std::string getQueryBindAddress() const {
+        return pt.get<std::string>("query.bind", "127.0.0.1");
+    }
+
+    std::string getQueryUnixPath() const {
+        return pt.get<std::string>("query.unix_path", "");
+    }
+
+    size_t getQueryThreads() const {
+        return pt.get<size_t>("query.threads", 2);
+    }
+
+    uint32_t getQueryMaxKlines() const {
+        return pt.get<uint32_t>("query.max_klines", 100000);
+    }
+
+    std::string getQueryLatestShmName() const {
+        return pt.get<std::string>("query.latest_shm_name", "");
+    }
+
     std::string getLogDir() const {
         return pt.get<std::string>("logging.dir", "logs");
     }
@@ -75,6 +202,30 @@ public:
         return pt.get<uint64_t>("history.kline_sync_start_ms", 0);
     }
 
+    size_t getHistoryRestMaxConnections() const {
+        return pt.get<size_t>("history.rest_max_connections", 8);
+    }
+
+    size_t getHistoryWorkers() const {
+        return pt.get<size_t>("history.workers", 4);
+    }
+
+    size_t getHistoryMaxOutstandingPages() const {
+        return pt.get<size_t>("history.max_outstanding_pages", 2);
+    }
+
+    bool getHistoryPartitionedBackfill() const {
+        return pt.get<bool>("history.partitioned_backfill", false);
+    }
+
+    size_t getHistoryChunkPages() const {
+        return pt.get<size_t>("history.chunk_pages", 50);
+    }
+
+    int64_t getHistoryWeightPerMinute() const {
+        return pt.get<int64_t>("history.weight_per_minute", 3000);
+    }
+
 private:
     boost::property_tree::ptree pt;
 };
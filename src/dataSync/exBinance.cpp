@@ -1,5 +1,7 @@
 #include "exBinance.h"
 
+#include <unordered_set>
+
 const std::string DB_MARKETINFO = "market_info";
 
 void printHumanReadableTime(int64_t timestamp_ms) {
@@ -15,25 +17,124 @@ void printHumanReadableTime(int64_t timestamp_ms) {
         << std::put_time(tm_ptr, "%Y-%m-%d %H:%M:%S") << " UTC" << std::endl;
 }
 
+static RedisProducerOptions producerOptionsFromConfig(const Config& cfg) {
+    RedisProducerOptions options;
+    options.queueCapacity = cfg.getRedisProducerQueueCapacity();
+    options.batchSize = cfg.getRedisProducerBatchSize();
+    options.overflowPolicy = RedisProducerOptions::parsePolicy(cfg.getRedisProducerOverflowPolicy());
+    options.spillPath = cfg.getRedisProducerSpillPath();
+    return options;
+}
+
+static RedisConsumerOptions consumerOptionsFromConfig(const Config& cfg) {
+    RedisConsumerOptions options;
+    options.batchSize = std::max<size_t>(1, cfg.getRedisConsumerBatchSize());
+    options.blockMs = std::max(1, cfg.getRedisConsumerBlockMs());
+    options.claimIdleMs = std::max<int64_t>(0, cfg.getRedisConsumerClaimIdleMs());
+    return options;
+}
+
+static KlineStorageOptions storageOptionsFromConfig(const Config& cfg) {
+    KlineStorageOptions options;
+    options.layout = parseKlineLayout(cfg.getDatabaseKlineLayout());
+    options.priceEncoding = parseKlinePriceEncoding(cfg.getDatabaseKlinePriceEncoding());
+    options.bucketBars = std::max<int64_t>(1, cfg.getDatabaseKlineBucketBars());
+    options.readBatchSize = std::max(1, cfg.getDatabaseKlineReadBatchSize());
+    return options;
+}
+
+static KlineQueryServerOptions queryOptionsFromConfig(const Config& cfg) {
+    KlineQueryServerOptions options;
+    options.port = static_cast<uint16_t>(cfg.getQueryPort());
+    options.bindAddress = cfg.getQueryBindAddress();
+    options.unixPath = cfg.getQueryUnixPath();
+    options.threads = cfg.getQueryThreads();
+    options.maxKlines = cfg.getQueryMaxKlines();
+    return options;
+}
+
+static RestClientOptions restOptionsFromConfig(const Config& cfg) {
+    RestClientOptions options;
+    options.maxConnections = cfg.getHistoryRestMaxConnections();
+    return options;
+}
+
 BinanceDataSync::BinanceDataSync(const std::string& iniConfig) : 
-    last_persist_time(std::chrono::steady_clock::now()), 
-    ioc_(), work_guard_(net::make_work_guard(ioc_)), resolver_(ioc_), ssl_ctx_(net::ssl::context::tlsv12_client),
-    reconnect_timer_(ioc_), ping_timer_(ioc_), strand_(ioc_.get_executor()),
     cfg(iniConfig),
-    mkdsM(cfg.getRedisHost(), cfg.getRedisPort(), cfg.getRedisPassword()),
-    mongoM(cfg.getDatabaseUri())
+    mkdsM(cfg.getRedisHost(), cfg.getRedisPort(), cfg.getRedisPassword(), producerOptionsFromConfig(cfg), consumerOptionsFromConfig(cfg)),
+    mongoM(cfg.getDatabaseUri(), storageOptionsFromConfig(cfg)),
+    restClient_("api.binance.com", "443", restOptionsFromConfig(cfg)),
+    weightLimiter_(cfg.getHistoryWeightPerMinute()),
+    last_persist_time(std::chrono::steady_clock::now()), 
+    ioc_(), ssl_ctx_(net::ssl::context::tlsv12_client), work_guard_(net::make_work_guard(ioc_))
 {      
-    ws_stream_ = std::make_unique<WsStream>(ioc_, ssl_ctx_);
-
-    auto redisHost = cfg.getRedisHost();
-    auto redisPort = cfg.getRedisPort();
-    auto mongoUri = cfg.getDatabaseUri();
     marketSymbols = cfg.getMarketSubInfo("marketsub.symbols");
     marketIntervals = cfg.getMarketSubInfo("marketsub.intervals");
     historyKlineSyncStartMs = cfg.getHistoryKlineSyncStartMs();
+    historyWorkers = std::max<size_t>(1, cfg.getHistoryWorkers());
+    historyMaxOutstandingPages = std::max<size_t>(1, cfg.getHistoryMaxOutstandingPages());
+    historyPartitioned = cfg.getHistoryPartitionedBackfill();
+    historyChunkPages = std::max<size_t>(1, cfg.getHistoryChunkPages());
+    ioThreads = std::max<size_t>(1, cfg.getMarketIoThreads());
+    streamsPerConnection = std::max<size_t>(1, cfg.getMarketStreamsPerConnection());
+
+    mkdsM.setStreamEncodings(parseStreamEncoding(cfg.getRedisGlobalStreamEncoding()), parseStreamEncoding(cfg.getRedisAssetStreamEncoding()));
+    if (mkdsM.usesBinaryEncoding()) {
+        mkdsM.registerSymbols(marketSymbols);
+    }
+
+    auto archiveDir = cfg.getArchiveDir();
+    if (!archiveDir.empty()) {
+        archive_ = std::make_unique<KlineArchiveWriter>(archiveDir, cfg.getArchiveSegmentBars(), cfg.getArchiveCompressSealed());
+        mongoM.SetKlineArchive(archive_.get());
+    }
+    size_t recentCacheKlines = cfg.getPersistenceRecentCacheKlines();
+    if (recentCacheKlines > 0) {
+        recentKlines_ = std::make_unique<KlineCache>(recentCacheKlines);
+        for (auto symbol : marketSymbols) {
+            std::transform(symbol.begin(), symbol.end(), symbol.begin(), ::toupper);
+            for (const auto& interval : marketIntervals) {
+                recentKlines_->addSeries(symbol + "_" + interval + "_Binance");
+            }
+        }
+    }
+
+    auto queryOptions = queryOptionsFromConfig(cfg);
+    if (queryOptions.port != 0 || !queryOptions.unixPath.empty()) {
+        queryServer_ = std::make_unique<KlineQueryServer>(mongoM, recentKlines_.get(), DB_MARKETINFO, queryOptions);
+    }
+    auto latestShmName = cfg.getQueryLatestShmName();
+    if (!latestShmName.empty()) {
+        std::vector<std::string> symbols;
+        for (auto symbol : marketSymbols) {
+            std::transform(symbol.begin(), symbol.end(), symbol.begin(), ::toupper);
+            symbols.push_back(symbol);
+        }
+        latestKlines_ = std::make_unique<LatestKlineTable>(latestShmName, symbols, marketIntervals);
+    }
+
+    // shared by the live flushes and the history page writes
+    mongoWriters_ = std::make_unique<MongoWriterPool>(mongoM, DB_MARKETINFO, std::max<size_t>(1, cfg.getPersistenceWriterThreads()));
+
+    auto journalDir = cfg.getPersistenceJournalDir();
+    if (!journalDir.empty()) {
+        journal_ = std::make_unique<KlineJournal>(journalDir, cfg.getPersistenceJournalSegmentMb() * 1024 * 1024);
+    }
+
+    inprocessHandoff = cfg.getPersistenceInprocessHandoff();
+    if (inprocessHandoff) {
+        closedKlineRing_ = std::make_unique<MpmcRing<KlineResponseWs>>(cfg.getPersistenceHandoffRingCapacity());
+    }
 }
 
 void BinanceDataSync::start() {
+    // collections and indexes first, the layout decides how every later write is done
+    provision_kline_collections();
+    warm_kline_cache();
+    if (queryServer_) {
+        queryServer_->start();
+    }
+
     // start threads for history market data sync
     handle_history_market_data_sync();
 
@@ -46,30 +147,86 @@ void BinanceDataSync::start() {
     // start two threads for market data subscribe and data persistence
     std::cout << "Start two threads for market data subscribe and data persistence." << std::endl;
 
-    // start the io_context in a separate thread
-    // in the future, we can expand the threads to multi-threads
-    std::thread io_thread([this]() { ioc_.run(); }); 
+    // start the io_context thread pool, shards are spread over these threads by their strands
+    std::vector<std::thread> io_threads;
+    io_threads.reserve(ioThreads);
+    for (size_t i = 0; i < ioThreads; ++i) {
+        io_threads.emplace_back([this]() { ioc_.run(); });
+    }
 
     // start the market data subscribe and data persistence threads
     std::thread market_data_thread(&BinanceDataSync::handle_market_data_subscribe, this); // not necessary use thread, but leave thread + io_context post(async) for future expansion
     std::thread data_persistence_thread(&BinanceDataSync::handle_data_persistence, this);
+    std::thread market_dispatch_thread;
+    if (inprocessHandoff) {
+        market_dispatch_thread = std::thread(&BinanceDataSync::handle_market_data_dispatch, this);
+    }
+    std::thread journal_apply_thread;
+    if (journal_) {
+        journal_apply_thread = std::thread(&BinanceDataSync::handle_journal_apply, this);
+    }
     
     market_data_thread.join();
     data_persistence_thread.join();
+    if (market_dispatch_thread.joinable()) {
+        market_dispatch_thread.join();
+    }
+    if (journal_apply_thread.joinable()) {
+        journal_apply_thread.join();
+    }
 
     // stop the io_context when all threads are done
     // otherwise, if no ioc stop, because of work_guard_, this join is not reachable, will block.
     ioc_.stop(); 
-    io_thread.join(); 
+    for (auto& t : io_threads) {
+        t.join();
+    }
+}
+
+void BinanceDataSync::provision_kline_collections() {
+    for (auto symbol : marketSymbols) {
+        std::transform(symbol.begin(), symbol.end(), symbol.begin(), ::toupper);
+        for (const auto& interval : marketIntervals) {
+            mongoM.EnsureKlineCollection(DB_MARKETINFO, symbol + "_" + interval + "_Binance", interval);
+        }
+    }
+    mongoM.EnsureBackfillChunkIndex(DB_MARKETINFO);
+}
+
+void BinanceDataSync::warm_kline_cache() {
+    if (!recentKlines_) return;
+
+    KlineRangeQuery query;
+    query.limit = recentKlines_->capacity();
+    query.latest = true;
+    KlineColumns klines;
+    klines.fields = KLINE_FIELDS_ALL;
+    for (auto symbol : marketSymbols) {
+        std::transform(symbol.begin(), symbol.end(), symbol.begin(), ::toupper);
+        for (const auto& interval : marketIntervals) {
+            auto colName = symbol + "_" + interval + "_Binance";
+            int64_t read = mongoM.ReadKlineColumns(DB_MARKETINFO, colName, query, klines);
+            if (read < 0) continue; // not loaded, the reads of this series keep going to Mongo
+            // fewer than asked for: that is the whole history
+            recentKlines_->load(colName, klines, static_cast<size_t>(read) < query.limit);
+        }
+    }
+    mongoM.SetKlineCache(recentKlines_.get());
 }
 
 void BinanceDataSync::handle_market_data_subscribe() {
     try {
-        net::post(strand_, [this, self = shared_from_this()] {
-            if (!connect_noexcept()) { scheduleReconnect(); return; }
-            startPing(); // start the ping timer to keep the connection alive
-            asyncReadLoop(); // start the async read loop to receive messages
-            });
+        auto streamsByShard = shardStreams(marketSymbols, marketIntervals, streamsPerConnection);
+        std::cout << "Subscribing " << marketSymbols.size() * marketIntervals.size() << " streams with "
+            << streamsByShard.size() << " connections on " << ioThreads << " io threads" << std::endl;
+
+        for (size_t i = 0; i < streamsByShard.size(); ++i) {
+            auto shard = std::make_shared<WsShard>(ioc_, ssl_ctx_, i, std::move(streamsByShard[i]),
+                [this](const char* data, size_t len) { onMarketFrame(data, len); },
+                [this](size_t shardId, int64_t disconnectedAtMs) { onShardReconnected(shardId, disconnectedAtMs); });
+            shards_.push_back(shard);
+            shard->start();
+        }
     } catch (const std::exception &e) {
         std::cerr << "handle_market_data websocket error: " << e.what() << std::endl;
     }
@@ -77,48 +234,329 @@ void BinanceDataSync::handle_market_data_subscribe() {
     std::cout << "handle_market_data_subscribe Posted" << std::endl;
 }
     
+void BinanceDataSync::onMarketFrame(const char* data, size_t len) {
+    std::string_view frame(data, len);
+    bool binary = mkdsM.globalStreamBinary();
+    // only closed klines are persisted, skip the parse for the in-progress updates
+    bool handoff = inprocessHandoff && frame.find("\"x\":true") != std::string_view::npos;
+
+    if (!binary && !handoff && !latestKlines_) {
+        mkdsM.publishGlobalKlines(data, len);
+        return;
+    }
+
+    // parse once for the binary record, the handoff and the latest kline table
+    KlineResponseWs kline;
+    auto status = parseKlineEvent(frame, kline);
+    if (!binary || status == KlineParseStatus::Invalid) {
+        mkdsM.publishGlobalKlines(data, len); // raw, a malformed frame is reported by the consumer
+    } else if (status == KlineParseStatus::Ok) {
+        mkdsM.publishGlobalKline(kline, data, len);
+    }
+    if (latestKlines_ && status == KlineParseStatus::Ok) {
+        latestKlines_->publish(kline);
+    }
+
+    if (!handoff) return;
+    if (status != KlineParseStatus::Ok) {
+        std::cerr << "onMarketFrame handoff parse error: malformed kline event" << std::endl;
+        return;
+    }
+    if (!kline.IsFinal) return;
+
+    // the ring only fills up if persistence is stalled. Never wait for it here, that would stall every shard of this
+    // io thread: the kline is in global_klines_stream already and reaches persistence with the dispatch thread
+    if (!closedKlineRing_->tryPush(kline)) {
+        uint64_t n = ++handoffOverflows_;
+        if ((n & (n - 1)) == 0) {
+            std::cerr << "onMarketFrame handoff ring full, " << n << " closed klines left to the Redis path so far" << std::endl;
+        }
+        return;
+    }
+    // closed klines are a few per series and minute, taking the mutex for the wake-up costs nothing here
+    { std::lock_guard<std::mutex> lock(handoffMutex_); }
+    handoffCv_.notify_one();
+}
+
 void BinanceDataSync::handle_data_persistence() {
+    std::vector<KlineResponseWs> handedOff;
+    std::vector<GlobalKlineBatch> streamed;
+    std::vector<std::string> journaledIds;
+    GlobalKlineBatch fetched;
     while (true) {
-        // fetch global klines and dispatch
-        std::vector<KlineResponseWs> closedKlines = mkdsM.fetchGlobalKlinesAndDispatch("consumer1");
-        if (closedKlines.empty()) {
-            std::this_thread::sleep_for(std::chrono::seconds(1));
-            continue;
-        }else{
+        if (inprocessHandoff) {
+            // drain the handoff ring, closed klines arrive here without a Redis hop
+            handedOff.clear();
+            KlineResponseWs k;
+            while (handedOff.size() < BATCH_SIZE && closedKlineRing_->tryPop(k)) {
+                handedOff.push_back(std::move(k));
+            }
+            // and their copies from the stream, a little later, which carry the entry ids to acknowledge
+            streamed.clear();
+            std::lock_guard<std::mutex> lock(handoffMutex_);
+            streamed.swap(streamedBatches_);
+        } else if (!mkdsM.fetchGlobalKlinesAndDispatch("consumer1", fetched)) {
+            // fetch global klines and dispatch, the read waits for new entries by itself; here Redis is unreachable
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        }
+
+        bool received = false;
+        auto store = [&](const std::vector<KlineResponseWs>& closedKlines, const std::vector<std::string>* streamIds) {
+            if (closedKlines.empty()) return;
+            received = true;
             std::cout << "Fetched " << closedKlines.size() << " closed klines." << std::endl;
+            if (journal_) {
+                journal_->append(closedKlines);
+                if (streamIds) journaledIds.insert(journaledIds.end(), streamIds->begin(), streamIds->end());
+            } else {
+                bufferClosedKlines(closedKlines, 0, streamIds);
+            }
+        };
+        if (inprocessHandoff) {
+            store(handedOff, nullptr);
+            for (const auto& batch : streamed) store(batch.closedKlines, &batch.closedIds);
+        } else {
+            store(fetched.closedKlines, &fetched.closedIds);
+        }
+        if (journal_ && received) {
+            // on disk before anything else, one flush for the whole batch; handle_journal_apply writes Mongo behind
+            journal_->sync();
+            acknowledgeStored(journaledIds);
+        }
+
+        // write behind: flush on BATCH_SIZE pending klines, or when the oldest unflushed ones waited BATCH_TIMEOUT
+        if (!journal_ && (pendingKlineCount_ >= BATCH_SIZE ||
+            (pendingKlineCount_ > 0 && std::chrono::steady_clock::now() - last_persist_time >= BATCH_TIMEOUT))) {
+            flushClosedKlines();
+        }
+
+        if (inprocessHandoff && !received) {
+            // sleep until a closed kline is handed off or read from the stream, or until the buffered ones are due
+            // for the flush
+            auto deadline = std::chrono::steady_clock::now() + BATCH_TIMEOUT;
+            if (!journal_ && pendingKlineCount_ > 0) deadline = std::min(deadline, last_persist_time + BATCH_TIMEOUT);
+            std::unique_lock<std::mutex> lock(handoffMutex_);
+            handoffCv_.wait_until(lock, deadline, [this] { return closedKlineRing_->sizeApprox() > 0 || !streamedBatches_.empty(); });
+        }
+    }
+}
+
+void BinanceDataSync::acknowledgeStored(std::vector<std::string>& streamIds) {
+    if (streamIds.empty()) return;
+    if (!inprocessHandoff) {
+        mkdsM.acknowledgeGlobalKlines(streamIds);
+    } else {
+        std::lock_guard<std::mutex> lock(handoffMutex_);
+        storedStreamIds_.insert(storedStreamIds_.end(), std::make_move_iterator(streamIds.begin()), std::make_move_iterator(streamIds.end()));
+    }
+    streamIds.clear();
+}
+
+void BinanceDataSync::handle_market_data_dispatch() {
+    GlobalKlineBatch fetched;
+    std::vector<std::string> stored;
+    while (true) {
+        // the entries the persistence thread stored since the last read, acked here on the consumer connection
+        {
+            std::lock_guard<std::mutex> lock(handoffMutex_);
+            stored.swap(storedStreamIds_);
+        }
+        if (!stored.empty()) {
+            mkdsM.acknowledgeGlobalKlines(stored); // a failed XACK leaves them pending, delivered again after a restart
+            stored.clear();
+        }
+
+        if (!mkdsM.fetchGlobalKlinesAndDispatch("consumer1", fetched)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            continue;
+        }
+        // the ring brought these klines to persistence already, but only this copy survives a crash: stay
+        // unacknowledged until persistence has stored them
+        if (fetched.closedIds.empty()) continue;
+        {
+            std::lock_guard<std::mutex> lock(handoffMutex_);
+            streamedBatches_.push_back(std::move(fetched));
+        }
+        handoffCv_.notify_one();
+    }
+}
+
+void BinanceDataSync::handle_journal_apply() {
+    uint64_t nextSeq = journal_->replayStart();
+    std::cout << "Applying the kline journal from " << nextSeq << ", last entry " << journal_->lastSeq() << std::endl;
+
+    std::vector<KlineResponseWs> klines;
+    while (true) {
+        // while Mongo is down the backlog stays in the journal instead of piling up here
+        if (pendingKlineCount_ < JOURNAL_MAX_PENDING) {
+            klines.clear();
+            uint64_t firstSeq = nextSeq;
+            nextSeq = journal_->read(nextSeq, BATCH_SIZE, klines, std::chrono::milliseconds(200));
+            bufferClosedKlines(klines, firstSeq);
+        } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        }
+
+        if (pendingKlineCount_ >= BATCH_SIZE ||
+            (pendingKlineCount_ > 0 && std::chrono::steady_clock::now() - last_persist_time >= BATCH_TIMEOUT)) {
+            flushClosedKlines();
+
+            // everything before the oldest kline still buffered (a failed collection) is in Mongo
+            uint64_t applied = nextSeq - 1;
+            for (auto& [colName, seq] : pendingMinSeq_) {
+                applied = std::min(applied, seq - 1);
+            }
+            journal_->checkpoint(applied);
+        }
+    }
+}
+
+void BinanceDataSync::bufferClosedKlines(const std::vector<KlineResponseWs>& closedKlines, uint64_t firstSeq, const std::vector<std::string>* streamIds) {
+    if (pendingKlineCount_ == 0 && !closedKlines.empty()) {
+        last_persist_time = std::chrono::steady_clock::now(); // the timeout counts from the first unflushed kline
+    }
+    for (size_t i = 0; i < closedKlines.size(); ++i) {
+        const auto& k = closedKlines[i];
+        // keyed by collection and start time: a kline seen twice (redelivery, reconnect) is written once, the latest copy wins
+        auto colName = std::string(k.Symbol) + "_" + k.Interval + "_Binance";
+        auto& series = pendingKlines_[colName];
+        auto inserted = series.insert_or_assign(k.StartTime, k);
+        if (inserted.second) ++pendingKlineCount_;
+        if (firstSeq) {
+            pendingMinSeq_.emplace(colName, firstSeq + i); // journal entries are read in order, the first one is the oldest
         }
+        if (streamIds) {
+            pendingStreamIds_[colName].push_back((*streamIds)[i]);
+        }
+    }
+}
 
-        // step 1: key sorted by symbol and interval
-        std::unordered_map<std::string, std::vector<KlineResponseWs>> klinesBySymbolInterval;
-        klinesBySymbolInterval.reserve(256); // reserve some space to avoid rehashing
-        for (auto& k : closedKlines) {
-            std::string key = k.Symbol + "_" + k.Interval;
-            klinesBySymbolInterval[key].push_back(k);
+void BinanceDataSync::flushClosedKlines() {
+    // one unordered bulk upsert per collection instead of a find_one and a write per kline,
+    // collections are spread over the writer pool and written in parallel
+    // waits for its own writes only, the history pages sharing the pool may keep it busy for the whole backfill
+    std::mutex doneMutex;
+    std::condition_variable doneCv;
+    size_t remaining = pendingKlines_.size();
+    std::vector<std::string> failed;
+    for (auto& [colName, series] : pendingKlines_) {
+        std::vector<KlineResponseWs> batch;
+        batch.reserve(series.size());
+        for (auto& [startTime, k] : series) {
+            batch.push_back(k); // already sorted by start time
         }
+        mongoWriters_->submit(colName, std::move(batch), [&doneMutex, &doneCv, &remaining, &failed, name = colName](bool ok) {
+            std::lock_guard<std::mutex> lock(doneMutex);
+            if (!ok) failed.push_back(name);
+            if (--remaining == 0) doneCv.notify_all();
+            });
+    }
+    {
+        std::unique_lock<std::mutex> lock(doneMutex);
+        doneCv.wait(lock, [&] { return remaining == 0; });
+    }
 
-        // step 2: write closed klines to MongoDB by symbol and interval
-        for (auto& [key, vec] : klinesBySymbolInterval) {
-            std::sort(vec.begin(), vec.end(),
-                [](auto& a, auto& b) { return a.StartTime < b.StartTime; });
+    // failed collections stay buffered for the next flush, the upserts are idempotent
+    std::unordered_map<std::string, std::map<int64_t, KlineResponseWs>> retry;
+    std::unordered_map<std::string, uint64_t> retrySeq;
+    std::unordered_map<std::string, std::vector<std::string>> retryIds;
+    size_t retryCount = 0;
+    for (auto& name : failed) {
+        auto it = pendingKlines_.find(name);
+        std::cerr << "flushClosedKlines: " << name << " write failed, " << it->second.size() << " klines retried later" << std::endl;
+        retryCount += it->second.size();
+        retry.emplace(name, std::move(it->second));
+        auto seq = pendingMinSeq_.find(name);
+        if (seq != pendingMinSeq_.end()) retrySeq.emplace(name, seq->second);
+        auto ids = pendingStreamIds_.find(name);
+        if (ids != pendingStreamIds_.end()) {
+            retryIds.emplace(name, std::move(ids->second));
+            pendingStreamIds_.erase(ids);
+        }
+    }
 
-            mongoM.WriteClosedKlines(DB_MARKETINFO, vec);
+    // the rest is in Mongo now, its stream entries can go
+    if (!pendingStreamIds_.empty()) {
+        std::vector<std::string> stored;
+        for (auto& [colName, ids] : pendingStreamIds_) {
+            stored.insert(stored.end(), std::make_move_iterator(ids.begin()), std::make_move_iterator(ids.end()));
         }
+        acknowledgeStored(stored);
     }
+    pendingKlines_ = std::move(retry);
+    pendingMinSeq_ = std::move(retrySeq);
+    pendingStreamIds_ = std::move(retryIds);
+    pendingKlineCount_ = retryCount;
+    last_persist_time = std::chrono::steady_clock::now();
 }
 
-void BinanceDataSync::handle_history_market_data_sync() {
-    // sync all symbols and intervals with multi-thread
+void BinanceDataSync::handle_history_market_data_sync(int64_t gapFromMs) {
+    // sync all symbols and intervals with a bounded worker pool, one page per job turn
     try {
-        std::vector<std::thread> syncThreads;
+        // the series furthest behind (smallest next start time) is served first
+        auto behind = [](const HistorySyncJob& a, const HistorySyncJob& b) { return a.nextStartMs > b.nextStartMs; };
+        std::priority_queue<HistorySyncJob, std::vector<HistorySyncJob>, decltype(behind)> jobs(behind);
+        std::vector<HistorySyncJob> planned;
         for (auto symbol : marketSymbols) {
+            std::transform(symbol.begin(), symbol.end(), symbol.begin(), ::toupper);
             for (auto interval : marketIntervals) {
-                syncThreads.push_back(std::thread(&BinanceDataSync::syncOneSymbol, this, symbol, interval, 1000));
+                // one series that can't be planned (Mongo unreachable) must not cost the others their sync
+                try {
+                    planHistoryJobs(symbol, interval, planned, gapFromMs);
+                }
+                catch (const std::exception& e) {
+                    std::cerr << "planHistoryJobs error for " << symbol << "_" << interval << ", not synced in this pass: " << e.what() << std::endl;
+                }
             }
         }
+        for (size_t i = 0; i < planned.size(); ++i) {
+            planned[i].series = i;
+            jobs.push(std::move(planned[i]));
+        }
+
+        // pages are written behind the fetches, a series keeps fetching while its previous page is upserted
+        HistoryPageWriter pageWriter(*mongoWriters_, historyMaxOutstandingPages);
+
+        std::mutex jobsMutex;
+        std::condition_variable jobsCv;
+        size_t inFlight = 0;
+        auto worker = [&] {
+            while (true) {
+                HistorySyncJob job;
+                {
+                    std::unique_lock<std::mutex> lock(jobsMutex);
+                    // a job in flight may come back, only stop when nothing is queued or running
+                    jobsCv.wait(lock, [&] { return !jobs.empty() || inFlight == 0; });
+                    if (jobs.empty()) return;
+                    job = jobs.top();
+                    jobs.pop();
+                    ++inFlight;
+                }
 
-        for (auto& t : syncThreads) {
+                bool more = false;
+                try {
+                    more = syncHistoryPage(job, pageWriter);
+                }
+                catch (const std::exception& e) {
+                    std::cerr << "syncHistoryPage error for " << job.symbol << "_" << job.interval << ": " << e.what() << std::endl;
+                    more = ++job.failures < HISTORY_MAX_FAILURES;
+                }
+
+                std::lock_guard<std::mutex> lock(jobsMutex);
+                --inFlight;
+                if (more) jobs.push(std::move(job));
+                jobsCv.notify_all();
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < historyWorkers; ++i) {
+            workers.emplace_back(worker);
+        }
+        for (auto& t : workers) {
             t.join();
         }
+        pageWriter.drain();
         std::cout << "handle_history_market_data_sync done, go ahead for subscribe market info." << std::endl;
     }
     catch(const std::exception& e) {
@@ -126,390 +564,242 @@ void BinanceDataSync::handle_history_market_data_sync() {
     }
 }
 
-void BinanceDataSync::handle_history_gap_fill() {
-    std::cout << "Start gap fill" << std::endl;
-    handle_history_market_data_sync();
+void BinanceDataSync::handle_history_gap_fill(int64_t gapFromMs) {
+    std::cout << "Start gap fill" << (gapFromMs ? " from " + std::to_string(gapFromMs) : std::string()) << std::endl;
+    handle_history_market_data_sync(gapFromMs);
 }
 
-std::string BinanceDataSync::subscribeRequest(const std::vector<std::string>& symbol, const std::vector<std::string>& interval) {
-    std::ostringstream oss;
-    std::string subscribePrefix = "{\"method\": \"SUBSCRIBE\", \"params\": [";
-    std::string timeframeSuffix = "kline_";
-    
-    oss << subscribePrefix;
+std::vector<std::vector<std::string>> BinanceDataSync::shardStreams(const std::vector<std::string>& symbol, const std::vector<std::string>& interval, size_t streamsPerConnection) const {
+    std::vector<std::string> streams;
+    streams.reserve(symbol.size() * interval.size());
     for (size_t i = 0; i < symbol.size(); ++i) {
         for (size_t j = 0; j < interval.size(); ++j) {
-            oss << "\"" << symbol[i] << "@" << timeframeSuffix << interval[j] << "\",";
+            streams.push_back(symbol[i] + "@kline_" + interval[j]);
         }
     }
 
-    // remove the last comma
-    std::string subscribeRequest = oss.str();
-    subscribeRequest.pop_back();
-    oss.str("");
-    oss.clear();
-    oss << subscribeRequest;
-    oss << "], \"id\": 1}";
-    return oss.str();
+    // spread the streams evenly instead of filling the first shards up to the cap
+    size_t shardCount = std::max<size_t>(1, (streams.size() + streamsPerConnection - 1) / streamsPerConnection);
+    std::vector<std::vector<std::string>> shards(shardCount);
+    for (size_t i = 0; i < streams.size(); ++i) {
+        shards[i % shardCount].push_back(std::move(streams[i]));
+    }
+    return shards;
 }
 
-bool BinanceDataSync::connect_noexcept(){
-    // Reset the WebSocket stream before connecting
-    reset_websocket();
-    beast::error_code ec;
+// TODO:
+// Important! History data sync: 
+//    when the connection is lost for a long time, we need to re-sync the history data for all symbols and intervals
+void BinanceDataSync::onShardReconnected(size_t shardId, int64_t disconnectedAtMs) {
+    // the live klines flushed since the re-connect moved the watermark past the outage, the gap fill must start
+    // from the disconnect rather than from the latest synced kline
+    int64_t from = gapfill_from_ms_.load();
+    while ((from == 0 || disconnectedAtMs < from) && !gapfill_from_ms_.compare_exchange_weak(from, disconnectedAtMs)) {}
+
+    // history Klines gap fill, one pass covers every series so concurrent shard re-connects collapse into it
+    std::thread([this, shardId] {
+        // atomic flag
+        if (gapfill_running_.exchange(true)) return;
+        std::cout << "Shard " << shardId << " re-connected, start history gap fill" << std::endl;
+        // again while shards re-connected during the pass
+        while (int64_t gapFromMs = gapfill_from_ms_.exchange(0)) {
+            handle_history_gap_fill(gapFromMs);
+        }
+        gapfill_running_ = false;
+    }).detach();
+}
 
-    // SNI: set the server name indication for the TLS(SSL) context in Hello message, so that the server can present the correct certificate
-    if (!SSL_set_tlsext_host_name(ws_stream_->next_layer().native_handle(), "stream.binance.com")) {
-        return false;
-    }
+void BinanceDataSync::planHistoryJobs(const std::string& symbol, const std::string& interval, std::vector<HistorySyncJob>& jobs, int64_t gapFromMs) {
+    auto colName = symbol + "_" + interval + "_Binance";
+    HistorySyncJob job;
+    job.symbol = symbol;
+    job.interval = interval;
 
-    // Resolve the Binance WebSocket server address
-    tcp::resolver resolver{ ioc_ };
-    auto res = resolver.resolve("stream.binance.com", "9443", ec);
-    if (ec) {
-        std::cerr << "Error resolving WebSocket server: " << ec.message() << std::endl;
-        return false;
+    const KlineInterval* info = intervalById(intervalId(interval));
+    int64_t firstStart = -1;
+    if (historyPartitioned && info && interval != "1M") {
+        firstStart = firstKlineTime(symbol, interval, static_cast<int64_t>(historyKlineSyncStartMs));
     }
-
-    // Connect to the server use TCP layers
-    net::connect(ws_stream_->next_layer().next_layer(), res, ec);
-    if (ec) {
-        std::cerr << "Error connecting to WebSocket server: " << ec.message() << std::endl;
-        return false;
+    std::vector<int64_t> done;
+    if (firstStart >= 0) {
+        try {
+            done = mongoM.GetCompletedBackfillChunks(DB_MARKETINFO, colName, static_cast<int64_t>(historyChunkPages * HISTORY_PAGE_LIMIT) * info->ms);
+        }
+        catch (const std::exception& e) {
+            std::cerr << "planHistoryJobs " << colName << ": no backfill chunk map, synced serially: " << e.what() << std::endl;
+            firstStart = -1;
+        }
     }
-
-    // Perform the TLS handshake(based on the old-school SSL context)
-    ws_stream_->next_layer().handshake(net::ssl::stream_base::client, ec);
-    if (ec) {
-        std::cerr << "Error during TLS handshake: " << ec.message() << std::endl;
-        return false;
+    if (firstStart < 0) {
+        // serial: walk forward from the latest synced kline, also the fallback when the partitioned plan fails
+        int64_t startTime = 0;
+        int64_t endTime = 0;
+        mongoM.GetLatestSyncedTime(DB_MARKETINFO, colName, startTime, endTime);
+        job.nextStartMs = (startTime == 0) ? static_cast<int64_t>(historyKlineSyncStartMs) : (endTime + 1);
+        if (startTime != 0 && gapFromMs > 0) {
+            // one bar before the disconnect, the bar in progress then may not have closed live
+            job.nextStartMs = std::min(job.nextStartMs, gapFromMs - (info ? info->ms : 0));
+        }
+        jobs.push_back(std::move(job));
+        return;
     }
 
-    // TODO: check the server certificate, if needed
-    //SSL_set1_host(ssl, "stream.binance.com");
-    //ssl_ctx_.set_verify_mode(boost::asio::ssl::verify_peer);
-    //ssl_ctx_.set_default_verify_paths();
-
-    ws_stream_->set_option(websocket::stream_base::timeout::suggested(beast::role_type::client));
-
-    // Perform the WebSocket handshake
-    ws_stream_->handshake("stream.binance.com", "/ws", ec);
-    if (ec) {
-        std::cerr << "Error during WebSocket handshake: " << ec.message() << std::endl;
-        return false;
+    // partitioned: fixed chunks on a grid anchored at kline_sync_start_ms, so every run cuts the same chunks
+    // and the completion map tells which ones are still missing. Chunks are written out of order.
+    const int64_t origin = static_cast<int64_t>(historyKlineSyncStartMs);
+    const int64_t chunkMs = static_cast<int64_t>(historyChunkPages * HISTORY_PAGE_LIMIT) * info->ms;
+    std::unordered_set<int64_t> completed(done.begin(), done.end());
+
+    int64_t now = now_in_ms();
+    int64_t start = origin + (std::max(firstStart, origin) - origin) / chunkMs * chunkMs;
+    size_t missing = 0;
+    for (; start + chunkMs <= now; start += chunkMs) {
+        if (completed.count(start)) continue;
+        HistorySyncJob chunk = job;
+        chunk.nextStartMs = start;
+        chunk.endMs = start + chunkMs;
+        chunk.chunkStartMs = start;
+        chunk.chunkMs = chunkMs;
+        jobs.push_back(std::move(chunk));
+        ++missing;
     }
 
-    // Send a subscription message to the WebSocket server
-    std::string json_message = subscribeRequest(marketSymbols, marketIntervals);
-    std::cout << "Sending message: " << json_message << std::endl;
-    ws_stream_->write(net::buffer(json_message), ec);
-    if (ec) {
-        std::cerr << "Error sending subscription message: " << ec.message() << std::endl;
-        return false;
-    }
+    // the chunk still growing is synced like a serial series and never marked complete
+    job.nextStartMs = gapFromMs > 0 ? std::min(start, gapFromMs - info->ms) : start;
+    jobs.push_back(std::move(job));
 
-    return true;
+    std::cout << "planHistoryJobs " << colName << ": " << missing << " missing chunks, " << completed.size()
+        << " completed, tail from " << start << std::endl;
 }
 
-void BinanceDataSync::reset_websocket() {
-    beast::error_code ec;
-    if (ws_stream_) {
-        if (ws_stream_->is_open()) {
-            ws_stream_->close(websocket::close_code::normal, ec);
-            ec = {};
-        }
-
-        auto& tls_session = ws_stream_->next_layer();
-        auto& tcp_socket = ws_stream_->next_layer().next_layer();
-        
-        if (tcp_socket.is_open()) {
-            // close the underlying TLS stream
-            tls_session.shutdown(ec);
-            if (ec) {
-                std::cerr << "Error shutting down TLS stream: " << ec.message() << std::endl;
-            }
-
-            tcp_socket.shutdown(tcp::socket::shutdown_both, ec);
-            if (ec) {
-                std::cerr << "Error shutting down TCP socket: " << ec.message() << std::endl;
-            }
-
-            tcp_socket.close(ec);
-            if (ec) {
-                std::cerr << "Error closing TCP socket: " << ec.message() << std::endl;
-            }
-        }
-        std::cout << "WebSocket stream reset successfully. Ready to re-connect to server..." << std::endl;
+int64_t BinanceDataSync::firstKlineTime(const std::string& symbol, const std::string& interval, int64_t fromMs) {
+    std::vector<KlineResponseWs> first;
+    try {
+        if (!klineRestReq(symbol, interval, std::to_string(fromMs), "", "1", first)) return -1;
     }
-    else {
-        std::cout << "WebSocket stream is not initialized, creating a new one..." << std::endl;
+    catch (const std::exception& e) {
+        // DNS, connect or TLS failure of the REST client
+        std::cerr << "firstKlineTime error for " << symbol << "_" << interval << ": " << e.what() << std::endl;
+        return -1;
     }
-    
-    // Clear the buffer, avoiding buffer left across the multi connections
-    buffer_.consume(buffer_.size());
-
-    // Reset the WebSocket stream
-    ws_stream_.reset(new WsStream(ioc_, ssl_ctx_));
-    
+    return first.empty() ? -1 : first.front().StartTime;
 }
 
-void BinanceDataSync::asyncReadLoop(){
-    auto self = shared_from_this();
-    ws_stream_->async_read(
-        buffer_,
-        net::bind_executor(strand_,
-            [this, self](beast::error_code ec, std::size_t n) {  // self is used to keep the shared_ptr alive, add one more reference. otherwise, the shared_ptr may be destroyed before the callback is called.
-                if (ec) {
-                    // 0. clear the buffer!!!
-                    buffer_.consume(buffer_.size());
-
-                    // 1. scheduledReconnect has cancelled this operation, taken over by it so no need to reconnect
-                    if (ec == net::error::operation_aborted) {
-                        std::cerr << "WS read ended: " << ec.message() << std::endl;
-                        return;
-                    }
-
-                    // 2. if the connection is closed by other reason, then reconnect
-                    if (!reconnecting_) {
-                        scheduleReconnect();
-                    }
-                    return; 
-                }
-
-                std::string msg = beast::buffers_to_string(buffer_.data());
-                
-                // buffer_.consume(n);
-                buffer_.consume(buffer_.size());
+bool BinanceDataSync::syncHistoryPage(HistorySyncJob& job, HistoryPageWriter& pageWriter) {
+    const std::string& upperCaseSymbol = job.symbol;
+    const std::string& interval = job.interval;
 
-                // std::cout << "AsyncReadLoop received message: " << msg << std::endl;
-
-                // Process the received market data
-                mkdsM.publishGlobalKlines(msg);
-
-                // read from the stream
-                asyncReadLoop();
-            }
-        )
-    );
-}
+    // a page written behind us failed, fetch again from there
+    if (int64_t failedStart = pageWriter.takeFailedStart(job.series)) {
+        std::cerr << "syncHistoryPage rewinds " << upperCaseSymbol << "_" << interval << " to " << failedStart << " after a failed write" << std::endl;
+        job.nextStartMs = failedStart;
+    }
 
-// TODO:
-// 1. Silent packet loss: when DROP packets, the server will not send any error message, so we need to handle this case. 
-//    Use watchdog to detect the connection status?
-// 2. Important! History data sync: 
-//    when the connection is lost for a long time, we need to re-sync the history data for all symbols and intervals
+    // from milliseconds to seconds
+    std::time_t time_sec = job.nextStartMs / 1000;
+    // transform to std::tm structure
+    std::tm* tm_ptr = std::gmtime(&time_sec);  // utc
 
-void BinanceDataSync::scheduleReconnect() {
-    net::post(strand_, [this, self = shared_from_this()] {
-        if (reconnecting_) return;
-        reconnecting_ = true;
-
-        // 1. stop ping timer
-        ping_running_ = false;
-        beast::error_code ec;
-        ping_timer_.cancel(ec);
-
-        // 2. close ws and cancel all the suspend I/O, an operation_aborted code will be returned
-        if (ws_stream_ && ws_stream_->is_open()) {
-            ws_stream_->async_close(websocket::close_code::normal,
-                net::bind_executor(strand_, [](beast::error_code) { /* quiet */ }));
-        }
-
-        // 3. stop reconnect timer
-        ec = {};
-        reconnect_timer_.cancel(ec);
-        reconnect_timer_.expires_after(std::chrono::seconds(5));
-        reconnect_timer_.async_wait(
-            net::bind_executor(strand_,  // also put the reconnect operation in the strand
-                [this, self](beast::error_code tec) {
-                    reconnecting_ = false;
-                    if (tec == net::error::operation_aborted) return;
-                    if (!connect_noexcept()) { scheduleReconnect(); return; }
-                    startPing(); // restart the ping timer to keep the connection alive
-                    asyncReadLoop();
-
-                    // history Klines gap fill
-                    std::thread([this] {
-                        // atomic flag
-                        if (gapfill_running_.exchange(true)) return;
-                        handle_history_gap_fill();
-                        gapfill_running_ = false;
-                    }).detach();
+    // print the time in a human-readable format
+    std::cout << "SyncOneSymbol starts from the next starttime time: ";
+    std::cout << std::put_time(tm_ptr, "%Y-%m-%d %H:%M:%S") << " UTC: " << job.nextStartMs << " for " << upperCaseSymbol << "_" << interval << std::endl;
+
+    std::vector<KlineResponseWs> FetchedKlines_ws;
+    std::string endTime = job.endMs ? std::to_string(job.endMs - 1) : "";
+    if (!klineRestReq(upperCaseSymbol, interval, std::to_string(job.nextStartMs), endTime, std::to_string(HISTORY_PAGE_LIMIT), FetchedKlines_ws)) {
+        // throttled or failed, the limiter holds the next request back as long as needed
+        if (++job.failures >= HISTORY_MAX_FAILURES) {
+            std::cerr << "syncHistoryPage gives up on " << upperCaseSymbol << "_" << interval << " after " << job.failures << " failed requests" << std::endl;
+            return false;
+        }
+        return true;
+    }
+    job.failures = 0;
 
-                }
-            )
-        );
-    });
-}
+    // a tmp vector for those to be written to mongo
+    std::vector<KlineResponseWs> KlinesToBeWritten_ws;
+    KlinesToBeWritten_ws.reserve(FetchedKlines_ws.size());
 
-void BinanceDataSync::syncOneSymbol(std::string symbol, std::string interval, uint64_t limit){
-    // convert limit to string
-    std::ostringstream oss;
-    oss << limit;
-    std::string limitStr = oss.str();
-    std::string upperCaseSymbol(symbol);
-    std::transform(upperCaseSymbol.begin(), upperCaseSymbol.end(), upperCaseSymbol.begin(), ::toupper);
+    // filter the Fetched klines, remove the latest one as it's not closed yet.
+    for (auto& kline_ws : FetchedKlines_ws) {
+        // convert KlineResponseWs to Kline
+        Kline klineInst = KlineResponseWs::toKline(kline_ws);
 
-    while(true){
-        // check start time from mongo lasted kline
-        int64_t startTime = 0;
-        int64_t endTime = 0;
-        mongoM.GetLatestSyncedTime(DB_MARKETINFO, upperCaseSymbol + "_" + interval + "_Binance", startTime, endTime);
-        int64_t nextStartMs = (startTime == 0) ? historyKlineSyncStartMs : (endTime + 1);
-
-        // from milliseconds to seconds
-        std::time_t time_sec = nextStartMs / 1000;
-        // transform to std::tm structure
-        std::tm* tm_ptr = std::gmtime(&time_sec);  // utc
-
-        // print the time in a human-readable format
-        std::cout << "SyncOneSymbol starts from the next starttime time: ";
-        std::cout << std::put_time(tm_ptr, "%Y-%m-%d %H:%M:%S") << " UTC: " << nextStartMs << " for " << upperCaseSymbol << "_" << interval << std::endl;
-
-        // int_64 endTime convert to string
-        std::string nextStartTime = std::to_string(nextStartMs);
-        auto FetchedKlines_ws = klineRestReq(upperCaseSymbol, interval, nextStartTime, "", limitStr);
-
-        // a tmp vector for those to be written to mongo
-        std::vector<KlineResponseWs> KlinesToBeWritten_ws;
-        KlinesToBeWritten_ws.reserve(FetchedKlines_ws.size());
-
-        // filter the Fetched klines, remove the latest one as it's not closed yet.
-        for (auto& kline_ws : FetchedKlines_ws) {
-            // convert KlineResponseWs to Kline
-            Kline klineInst = KlineResponseWs::toKline(kline_ws);
-
-            bool closed = is_closed_by_time(klineInst, now_in_ms());
-            if (!closed) {
-                std::cout << "Processing non-final kline: " << klineInst.StartTime << " for " << upperCaseSymbol << "_" << interval << std::endl;
-                continue;
-            }
-            KlinesToBeWritten_ws.push_back(kline_ws); // make sure non-final out
+        bool closed = is_closed_by_time(klineInst, now_in_ms());
+        if (!closed) {
+            std::cout << "Processing non-final kline: " << klineInst.StartTime << " for " << upperCaseSymbol << "_" << interval << std::endl;
+            continue;
         }
+        KlinesToBeWritten_ws.push_back(kline_ws); // make sure non-final out
+    }
 
-        if (KlinesToBeWritten_ws.empty()) {
-            std::cout << "syncOneSymbol reach end, No closed klines to write for " << upperCaseSymbol << "_" << interval << std::endl;
-            return; // no closed klines to write, exit the loop
-        }
+    if (KlinesToBeWritten_ws.empty()) {
+        std::cout << "syncOneSymbol reach end, No closed klines to write for " << upperCaseSymbol << "_" << interval << std::endl;
+        return finishHistorySeries(job, pageWriter); // no closed klines to write, the series is done
+    }
 
-        // Write the klines to MongoDB
-        auto colName = upperCaseSymbol + "_" + interval + "_Binance";
-        mongoM.BulkWriteClosedKlines(DB_MARKETINFO, colName, KlinesToBeWritten_ws);
+    // the next start time comes from this page, so the next fetch does not wait for the write
+    size_t fetched = KlinesToBeWritten_ws.size();
+    job.nextStartMs = KlinesToBeWritten_ws.back().EndTime + 1;
 
-        if (KlinesToBeWritten_ws.size() < limit) {
-            // means the data is up to date
-            std::cout << "syncOneSymbol reach end, Fetched last " << KlinesToBeWritten_ws.size() << " klines for " << upperCaseSymbol << "_" << interval << std::endl;
-            return;
-        }
+    // Write the klines to MongoDB, queued behind the fetches
+    auto colName = upperCaseSymbol + "_" + interval + "_Binance";
+    pageWriter.submit(job.series, colName, std::move(KlinesToBeWritten_ws));
+
+    if (fetched < HISTORY_PAGE_LIMIT || (job.endMs && job.nextStartMs >= job.endMs)) {
+        // means the data is up to date, or the chunk is complete
+        std::cout << "syncOneSymbol reach end, Fetched last " << fetched << " klines for " << upperCaseSymbol << "_" << interval << std::endl;
+        return finishHistorySeries(job, pageWriter);
     }
+    return true;
 }
 
-std::vector<KlineResponseWs> BinanceDataSync::klineRestReq(std::string symbolUpperCase, std::string interval, std::string startTime, std::string endTime, std::string limitStr) {
-    // Important! Create a new io_context and SSL context for HTTP request
-    net::io_context http_ioc;
-    net::ssl::context http_ssl(net::ssl::context::tlsv12_client);
-
-    // Set up HTTP request
-    beast::ssl_stream<tcp::socket> stream(http_ioc, http_ssl);
-    if (!SSL_set_tlsext_host_name(stream.native_handle(), "api.binance.com")) {
-        beast::error_code ec{static_cast<int>(::ERR_get_error()), net::error::get_ssl_category()};
-        throw beast::system_error{ec};
+bool BinanceDataSync::finishHistorySeries(HistorySyncJob& job, HistoryPageWriter& pageWriter) {
+    // the series is only done once its last page is in Mongo
+    pageWriter.waitSeries(job.series);
+    if (int64_t failedStart = pageWriter.takeFailedStart(job.series)) {
+        std::cerr << "syncHistoryPage rewinds " << job.symbol << "_" << job.interval << " to " << failedStart << " after a failed write" << std::endl;
+        job.nextStartMs = failedStart;
+        return ++job.failures < HISTORY_MAX_FAILURES;
     }
+    if (job.endMs) {
+        // a failed mark only costs a re-fetch of this chunk on the next run
+        mongoM.MarkBackfillChunkCompleted(DB_MARKETINFO, job.symbol + "_" + job.interval + "_Binance", job.chunkMs, job.chunkStartMs, job.endMs);
+    }
+    return false;
+}
 
-    // New TCP resolver for the HTTP request
-    tcp::resolver resolver(http_ioc);
-    auto results = resolver.resolve("api.binance.com", "https");
-    net::connect(stream.next_layer(), results.begin(), results.end());
-    stream.handshake(net::ssl::stream_base::client);
-
+bool BinanceDataSync::klineRestReq(const std::string& symbolUpperCase, const std::string& interval, const std::string& startTime, const std::string& endTime, const std::string& limitStr, std::vector<KlineResponseWs>& wsKlines) {
     // Set up the target URL and HTTP request parameters
     std::string target = "/api/v3/klines?symbol=" + symbolUpperCase + "&interval=" + interval + "&startTime=" + startTime + "&limit=" + limitStr;
+    if (!endTime.empty()) {
+        target += "&endTime=" + endTime;
+    }
     std::cout << "Requesting: " << target << std::endl;
-    int version = 11;
 
-    http::request<http::string_body> req{http::verb::get, target, version};
-    req.set(http::field::host, "api.binance.com");
-    req.set(http::field::user_agent, BOOST_BEAST_VERSION_STRING);
-    req.set(http::field::content_type, "application/json");
-    // req.set("X-MBX-APIKEY", "YOUR_API_KEY");
+    // every history request of the process goes through the same weight budget
+    weightLimiter_.acquire(KLINES_REQUEST_WEIGHT);
 
-    // Send the HTTP request to the remote host
-    http::write(stream, req);
+    // pooled keep-alive connection, the TCP and TLS setup is only paid once per connection
+    auto res = restClient_.get(target);
 
-    // Buffer for reading the response
-    beast::flat_buffer buffer;
+    auto header = [&](const char* name) {
+        auto v = res[name];
+        return std::string(v.data(), v.size());
+    };
+    std::string usedWeight = header("X-MBX-USED-WEIGHT-1M");
+    if (usedWeight.empty()) usedWeight = header("X-MBX-USED-WEIGHT");
+    weightLimiter_.onResponse(res.result_int(), usedWeight, header("Retry-After"));
 
-    // Container for the response
-    http::response<http::dynamic_body> res;
-
-    // Receive the HTTP response
-    http::read(stream, buffer, res);
-
-    // Gracefully close the stream
-    beast::error_code ec;
-    stream.shutdown(ec);
-    if (ec == net::error::eof) {
-        ec = {};
-    }
-
-    std::vector<KlineResponseWs> wsKlines;
     // Parse the response and insert into MongoDB
     if (res.result() == http::status::ok) {
-        auto body = boost::beast::buffers_to_string(res.body().data());
-
         // Parse the kline data and insert into MongoDB
-        KlineResponseWs::parseKlineWs(body, symbolUpperCase, interval, wsKlines);
+        wsKlines.reserve(HISTORY_PAGE_LIMIT);
+        parseKlineRestArray(res.body(), symbolUpperCase, interval, wsKlines);
         std::cout << "Fetched " << wsKlines.size() << " klines for " << symbolUpperCase << "_" << interval << std::endl;
-        return wsKlines;
+        return true;
     } else {
-        std::cerr << "Failed to fetch klines. Status code: " << res.result_int() << std::endl;
-        return std::vector<KlineResponseWs>();
+        std::cerr << "Failed to fetch klines. Status code: " << res.result_int() << " " << res.body() << std::endl;
+        return false;
     }
 }
-
-void BinanceDataSync::startPing() {
-    // put the ping operation in the strand to ensure it runs in the correct order
-    net::post(strand_, [this, self = shared_from_this()] {
-        if (ping_running_) return;
-        ping_running_ = true;
-        scheduleNextPing();
-        });
-}
-
-void BinanceDataSync::stopPing() {
-    net::post(strand_, [this, self = shared_from_this()] {
-        ping_running_ = false;
-        beast::error_code ec;
-        ping_timer_.cancel(ec); // stop the ping timer
-        });
-}
-
-// heart beat for the WebSocket connection
-void BinanceDataSync::scheduleNextPing() {
-    if (!ping_running_ || reconnecting_) return;          // reconnecting or ping not used, then do not schedule next ping
-    if (!ws_stream_ || !ws_stream_->is_open()) return;    // no ws or ws not open, then do not schedule next ping
-
-    ping_timer_.expires_after(ping_interval_);
-    ping_timer_.async_wait(
-        net::bind_executor(strand_,
-            [this, self = shared_from_this()](beast::error_code ec) {
-                if (!ping_running_) return;
-                if (ec == net::error::operation_aborted) return;
-                if (!ws_stream_ || !ws_stream_->is_open()) return;
-
-                ws_stream_->async_ping(websocket::ping_data{},
-                    net::bind_executor(strand_,
-                        [this, self](beast::error_code pec) {
-                            if (!ping_running_) return;
-                            if (pec == net::error::operation_aborted || pec == websocket::error::closed) return;
-                            if (pec) {
-                                // reconnect if ping failed
-                                scheduleReconnect();
-                                return;
-                            }
-                            scheduleNextPing();
-                        })
-                );
-            })
-    );
-}
@@ -8,26 +8,44 @@
 #include <chrono>
 #include <mutex>
 #include <condition_variable>
+#include <map>
 #include <queue>
+#include <unordered_map>
 #include <vector>
 #include <boost/asio.hpp>
 #include <boost/beast.hpp>
 #include <boost/beast/websocket.hpp>
 #include <boost/beast/ssl.hpp>
 
+#include "dataSync/historyPageWriter.h"
+#include "dtos/intervals.h"
+#include "dataSync/restClient.h"
+#include "dataSync/weightLimiter.h"
+#include "dataSync/wsShard.h"
+#include "utils/mpmcRing.h"
+#include "dataSync/klineQueryServer.h"
+#include "db/klineArchive.h"
+#include "db/klineCache.h"
+#include "db/klineJournal.h"
+#include "db/latestKlineTable.h"
 #include "db/marketDataStreamManager.h"
 #include "db/mongoManager.h"
+#include "db/mongoWriterPool.h"
 #include "config/config.h"
 
-// when subscribe a multi combined streams in binance，payload will be like {"stream":"<streamName>","data":<rawPayload>}
-// but for kline, it is received one by one even in multi streams
-namespace net = boost::asio;
-namespace beast = boost::beast;
-namespace http = beast::http;
-namespace websocket = beast::websocket;
-
-using tcp = boost::asio::ip::tcp;
-using WsStream = boost::beast::websocket::stream<boost::beast::ssl_stream<boost::asio::ip::tcp::socket>>;
+// One symbol × interval series of the history sync, re-queued after every page until it is up to date
+struct HistorySyncJob {
+    size_t series = 0;    // index of the series in this sync pass
+    std::string symbol;   // upper case
+    std::string interval;
+    int64_t nextStartMs = 0;
+    int failures = 0;     // consecutive failed requests
+
+    // partitioned backfill chunk [chunkStartMs, endMs), endMs is 0 for a series synced up to now
+    int64_t endMs = 0;
+    int64_t chunkStartMs = 0;
+    int64_t chunkMs = 0;
+};
 
 // Class for handling Binance data synchronization
 class BinanceDataSync : public std::enable_shared_from_this<BinanceDataSync>{
@@ -35,14 +53,10 @@ public:
     BinanceDataSync(const std::string& iniConfig);
     void start();
 
-    // WS Ping/Pong
-    void startPing();
-    void stopPing();
-    void scheduleNextPing();
-    
     // Handle history market data synchronization
-    void handle_history_market_data_sync();
-    void handle_history_gap_fill(); // same as handle_history_market_data_sync, but for gap fill
+    // gapFromMs: also re-fetch every series from this time on, for holes behind the collection watermark
+    void handle_history_market_data_sync(int64_t gapFromMs = 0);
+    void handle_history_gap_fill(int64_t gapFromMs = 0); // same as handle_history_market_data_sync, but for gap fill
 
     // Handle incoming WebSocket messages
     void handle_market_data_subscribe();
@@ -50,15 +64,35 @@ public:
     // Handle data persistence
     void handle_data_persistence();
 
+    // Dispatch global_klines_stream to the per-symbol streams, used when closed klines reach persistence in-process.
+    // The closed klines it reads go to the persistence thread too, for their entry ids: acknowledged here once stored
+    void handle_market_data_dispatch();
+
+    // Apply the kline journal to MongoDB, from its checkpoint on
+    void handle_journal_apply();
+
 private:
-    std::string subscribeRequest(const std::vector<std::string>& symbol, const std::vector<std::string>& interval);
+    // create the kline collections in the configured layout and the indexes the sync relies on
+    void provision_kline_collections();
+    // loads the latest klines of every series into recentKlines_, one query per series
+    void warm_kline_cache();
+
+    // split symbol × interval streams into shards of at most streamsPerConnection
+    std::vector<std::vector<std::string>> shardStreams(const std::vector<std::string>& symbol, const std::vector<std::string>& interval, size_t streamsPerConnection) const;
 
-    bool connect_noexcept();
-    void reset_websocket();
+    // a shard re-connected, its streams may have missed klines during the outage
+    void onShardReconnected(size_t shardId, int64_t disconnectedAtMs);
 
-    void asyncReadLoop();
+    // called in a shard strand for every ws frame
+    void onMarketFrame(const char* data, size_t len);
 
-    void scheduleReconnect();
+    // write-behind batching of the live closed klines, see BATCH_SIZE / BATCH_TIMEOUT
+    // firstSeq is the journal sequence number of closedKlines[0], 0 when they are not journaled;
+    // streamIds are their global_klines_stream entries, acknowledged once the flush stored them
+    void bufferClosedKlines(const std::vector<KlineResponseWs>& closedKlines, uint64_t firstSeq = 0, const std::vector<std::string>* streamIds = nullptr);
+    void flushClosedKlines();
+    // XACK once stored; in handoff mode queued for handle_market_data_dispatch, which owns the consumer connection
+    void acknowledgeStored(std::vector<std::string>& streamIds);
 
     inline int64_t now_in_ms() {
         using namespace std::chrono;
@@ -75,13 +109,37 @@ private:
         return 0;
     };
 
-    void syncOneSymbol(std::string symbol, std::string interval, uint64_t limit);
+    // one serial job per series, or the missing chunks plus a tail job in partitioned mode
+    void planHistoryJobs(const std::string& symbol, const std::string& interval, std::vector<HistorySyncJob>& jobs, int64_t gapFromMs = 0);
+    // start time of the first kline at or after fromMs, -1 if unknown
+    int64_t firstKlineTime(const std::string& symbol, const std::string& interval, int64_t fromMs);
 
-    std::vector<KlineResponseWs>  klineRestReq(std::string symbolUpperCase, std::string interval, std::string startTime, std::string endTime, std::string limitStr);
+    // fetch one page of the series and queue it for writing, true if the job has more pages
+    bool syncHistoryPage(HistorySyncJob& job, HistoryPageWriter& pageWriter);
+    // wait for the last page of the series to be written, true if it failed and the job must go on
+    bool finishHistorySeries(HistorySyncJob& job, HistoryPageWriter& pageWriter);
+
+    // false if the request was rejected or throttled, the response weight is fed back to weightLimiter_
+    bool klineRestReq(const std::string& symbolUpperCase, const std::string& interval, const std::string& startTime, const std::string& endTime, const std::string& limitStr, std::vector<KlineResponseWs>& wsKlines);
 
     Config cfg;
     MarketDataStreamManager mkdsM;
     MongoManager mongoM;
+    std::unique_ptr<KlineArchiveWriter> archive_; // fed by mongoM, null when archive.dir is empty
+    std::unique_ptr<KlineCache> recentKlines_;    // same, null when persistence.recent_cache_klines is 0
+    std::unique_ptr<KlineQueryServer> queryServer_; // null when neither query.port nor query.unix_path is set
+    std::unique_ptr<LatestKlineTable> latestKlines_; // written by onMarketFrame, null when query.latest_shm_name is empty
+    std::unique_ptr<MongoWriterPool> mongoWriters_; // kline bulk upserts sharded by collection over several threads
+    RestClient restClient_; // keep-alive connections to api.binance.com shared by the history sync threads
+    WeightLimiter weightLimiter_; // Binance request weight budget of the history sync
+
+    size_t historyWorkers = 4;
+    size_t historyMaxOutstandingPages = 2; // per series, fetched and not yet written
+    bool historyPartitioned = false;
+    size_t historyChunkPages = 50; // pages per backfill chunk
+    static constexpr size_t HISTORY_PAGE_LIMIT = 1000;
+    static constexpr int64_t KLINES_REQUEST_WEIGHT = 2; // GET /api/v3/klines
+    static constexpr int HISTORY_MAX_FAILURES = 5;
 
     std::vector<std::string> marketSymbols;
     std::vector<std::string> marketIntervals;
@@ -90,29 +148,41 @@ private:
     std::chrono::steady_clock::time_point last_persist_time;
     const size_t BATCH_SIZE = 100;
     const std::chrono::seconds BATCH_TIMEOUT = std::chrono::seconds(2);
-
-    // io_context and resolver for asynchronous operations,
-    // Could be used in data sync's Multi-Connection-One-Thread model
+    std::unordered_map<std::string, std::map<int64_t, KlineResponseWs>> pendingKlines_; // collection -> start time -> kline, persistence thread only
+    size_t pendingKlineCount_ = 0;
+    std::unordered_map<std::string, std::vector<std::string>> pendingStreamIds_; // collection -> stream entries of its buffered klines
+
+    // write-ahead journal between the fetched klines and MongoDB, null when persistence.journal_dir is empty.
+    // With it the persistence thread only appends, the buffers above belong to the journal apply thread.
+    std::unique_ptr<KlineJournal> journal_;
+    std::unordered_map<std::string, uint64_t> pendingMinSeq_; // collection -> oldest journal seq still buffered
+    static constexpr size_t JOURNAL_MAX_PENDING = 5000;       // stop reading the journal while Mongo lags this far
+
+    // io_context shared by all the ws shards, run by a pool of ioThreads threads.
+    // Each shard serializes its own handlers with a strand, so a slow or dropped socket only stalls itself.
     net::io_context ioc_;
     net::ssl::context ssl_ctx_;
     net::executor_work_guard<net::io_context::executor_type> work_guard_; // block io_context.run() to keep io_context working all the time
-
-    // WS Ping/Pong
-    net::steady_timer ping_timer_;
-    std::chrono::seconds ping_interval_{ std::chrono::minutes(10) };
-
-    // ensure all operations are executed in the same thread
-    // Although io_context only run in one thread, we still use strand to ensure all operations are executed in the same order
-    // Meanwhile, in the future, when we expand the run threads to multi-threads, strand will ensure the operations are executed in the same order
-    net::strand<net::io_context::executor_type> strand_;                  
-
-    tcp::resolver resolver_;
-    beast::flat_buffer buffer_;
-    std::unique_ptr<WsStream> ws_stream_;
-    net::steady_timer reconnect_timer_;
+    size_t ioThreads = 1;
+    size_t streamsPerConnection = 200;
+
+    std::vector<std::shared_ptr<WsShard>> shards_;
+
+    // optional in-process path: closed klines parsed in the shard strands go straight to the persistence thread,
+    // skipping the Redis round-trip and the second json parse. Redis still gets every frame for external consumers.
+    bool inprocessHandoff = false;
+    std::unique_ptr<MpmcRing<KlineResponseWs>> closedKlineRing_;
+    // the persistence thread waits here while the ring is empty, onMarketFrame notifies after each push
+    std::mutex handoffMutex_;
+    std::condition_variable handoffCv_;
+    // under handoffMutex_: the closed klines the dispatch thread read from the stream, buffered by the persistence
+    // thread with their entry ids (a kline already handed off is written once), and the ids stored since then
+    std::vector<GlobalKlineBatch> streamedBatches_;
+    std::vector<std::string> storedStreamIds_;
+    std::atomic<uint64_t> handoffOverflows_{ 0 }; // closed klines that found the ring full
 
     // some flags
     std::atomic_bool gapfill_running_{ false };
-    bool ping_running_ = false;
-    bool reconnecting_ = false;
+    // earliest disconnect of the shards re-connected since the last gap fill started, 0 if none
+    std::atomic<int64_t> gapfill_from_ms_{ 0 };
 };
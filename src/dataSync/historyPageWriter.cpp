@@ -0,0 +1,65 @@
+#include "dataSync/historyPageWriter.h"
+
+#include <algorithm>
+#include <iostream>
+
+HistoryPageWriter::HistoryPageWriter(MongoWriterPool& pool, size_t maxOutstanding) :
+    pool_(pool), maxOutstanding_(std::max<size_t>(1, maxOutstanding))
+{
+}
+
+HistoryPageWriter::~HistoryPageWriter() {
+    // the completions below reference this object
+    drain();
+}
+
+void HistoryPageWriter::submit(size_t series, std::string colName, std::vector<KlineResponseWs> page) {
+    uint64_t epoch;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [&] { return outstanding_[series] < maxOutstanding_; });
+        ++outstanding_[series];
+        epoch = epoch_[series];
+    }
+
+    int64_t pageStart = page.empty() ? 0 : page.front().StartTime;
+    pool_.submit(std::move(colName), std::move(page),
+        [this, series, pageStart](bool ok) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!ok) {
+                // the fetcher rewinds to here, the upserts of later pages are simply repeated
+                failedStart_[series] = pageStart;
+            }
+            --outstanding_[series];
+            cv_.notify_all();
+        },
+        [this, series, epoch] {
+            // after a failure the rest of the series is held back until the fetcher rewinds, and pages fetched
+            // before the rewind are stale: writing either would put klines in Mongo ahead of the gap
+            std::lock_guard<std::mutex> lock(mutex_);
+            return epoch == epoch_[series] && failedStart_.count(series) == 0;
+        },
+        false);
+}
+
+int64_t HistoryPageWriter::takeFailedStart(size_t series) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = failedStart_.find(series);
+    if (it == failedStart_.end()) return 0;
+    int64_t start = it->second;
+    failedStart_.erase(it);
+    ++epoch_[series];
+    return start;
+}
+
+void HistoryPageWriter::waitSeries(size_t series) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [&] { return outstanding_[series] == 0; });
+}
+
+void HistoryPageWriter::drain() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [&] {
+        return std::all_of(outstanding_.begin(), outstanding_.end(), [](const auto& kv) { return kv.second == 0; });
+        });
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "db/mongoWriterPool.h"
+#include "dtos/kline.h"
+
+// Writes fetched history pages to MongoDB behind the REST fetches, so a series can have its next page in flight
+// while the previous one is bulk-written. Pages go to the MongoWriterPool thread of their collection, the one its
+// live flushes use too, and are written in fetch order, so the latest synced time in Mongo never skips a page.
+// submit() blocks while a series already has maxOutstanding pages waiting, which bounds the memory held by fast
+// fetchers.
+class HistoryPageWriter {
+public:
+    HistoryPageWriter(MongoWriterPool& pool, size_t maxOutstanding);
+    ~HistoryPageWriter(); // waits for the pages already submitted
+
+    HistoryPageWriter(const HistoryPageWriter&) = delete;
+    HistoryPageWriter& operator=(const HistoryPageWriter&) = delete;
+
+    // pages are written in full: live flushes move the collection watermark past holes that only history pages
+    // fill, so skipping below it (BulkWriteClosedKlines skipSynced) would drop exactly those klines
+    void submit(size_t series, std::string colName, std::vector<KlineResponseWs> page);
+
+    // start time of the oldest page of the series that failed to write, 0 if none. The fetcher rewinds to it,
+    // pages of the series queued before the call are dropped since they would be written ahead of the gap.
+    int64_t takeFailedStart(size_t series);
+
+    // block until every submitted page of the series is written
+    void waitSeries(size_t series);
+
+    // block until every submitted page is written
+    void drain();
+
+private:
+    MongoWriterPool& pool_;
+    size_t maxOutstanding_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::unordered_map<size_t, size_t> outstanding_;  // pages submitted and not yet written, per series
+    std::unordered_map<size_t, int64_t> failedStart_; // per series
+    std::unordered_map<size_t, uint64_t> epoch_;      // per series, bumped on every rewind
+};
@@ -0,0 +1,153 @@
+#include "dataSync/klineQueryServer.h"
+
+#include <algorithm>
+#include <climits>
+#include <filesystem>
+#include <iostream>
+
+// SYMBOL_INTERVAL_Binance, anything else could name any collection of the database
+static bool validSeriesName(const std::string& series) {
+    static const std::string suffix = "_Binance";
+    if (series.size() <= suffix.size() || series.size() > 64) return false;
+    if (series.compare(series.size() - suffix.size(), suffix.size(), suffix) != 0) return false;
+    return std::all_of(series.begin(), series.end(), [](char c) {
+        return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_';
+        });
+}
+
+// One connection. Requests are read and answered one after the other, so responses come back in request order.
+template <typename Socket>
+class KlineQueryServer::Session : public std::enable_shared_from_this<Session<Socket>> {
+public:
+    Session(KlineQueryServer& server, Socket socket) : server_(server), socket_(std::move(socket)) {}
+
+    void start() { readHeader(); }
+
+private:
+    void readHeader() {
+        auto self = this->shared_from_this();
+        net::async_read(socket_, net::buffer(header_, sizeof(header_)), [self](const boost::system::error_code& ec, size_t) {
+            if (ec) return; // closed by the client
+            size_t len = static_cast<size_t>(kline_record_detail::loadLe(self->header_, 4));
+            if (len < KLINE_QUERY_REQUEST_SIZE || len > KLINE_QUERY_REQUEST_SIZE + 255) {
+                std::cerr << "KlineQueryServer: bad request frame of " << len << " bytes, closing the connection" << std::endl;
+                return;
+            }
+            self->body_.resize(len);
+            self->readBody();
+            });
+    }
+
+    void readBody() {
+        auto self = this->shared_from_this();
+        net::async_read(socket_, net::buffer(body_), [self](const boost::system::error_code& ec, size_t) {
+            if (ec) return;
+            self->out_.clear();
+            KlineQuery q;
+            if (decodeKlineQuery(self->body_.data(), self->body_.size(), q)) {
+                self->server_.answer(q, self->klines_, self->out_);
+            } else {
+                q.id = static_cast<uint32_t>(kline_record_detail::loadLe(self->body_.data(), 4));
+                encodeKlineQueryResponse(q.id, KlineQueryStatus::BadRequest, KlineQuerySource::Cache, self->klines_, self->out_);
+            }
+            net::async_write(self->socket_, net::buffer(self->out_), [self](const boost::system::error_code& ec, size_t) {
+                if (!ec) self->readHeader();
+                });
+            });
+    }
+
+    KlineQueryServer& server_;
+    Socket socket_;
+    char header_[4];
+    std::vector<char> body_;
+    std::string out_;
+    KlineColumns klines_; // reused by the requests of the connection
+};
+
+KlineQueryServer::KlineQueryServer(MongoManager& mongo, const KlineCache* cache, std::string dbName, KlineQueryServerOptions options) :
+    mongo_(mongo), cache_(cache), dbName_(std::move(dbName)), options_(std::move(options))
+{
+    options_.threads = std::max<size_t>(1, options_.threads);
+    options_.maxKlines = std::max<uint32_t>(1, options_.maxKlines);
+}
+
+KlineQueryServer::~KlineQueryServer() {
+    stop();
+}
+
+template <typename Acceptor>
+void KlineQueryServer::accept(Acceptor& acceptor) {
+    acceptor.async_accept([this, &acceptor](const boost::system::error_code& ec, typename Acceptor::protocol_type::socket socket) {
+        if (ec == net::error::operation_aborted) return;
+        if (!ec) {
+            std::make_shared<Session<typename Acceptor::protocol_type::socket>>(*this, std::move(socket))->start();
+        } else {
+            std::cerr << "KlineQueryServer accept error: " << ec.message() << std::endl;
+        }
+        accept(acceptor);
+        });
+}
+
+void KlineQueryServer::start() {
+    if (options_.port != 0) {
+        tcp::endpoint endpoint(net::ip::make_address(options_.bindAddress), options_.port);
+        tcpAcceptor_.emplace(ioc_, endpoint);
+        accept(*tcpAcceptor_);
+        std::cout << "KlineQueryServer listening on " << options_.bindAddress << ":" << options_.port << std::endl;
+    }
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    if (!options_.unixPath.empty()) {
+        std::error_code ec;
+        std::filesystem::remove(options_.unixPath, ec); // left behind by a previous run
+        unixAcceptor_.emplace(ioc_, net::local::stream_protocol::endpoint(options_.unixPath));
+        accept(*unixAcceptor_);
+        std::cout << "KlineQueryServer listening on " << options_.unixPath << std::endl;
+    }
+#else
+    if (!options_.unixPath.empty()) {
+        std::cerr << "KlineQueryServer: Unix sockets are not supported on this platform, query.unix_path ignored" << std::endl;
+    }
+#endif
+
+    for (size_t i = 0; i < options_.threads; ++i) {
+        threads_.emplace_back([this]() { ioc_.run(); });
+    }
+}
+
+void KlineQueryServer::stop() {
+    ioc_.stop();
+    for (auto& t : threads_) {
+        if (t.joinable()) t.join();
+    }
+    threads_.clear();
+}
+
+void KlineQueryServer::answer(const KlineQuery& q, KlineColumns& klines, std::string& out) {
+    if (!validSeriesName(q.series) || q.startTime > q.endTime) {
+        encodeKlineQueryResponse(q.id, KlineQueryStatus::BadRequest, KlineQuerySource::Cache, klines, out);
+        return;
+    }
+
+    klines.fields = q.fields & KLINE_FIELDS_ALL;
+    size_t limit = q.limit == 0 && q.op == KlineQueryOp::Latest ? 1 : q.limit;
+    limit = limit == 0 ? options_.maxKlines : std::min<size_t>(limit, options_.maxKlines);
+
+    bool cached = false;
+    if (cache_) {
+        cached = q.op == KlineQueryOp::Latest
+            ? cache_->latest(q.series, limit, q.endTime, klines)
+            : cache_->range(q.series, q.startTime, q.endTime, limit, klines);
+    }
+    if (cached) {
+        encodeKlineQueryResponse(q.id, KlineQueryStatus::Ok, KlineQuerySource::Cache, klines, out);
+        return;
+    }
+
+    KlineRangeQuery range;
+    range.startTime = q.op == KlineQueryOp::Latest ? INT64_MIN : q.startTime;
+    range.endTime = q.endTime;
+    range.limit = limit;
+    range.latest = q.op == KlineQueryOp::Latest;
+    bool ok = mongo_.ReadKlineColumns(dbName_, q.series, range, klines) >= 0;
+    encodeKlineQueryResponse(q.id, ok ? KlineQueryStatus::Ok : KlineQueryStatus::Error, KlineQuerySource::Mongo, klines, out);
+}
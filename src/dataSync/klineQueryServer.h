@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/asio.hpp>
+
+#include "db/klineCache.h"
+#include "db/mongoManager.h"
+#include "dtos/klineQuery.h"
+
+namespace net = boost::asio;
+
+using tcp = boost::asio::ip::tcp;
+
+struct KlineQueryServerOptions {
+    std::string bindAddress = "127.0.0.1";
+    uint16_t port = 0;          // 0: no TCP listener
+    std::string unixPath;       // empty: no Unix socket listener, ignored where Asio has no local sockets
+    size_t threads = 2;         // a request falling back to Mongo blocks its thread until the query returns
+    uint32_t maxKlines = 100000; // per response, longer ranges are read in several requests
+};
+
+// Read-only kline query service for the strategy processes on the same host, so they share the warm cache of
+// this process instead of each querying MongoDB. Wire format in dtos/klineQuery.h. A request is answered from
+// the recent kline cache when the cache covers it, from Mongo (ReadKlineColumns) otherwise.
+class KlineQueryServer {
+public:
+    KlineQueryServer(MongoManager& mongo, const KlineCache* cache, std::string dbName, KlineQueryServerOptions options);
+    ~KlineQueryServer(); // stops
+
+    KlineQueryServer(const KlineQueryServer&) = delete;
+    KlineQueryServer& operator=(const KlineQueryServer&) = delete;
+
+    // binds the listeners and starts the threads, throws boost::system::system_error if a listener can't be bound
+    void start();
+    void stop();
+
+    // appends the response frame of one request to out, klines is scratch space kept by the caller
+    void answer(const KlineQuery& q, KlineColumns& klines, std::string& out);
+
+private:
+    template <typename Socket>
+    class Session;
+
+    template <typename Acceptor>
+    void accept(Acceptor& acceptor);
+
+    MongoManager& mongo_;
+    const KlineCache* cache_;
+    std::string dbName_;
+    KlineQueryServerOptions options_;
+
+    net::io_context ioc_;
+    std::optional<tcp::acceptor> tcpAcceptor_;
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    std::optional<net::local::stream_protocol::acceptor> unixAcceptor_;
+#endif
+    std::vector<std::thread> threads_;
+};
@@ -0,0 +1,137 @@
+#include "dataSync/restClient.h"
+
+RestClient::RestClient(std::string host, std::string port, RestClientOptions options) :
+    host_(std::move(host)), port_(std::move(port)), options_(options), ssl_(net::ssl::context::tlsv12_client)
+{
+    if (options_.maxConnections == 0) options_.maxConnections = 1;
+}
+
+RestClient::~RestClient() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& conn : idle_) close(*conn);
+    idle_.clear();
+}
+
+RestClient::Response RestClient::get(const std::string& target) {
+    http::request<http::empty_body> req{ http::verb::get, target, 11 };
+    req.set(http::field::host, host_);
+    req.set(http::field::user_agent, BOOST_BEAST_VERSION_STRING);
+    req.set(http::field::content_type, "application/json");
+    req.keep_alive(true);
+
+    for (int attempt = 0; ; ++attempt) {
+        auto conn = acquire();
+        bool reused = conn->requests > 0;
+        try {
+            http::write(conn->stream, req);
+
+            http::response_parser<http::string_body> parser;
+            parser.body_limit(32 * 1024 * 1024);
+            http::read(conn->stream, conn->buffer, parser);
+            Response res = parser.release();
+
+            conn->requests++;
+            release(std::move(conn), res.keep_alive());
+            return res;
+        }
+        catch (const beast::system_error& e) {
+            release(std::move(conn), false);
+            // a pooled connection may have been closed by the server while idle, that is not worth an error
+            if (reused && attempt == 0) {
+                std::cout << "RestClient: pooled connection to " << host_ << " went stale (" << e.code().message() << "), reconnecting" << std::endl;
+                continue;
+            }
+            throw;
+        }
+    }
+}
+
+size_t RestClient::idleConnections() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return idle_.size();
+}
+
+std::unique_ptr<RestClient::Connection> RestClient::acquire() {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            auto now = std::chrono::steady_clock::now();
+            while (!idle_.empty()) {
+                auto conn = std::move(idle_.back()); // most recently used first, it is the least likely to be stale
+                idle_.pop_back();
+                if (now - conn->lastUsed < options_.idleTimeout) return conn;
+                close(*conn);
+                --open_;
+            }
+            if (open_ < options_.maxConnections) {
+                ++open_;
+                break;
+            }
+            cv_.wait(lock);
+        }
+    }
+
+    // connect outside the lock, other threads keep using the pool meanwhile
+    try {
+        return connect();
+    }
+    catch (...) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        --open_;
+        cv_.notify_one();
+        throw;
+    }
+}
+
+void RestClient::release(std::unique_ptr<Connection> conn, bool reusable) {
+    if (!reusable) close(*conn);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (reusable) {
+        conn->lastUsed = std::chrono::steady_clock::now();
+        idle_.push_back(std::move(conn));
+    } else {
+        --open_;
+    }
+    cv_.notify_one();
+}
+
+std::unique_ptr<RestClient::Connection> RestClient::connect() {
+    auto conn = std::make_unique<Connection>(ioc_, ssl_);
+    if (!SSL_set_tlsext_host_name(conn->stream.native_handle(), host_.c_str())) {
+        beast::error_code ec{ static_cast<int>(::ERR_get_error()), net::error::get_ssl_category() };
+        throw beast::system_error{ ec };
+    }
+
+    auto results = endpoints();
+    try {
+        net::connect(conn->stream.next_layer(), results.begin(), results.end());
+    }
+    catch (const beast::system_error&) {
+        // the cached address may be gone, resolve again on the next connect
+        std::lock_guard<std::mutex> lock(dnsMutex_);
+        endpoints_ = {};
+        throw;
+    }
+    conn->stream.next_layer().set_option(tcp::no_delay(true));
+    conn->stream.handshake(net::ssl::stream_base::client);
+    return conn;
+}
+
+tcp::resolver::results_type RestClient::endpoints() {
+    std::lock_guard<std::mutex> lock(dnsMutex_);
+    auto now = std::chrono::steady_clock::now();
+    if (endpoints_.empty() || now - resolvedAt_ >= options_.dnsTtl) {
+        tcp::resolver resolver(ioc_);
+        endpoints_ = resolver.resolve(host_, port_);
+        resolvedAt_ = now;
+    }
+    return endpoints_;
+}
+
+void RestClient::close(Connection& conn) {
+    // no TLS close_notify, it would block on a peer that is already gone
+    beast::error_code ec;
+    conn.stream.next_layer().shutdown(tcp::socket::shutdown_both, ec);
+    conn.stream.next_layer().close(ec);
+}
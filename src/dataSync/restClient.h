@@ -0,0 +1,76 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/beast.hpp>
+#include <boost/beast/ssl.hpp>
+
+namespace net = boost::asio;
+namespace beast = boost::beast;
+namespace http = beast::http;
+
+using tcp = boost::asio::ip::tcp;
+
+struct RestClientOptions {
+    size_t maxConnections = 8;                                   // requests beyond this wait for a free connection
+    std::chrono::seconds idleTimeout = std::chrono::seconds(50); // binance drops idle keep-alive connections after about a minute
+    std::chrono::seconds dnsTtl = std::chrono::seconds(300);
+};
+
+// Blocking HTTPS client for one REST host with a pool of keep-alive HTTP/1.1 connections.
+// The SSL context and the resolved endpoints are shared, so only the first request on a connection pays for
+// the TCP connect and the TLS handshake. Safe to call from many threads, each request holds one connection.
+class RestClient {
+public:
+    using Response = http::response<http::string_body>;
+
+    RestClient(std::string host, std::string port = "443", RestClientOptions options = {});
+    ~RestClient();
+
+    RestClient(const RestClient&) = delete;
+    RestClient& operator=(const RestClient&) = delete;
+
+    // GET target (path and query). A request on a connection the server already closed is retried once on a new one.
+    // Throws beast::system_error when the host cannot be reached.
+    Response get(const std::string& target);
+
+    size_t idleConnections();
+
+private:
+    struct Connection {
+        Connection(net::io_context& ioc, net::ssl::context& ssl) : stream(ioc, ssl) {}
+        beast::ssl_stream<tcp::socket> stream;
+        beast::flat_buffer buffer;
+        std::chrono::steady_clock::time_point lastUsed;
+        size_t requests = 0;
+    };
+
+    std::unique_ptr<Connection> acquire();
+    void release(std::unique_ptr<Connection> conn, bool reusable);
+    std::unique_ptr<Connection> connect();
+    tcp::resolver::results_type endpoints();
+    void close(Connection& conn);
+
+    std::string host_;
+    std::string port_;
+    RestClientOptions options_;
+
+    net::io_context ioc_; // only used for blocking calls, never run
+    net::ssl::context ssl_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<std::unique_ptr<Connection>> idle_;
+    size_t open_ = 0; // idle and in use
+
+    std::mutex dnsMutex_;
+    tcp::resolver::results_type endpoints_;
+    std::chrono::steady_clock::time_point resolvedAt_;
+};
@@ -0,0 +1,64 @@
+#include "dataSync/weightLimiter.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+WeightLimiter::WeightLimiter(int64_t weightPerMinute) :
+    weightPerMinute_(std::max<int64_t>(1, weightPerMinute)),
+    tokens_(static_cast<double>(weightPerMinute_)),
+    lastRefill_(Clock::now()),
+    blockedUntil_(Clock::now())
+{
+}
+
+void WeightLimiter::acquire(int64_t weight) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        auto now = Clock::now();
+        if (now < blockedUntil_) {
+            cv_.wait_until(lock, blockedUntil_);
+            continue;
+        }
+
+        refill(now);
+        if (tokens_ >= static_cast<double>(weight)) {
+            tokens_ -= static_cast<double>(weight);
+            return;
+        }
+
+        // sleep exactly until the missing tokens have refilled
+        double missing = static_cast<double>(weight) - tokens_;
+        auto wait = std::chrono::duration<double, std::milli>(missing * 60000.0 / static_cast<double>(weightPerMinute_));
+        cv_.wait_for(lock, std::chrono::duration_cast<Clock::duration>(wait) + std::chrono::milliseconds(1));
+    }
+}
+
+void WeightLimiter::onResponse(unsigned status, const std::string& usedWeight, const std::string& retryAfter) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto now = Clock::now();
+    refill(now);
+
+    if (!usedWeight.empty()) {
+        // the server counts everything this IP spent in the current minute, never assume more than it leaves us
+        int64_t used = std::strtoll(usedWeight.c_str(), nullptr, 10);
+        tokens_ = std::min(tokens_, static_cast<double>(weightPerMinute_ - used));
+    }
+
+    if (status == 429 || status == 418) {
+        // Retry-After is in seconds; without it wait a full window, a ban (418) means we ignored a 429 already
+        int64_t seconds = retryAfter.empty() ? 60 : std::strtoll(retryAfter.c_str(), nullptr, 10);
+        if (seconds <= 0) seconds = 60;
+        blockedUntil_ = std::max(blockedUntil_, now + std::chrono::seconds(seconds));
+        tokens_ = 0;
+        std::cerr << "Binance REST " << (status == 418 ? "IP ban" : "rate limit") << " (" << status << "), pausing all history requests for "
+            << seconds << "s" << std::endl;
+    }
+    cv_.notify_all();
+}
+
+void WeightLimiter::refill(Clock::time_point now) {
+    double elapsedMs = std::chrono::duration<double, std::milli>(now - lastRefill_).count();
+    lastRefill_ = now;
+    tokens_ = std::min(static_cast<double>(weightPerMinute_), tokens_ + elapsedMs * static_cast<double>(weightPerMinute_) / 60000.0);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+// Token bucket over Binance's per-IP request weight budget, shared by every REST caller of the process.
+// Tokens refill continuously at weightPerMinute / 60s. The bucket is corrected from the X-MBX-USED-WEIGHT-1M
+// header of each response, so weight spent by other processes on the same IP is accounted for too, and a
+// 429 (rate limited) or 418 (IP banned) stops all requests until Retry-After has passed.
+class WeightLimiter {
+public:
+    explicit WeightLimiter(int64_t weightPerMinute);
+
+    // block until weight can be spent
+    void acquire(int64_t weight);
+
+    // feed back a response: status code, X-MBX-USED-WEIGHT-1M and Retry-After (empty when absent)
+    void onResponse(unsigned status, const std::string& usedWeight, const std::string& retryAfter);
+
+    int64_t weightPerMinute() const { return weightPerMinute_; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    void refill(Clock::time_point now);
+
+    const int64_t weightPerMinute_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    double tokens_;
+    Clock::time_point lastRefill_;
+    Clock::time_point blockedUntil_; // set by 429/418
+};
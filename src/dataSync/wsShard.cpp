@@ -0,0 +1,267 @@
+#include "dataSync/wsShard.h"
+
+WsShard::WsShard(net::io_context& ioc, net::ssl::context& sslCtx, size_t shardId, std::vector<std::string> streams,
+    FrameHandler onFrame, ReconnectHandler onReconnected) :
+    ioc_(ioc), ssl_ctx_(sslCtx), shardId_(shardId), streams_(std::move(streams)),
+    onFrame_(std::move(onFrame)), onReconnected_(std::move(onReconnected)),
+    strand_(net::make_strand(ioc)), resolver_(strand_), ping_timer_(strand_), reconnect_timer_(strand_)
+{
+    ws_stream_ = std::make_unique<WsStream>(strand_, ssl_ctx_);
+
+    // kline frames are ~400 bytes, reserve once so the read loop never grows the buffer in steady state
+    buffer_.reserve(FRAME_BUFFER_RESERVE);
+}
+
+void WsShard::start() {
+    net::post(strand_, [this, self = shared_from_this()] { connect(); });
+}
+
+std::string WsShard::subscribeRequest() const {
+    std::ostringstream oss;
+    oss << "{\"method\": \"SUBSCRIBE\", \"params\": [";
+    for (size_t i = 0; i < streams_.size(); ++i) {
+        if (i) oss << ",";
+        oss << "\"" << streams_[i] << "\"";
+    }
+    // the id echoes back in the {"result":null,"id":n} ack, use the shard id to tell them apart
+    oss << "], \"id\": " << (shardId_ + 1) << "}";
+    return oss.str();
+}
+
+void WsShard::connect() {
+    // Reset the WebSocket stream before connecting
+    reset_websocket();
+
+    // SNI: set the server name indication for the TLS(SSL) context in Hello message, so that the server can present the correct certificate
+    if (!SSL_set_tlsext_host_name(ws_stream_->next_layer().native_handle(), "stream.binance.com")) {
+        failConnect("Error setting the TLS server name", beast::error_code{});
+        return;
+    }
+
+    // Resolve the Binance WebSocket server address
+    resolver_.async_resolve("stream.binance.com", "9443",
+        net::bind_executor(strand_, beast::bind_front_handler(&WsShard::onResolve, shared_from_this())));
+}
+
+void WsShard::onResolve(beast::error_code ec, tcp::resolver::results_type results) {
+    if (ec) { failConnect("Error resolving WebSocket server", ec); return; }
+
+    // Connect to the server use TCP layers
+    net::async_connect(ws_stream_->next_layer().next_layer(), results,
+        net::bind_executor(strand_, beast::bind_front_handler(&WsShard::onTcpConnect, shared_from_this())));
+}
+
+void WsShard::onTcpConnect(beast::error_code ec, const tcp::endpoint&) {
+    if (ec) { failConnect("Error connecting to WebSocket server", ec); return; }
+
+    // Perform the TLS handshake(based on the old-school SSL context)
+    ws_stream_->next_layer().async_handshake(net::ssl::stream_base::client,
+        net::bind_executor(strand_, beast::bind_front_handler(&WsShard::onTlsHandshake, shared_from_this())));
+}
+
+void WsShard::onTlsHandshake(beast::error_code ec) {
+    if (ec) { failConnect("Error during TLS handshake", ec); return; }
+
+    // TODO: check the server certificate, if needed
+    //SSL_set1_host(ssl, "stream.binance.com");
+    //ssl_ctx_.set_verify_mode(boost::asio::ssl::verify_peer);
+    //ssl_ctx_.set_default_verify_paths();
+
+    ws_stream_->set_option(websocket::stream_base::timeout::suggested(beast::role_type::client));
+
+    // Perform the WebSocket handshake
+    ws_stream_->async_handshake("stream.binance.com", "/ws",
+        net::bind_executor(strand_, beast::bind_front_handler(&WsShard::onWsHandshake, shared_from_this())));
+}
+
+void WsShard::onWsHandshake(beast::error_code ec) {
+    if (ec) { failConnect("Error during WebSocket handshake", ec); return; }
+
+    // Send a subscription message to the WebSocket server
+    subscribe_message_ = subscribeRequest();
+    std::cout << "[shard " << shardId_ << "] Sending message: " << subscribe_message_ << std::endl;
+    ws_stream_->async_write(net::buffer(subscribe_message_),
+        net::bind_executor(strand_, beast::bind_front_handler(&WsShard::onSubscribe, shared_from_this())));
+}
+
+void WsShard::onSubscribe(beast::error_code ec, std::size_t) {
+    if (ec) { failConnect("Error sending subscription message", ec); return; }
+    onConnected();
+}
+
+void WsShard::onConnected() {
+    startPing(); // start the ping timer to keep the connection alive
+    asyncReadLoop(); // start the async read loop to receive messages
+
+    // a connection lost before (or a first connect that failed) means klines may be missing since then
+    if (disconnectedAtMs_ == 0) return;
+    std::cout << "[shard " << shardId_ << "] re-connected with " << streams_.size() << " streams" << std::endl;
+    int64_t disconnectedAtMs = disconnectedAtMs_;
+    disconnectedAtMs_ = 0;
+    if (onReconnected_) {
+        onReconnected_(shardId_, disconnectedAtMs);
+    }
+}
+
+void WsShard::failConnect(const char* what, beast::error_code ec) {
+    std::cerr << "[shard " << shardId_ << "] " << what;
+    if (ec) std::cerr << ": " << ec.message();
+    std::cerr << std::endl;
+    scheduleReconnect();
+}
+
+void WsShard::reset_websocket() {
+    if (ws_stream_) {
+        // no close or TLS shutdown handshake here, both wait on the peer: the synchronous ones would block the io
+        // thread on a dead connection. scheduleReconnect() has already sent the close frame asynchronously, closing
+        // the socket aborts whatever is still pending on it
+        beast::error_code ec;
+        auto& tcp_socket = ws_stream_->next_layer().next_layer();
+        if (tcp_socket.is_open()) {
+            tcp_socket.shutdown(tcp::socket::shutdown_both, ec);
+            ec = {};
+            tcp_socket.close(ec);
+            if (ec) {
+                std::cerr << "[shard " << shardId_ << "] Error closing TCP socket: " << ec.message() << std::endl;
+            }
+        }
+        // the aborted operations still complete in the strand and touch the stream, destroy it after them
+        net::post(strand_, [old = std::move(ws_stream_)] {});
+        std::cout << "[shard " << shardId_ << "] WebSocket stream reset successfully. Ready to re-connect to server..." << std::endl;
+    }
+    else {
+        std::cout << "[shard " << shardId_ << "] WebSocket stream is not initialized, creating a new one..." << std::endl;
+    }
+
+    // Clear the buffer, avoiding buffer left across the multi connections
+    buffer_.consume(buffer_.size());
+
+    // Reset the WebSocket stream
+    ws_stream_.reset(new WsStream(strand_, ssl_ctx_));
+}
+
+void WsShard::asyncReadLoop() {
+    auto self = shared_from_this();
+    ws_stream_->async_read(
+        buffer_,
+        net::bind_executor(strand_,
+            [this, self](beast::error_code ec, std::size_t) {  // self is used to keep the shared_ptr alive, add one more reference. otherwise, the shared_ptr may be destroyed before the callback is called.
+                if (ec) {
+                    // 0. clear the buffer!!!
+                    buffer_.consume(buffer_.size());
+
+                    // 1. scheduledReconnect has cancelled this operation, taken over by it so no need to reconnect
+                    if (ec == net::error::operation_aborted) {
+                        std::cerr << "[shard " << shardId_ << "] WS read ended: " << ec.message() << std::endl;
+                        return;
+                    }
+
+                    // 2. if the connection is closed by other reason, then reconnect
+                    if (!reconnecting_) {
+                        scheduleReconnect();
+                    }
+                    return;
+                }
+
+                // flat_buffer keeps the whole frame in one contiguous region, publish it in place without a string copy
+                auto frame = buffer_.data();
+
+                // Process the received market data
+                onFrame_(static_cast<const char*>(frame.data()), frame.size());
+
+                // consume() only rewinds the read/write pointers, the storage is recycled by the next async_read
+                buffer_.consume(buffer_.size());
+
+                // read from the stream
+                asyncReadLoop();
+            }
+        )
+    );
+}
+
+// TODO:
+// 1. Silent packet loss: when DROP packets, the server will not send any error message, so we need to handle this case.
+//    Use watchdog to detect the connection status?
+
+void WsShard::scheduleReconnect() {
+    net::post(strand_, [this, self = shared_from_this()] {
+        if (reconnecting_) return;
+        reconnecting_ = true;
+        if (disconnectedAtMs_ == 0) {
+            using namespace std::chrono;
+            disconnectedAtMs_ = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+        }
+
+        // 1. stop ping timer
+        ping_running_ = false;
+        beast::error_code ec;
+        ping_timer_.cancel(ec);
+
+        // 2. close ws and cancel all the suspend I/O, an operation_aborted code will be returned
+        if (ws_stream_ && ws_stream_->is_open()) {
+            ws_stream_->async_close(websocket::close_code::normal,
+                net::bind_executor(strand_, [](beast::error_code) { /* quiet */ }));
+        }
+
+        // 3. stop reconnect timer
+        ec = {};
+        reconnect_timer_.cancel(ec);
+        reconnect_timer_.expires_after(std::chrono::seconds(5));
+        reconnect_timer_.async_wait(
+            net::bind_executor(strand_,  // also put the reconnect operation in the strand
+                [this, self](beast::error_code tec) {
+                    reconnecting_ = false;
+                    if (tec == net::error::operation_aborted) return;
+                    connect();
+                }
+            )
+        );
+    });
+}
+
+void WsShard::startPing() {
+    // put the ping operation in the strand to ensure it runs in the correct order
+    net::post(strand_, [this, self = shared_from_this()] {
+        if (ping_running_) return;
+        ping_running_ = true;
+        scheduleNextPing();
+        });
+}
+
+void WsShard::stopPing() {
+    net::post(strand_, [this, self = shared_from_this()] {
+        ping_running_ = false;
+        beast::error_code ec;
+        ping_timer_.cancel(ec); // stop the ping timer
+        });
+}
+
+// heart beat for the WebSocket connection
+void WsShard::scheduleNextPing() {
+    if (!ping_running_ || reconnecting_) return;          // reconnecting or ping not used, then do not schedule next ping
+    if (!ws_stream_ || !ws_stream_->is_open()) return;    // no ws or ws not open, then do not schedule next ping
+
+    ping_timer_.expires_after(ping_interval_);
+    ping_timer_.async_wait(
+        net::bind_executor(strand_,
+            [this, self = shared_from_this()](beast::error_code ec) {
+                if (!ping_running_) return;
+                if (ec == net::error::operation_aborted) return;
+                if (!ws_stream_ || !ws_stream_->is_open()) return;
+
+                ws_stream_->async_ping(websocket::ping_data{},
+                    net::bind_executor(strand_,
+                        [this, self](beast::error_code pec) {
+                            if (!ping_running_) return;
+                            if (pec == net::error::operation_aborted || pec == websocket::error::closed) return;
+                            if (pec) {
+                                // reconnect if ping failed
+                                scheduleReconnect();
+                                return;
+                            }
+                            scheduleNextPing();
+                        })
+                );
+            })
+    );
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/beast.hpp>
+#include <boost/beast/websocket.hpp>
+#include <boost/beast/ssl.hpp>
+
+// when subscribe a multi combined streams in binance，payload will be like {"stream":"<streamName>","data":<rawPayload>}
+// but for kline, it is received one by one even in multi streams
+namespace net = boost::asio;
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace websocket = beast::websocket;
+
+using tcp = boost::asio::ip::tcp;
+using WsStream = boost::beast::websocket::stream<boost::beast::ssl_stream<boost::asio::ip::tcp::socket>>;
+
+// One WebSocket connection to stream.binance.com carrying a slice of the subscription set.
+// Every async operation of a shard runs in its own strand, so shards can share a multi-threaded
+// io_context while each connection still sees its reads, pings and reconnects strictly in order.
+class WsShard : public std::enable_shared_from_this<WsShard> {
+public:
+    // called in the shard strand with the raw frame, the region is only valid during the call
+    using FrameHandler = std::function<void(const char* data, size_t len)>;
+    // called in the shard strand after a successful re-connect, e.g. to trigger a history gap fill;
+    // disconnectedAtMs is the wall clock time the connection was lost, klines from then on may be missing
+    using ReconnectHandler = std::function<void(size_t shardId, int64_t disconnectedAtMs)>;
+
+    WsShard(net::io_context& ioc, net::ssl::context& sslCtx, size_t shardId, std::vector<std::string> streams,
+        FrameHandler onFrame, ReconnectHandler onReconnected);
+
+    void start();
+
+    // WS Ping/Pong
+    void startPing();
+    void stopPing();
+
+    size_t id() const { return shardId_; }
+    size_t streamCount() const { return streams_.size(); }
+
+private:
+    std::string subscribeRequest() const;
+
+    // resolve, TCP connect, TLS and WebSocket handshakes and the subscribe request, chained as async operations in
+    // the strand so a slow or dead endpoint never blocks the io threads the other shards run on. Ends in
+    // onConnected(), or in scheduleReconnect() if any step fails
+    void connect();
+    void onResolve(beast::error_code ec, tcp::resolver::results_type results);
+    void onTcpConnect(beast::error_code ec, const tcp::endpoint&);
+    void onTlsHandshake(beast::error_code ec);
+    void onWsHandshake(beast::error_code ec);
+    void onSubscribe(beast::error_code ec, std::size_t);
+    void onConnected();
+    void failConnect(const char* what, beast::error_code ec);
+    void reset_websocket();
+
+    void asyncReadLoop();
+    void scheduleReconnect();
+    void scheduleNextPing();
+
+    net::io_context& ioc_;
+    net::ssl::context& ssl_ctx_;
+    size_t shardId_;
+    std::vector<std::string> streams_; // like "btcusdt@kline_1h"
+    FrameHandler onFrame_;
+    ReconnectHandler onReconnected_;
+
+    // all the handlers of this connection are serialized by its own strand,
+    // the ws stream is also bound to it so the internal composed operations run there too
+    net::strand<net::io_context::executor_type> strand_;
+    tcp::resolver resolver_;
+    std::string subscribe_message_; // kept alive until the async write of the subscription is done
+
+    beast::flat_buffer buffer_;
+    const size_t FRAME_BUFFER_RESERVE = 16 * 1024;
+    std::unique_ptr<WsStream> ws_stream_;
+
+    // WS Ping/Pong
+    net::steady_timer ping_timer_;
+    std::chrono::seconds ping_interval_{ std::chrono::minutes(10) };
+    net::steady_timer reconnect_timer_;
+
+    // some flags, only touched inside strand_
+    bool ping_running_ = false;
+    bool reconnecting_ = false;
+    int64_t disconnectedAtMs_ = 0; // set when the connection is lost, cleared by the re-connect
+};
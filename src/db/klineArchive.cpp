@@ -0,0 +1,588 @@
+#include "db/klineArchive.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include "dtos/intervals.h"
+
+namespace fs = std::filesystem;
+
+// header, little endian: magic[8] | version u32 | flags u32 | intervalMs i64 | phase i64 | first slot i64 |
+// bars u32 | columns u32 | count u64 (slots holding a kline) | reserved up to 64
+namespace {
+
+const char MAGIC[8] = { 'K', 'L', 'N', 'A', 'R', 'C', 'H', '1' };
+constexpr uint32_t VERSION = 1;
+constexpr uint32_t FLAG_SEALED = 1;
+constexpr size_t HEADER_SIZE = 64;
+constexpr size_t COLUMNS = static_cast<size_t>(KlineField::Count);
+constexpr size_t VALUE_SIZE = 8;
+constexpr size_t MAX_OPEN_SEGMENTS = 4; // per series, mapped for writing
+constexpr std::chrono::seconds SEAL_IDLE{ 60 }; // a segment behind the newest is sealed once not written for this long
+
+const char* const OPEN_SUFFIX = ".kca";
+const char* const SEALED_SUFFIX = ".kcz";
+
+struct SegmentHeader {
+    uint32_t flags = 0;
+    int64_t intervalMs = 0;
+    int64_t phase = 0;
+    int64_t firstSlot = 0;
+    uint32_t bars = 0;
+    uint64_t count = 0;
+};
+
+using kline_record_detail::loadLe;
+using kline_record_detail::storeLe;
+
+void writeHeader(char* p, const SegmentHeader& h) {
+    std::memset(p, 0, HEADER_SIZE);
+    std::memcpy(p, MAGIC, sizeof(MAGIC));
+    storeLe(p + 8, VERSION, 4);
+    storeLe(p + 12, h.flags, 4);
+    storeLe(p + 16, static_cast<uint64_t>(h.intervalMs), 8);
+    storeLe(p + 24, static_cast<uint64_t>(h.phase), 8);
+    storeLe(p + 32, static_cast<uint64_t>(h.firstSlot), 8);
+    storeLe(p + 40, h.bars, 4);
+    storeLe(p + 44, COLUMNS, 4);
+    storeLe(p + 48, h.count, 8);
+}
+
+bool readHeader(const char* p, size_t size, SegmentHeader& h) {
+    if (size < HEADER_SIZE || std::memcmp(p, MAGIC, sizeof(MAGIC)) != 0) return false;
+    if (loadLe(p + 8, 4) != VERSION || loadLe(p + 44, 4) != COLUMNS) return false;
+    h.flags = static_cast<uint32_t>(loadLe(p + 12, 4));
+    h.intervalMs = static_cast<int64_t>(loadLe(p + 16, 8));
+    h.phase = static_cast<int64_t>(loadLe(p + 24, 8));
+    h.firstSlot = static_cast<int64_t>(loadLe(p + 32, 8));
+    h.bars = static_cast<uint32_t>(loadLe(p + 40, 4));
+    h.count = loadLe(p + 48, 8);
+    return h.intervalMs > 0 && h.bars > 0;
+}
+
+size_t segmentBytes(size_t bars) {
+    return HEADER_SIZE + COLUMNS * bars * VALUE_SIZE;
+}
+
+int64_t floorDiv(int64_t a, int64_t b) {
+    int64_t q = a / b;
+    return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+}
+
+int64_t floorMod(int64_t a, int64_t b) {
+    return a - floorDiv(a, b) * b;
+}
+
+// interval of SYMBOL_INTERVAL_Binance, 0 if it has no fixed length
+int64_t seriesIntervalMs(const std::string& series) {
+    auto first = series.find('_');
+    auto second = series.find('_', first + 1);
+    if (first == std::string::npos || second == std::string::npos) return 0;
+    std::string name = series.substr(first + 1, second - first - 1);
+    if (name == "1M") return 0;
+    const KlineInterval* itv = intervalById(intervalId(name));
+    return itv ? itv->ms : 0;
+}
+
+std::string segmentName(int64_t index, const char* suffix) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%020lld", static_cast<long long>(index));
+    return std::string(name) + suffix;
+}
+
+// Sealed columns. Integers: zigzag varint of the difference to the previous value. Doubles: the XOR with the
+// previous value's bits, which for neighbouring prices has zero high and low bits: a byte with the number of
+// trailing zero bits (255: equal to the previous value), then the varint of the rest.
+void putVarint(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<char>((v & 0x7f) | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+bool getVarint(const char*& p, const char* end, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        uint8_t b = static_cast<uint8_t>(*p++);
+        v |= static_cast<uint64_t>(b & 0x7f) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+bool isIntColumn(size_t c) {
+    auto f = static_cast<KlineField>(c);
+    return f == KlineField::StartTime || f == KlineField::EndTime || f == KlineField::TradeNum;
+}
+
+void encodeColumn(const char* column, size_t bars, bool integer, std::string& out) {
+    uint64_t prev = 0;
+    for (size_t i = 0; i < bars; ++i) {
+        uint64_t v;
+        std::memcpy(&v, column + i * VALUE_SIZE, VALUE_SIZE);
+        if (integer) {
+            int64_t delta = static_cast<int64_t>(v - prev);
+            putVarint(out, (static_cast<uint64_t>(delta) << 1) ^ static_cast<uint64_t>(delta >> 63));
+        } else {
+            uint64_t x = v ^ prev;
+            if (x == 0) {
+                out.push_back(static_cast<char>(255));
+            } else {
+                uint8_t tz = 0;
+                while (!(x & 1)) { x >>= 1; ++tz; }
+                out.push_back(static_cast<char>(tz));
+                putVarint(out, x);
+            }
+        }
+        prev = v;
+    }
+}
+
+bool decodeColumn(const char*& p, const char* end, size_t bars, bool integer, char* column) {
+    uint64_t prev = 0;
+    for (size_t i = 0; i < bars; ++i) {
+        uint64_t v;
+        if (integer) {
+            uint64_t z;
+            if (!getVarint(p, end, z)) return false;
+            v = prev + ((z >> 1) ^ (~(z & 1) + 1));
+        } else {
+            if (p >= end) return false;
+            uint8_t tz = static_cast<uint8_t>(*p++);
+            if (tz == 255) {
+                v = prev;
+            } else {
+                uint64_t x;
+                if (tz > 63 || !getVarint(p, end, x)) return false;
+                v = prev ^ (x << tz);
+            }
+        }
+        std::memcpy(column + i * VALUE_SIZE, &v, VALUE_SIZE);
+        prev = v;
+    }
+    return true;
+}
+
+} // namespace
+
+// a loaded segment: an open one mapped, a sealed one decoded into memory, same layout either way
+struct KlineArchiveSegment {
+    int64_t index = 0;
+    std::string path;
+    SegmentHeader header;
+    boost::interprocess::file_mapping file;
+    boost::interprocess::mapped_region region;
+    std::vector<char> decoded;
+    char* base = nullptr;
+
+    char* column(size_t c) { return base + HEADER_SIZE + c * header.bars * VALUE_SIZE; }
+    const char* column(size_t c) const { return base + HEADER_SIZE + c * header.bars * VALUE_SIZE; }
+};
+
+static std::unique_ptr<KlineArchiveSegment> mapSegment(const std::string& path, int64_t index, bool writable) {
+    auto mode = writable ? boost::interprocess::read_write : boost::interprocess::read_only;
+    auto seg = std::make_unique<KlineArchiveSegment>();
+    seg->index = index;
+    seg->path = path;
+    seg->file = boost::interprocess::file_mapping(path.c_str(), mode);
+    seg->region = boost::interprocess::mapped_region(seg->file, mode);
+    seg->base = static_cast<char*>(seg->region.get_address());
+    if (!readHeader(seg->base, seg->region.get_size(), seg->header) || seg->region.get_size() < segmentBytes(seg->header.bars)) {
+        std::cerr << "KlineArchive: invalid segment " << path << std::endl;
+        return nullptr;
+    }
+    return seg;
+}
+
+static std::unique_ptr<KlineArchiveSegment> decodeSegment(const std::string& path, int64_t index) {
+    std::ifstream in(path, std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    auto seg = std::make_unique<KlineArchiveSegment>();
+    seg->index = index;
+    seg->path = path;
+    if (!readHeader(data.data(), data.size(), seg->header)) {
+        std::cerr << "KlineArchive: invalid segment " << path << std::endl;
+        return nullptr;
+    }
+    seg->decoded.resize(segmentBytes(seg->header.bars));
+    seg->base = seg->decoded.data();
+    std::memcpy(seg->base, data.data(), HEADER_SIZE);
+
+    const char* p = data.data() + HEADER_SIZE;
+    const char* end = data.data() + data.size();
+    for (size_t c = 0; c < COLUMNS; ++c) {
+        if (!decodeColumn(p, end, seg->header.bars, isIntColumn(c), seg->column(c))) {
+            std::cerr << "KlineArchive: corrupt segment " << path << std::endl;
+            return nullptr;
+        }
+    }
+    return seg;
+}
+
+// index -> whether it is sealed, of the segment files of a directory. An open file wins over a sealed one
+// of the same index: both exist only when sealing or unsealing was interrupted, and the open one is never older.
+static std::map<int64_t, bool> listSegments(const std::string& dir) {
+    std::map<int64_t, bool> segments;
+    std::error_code ec;
+    for (auto& file : fs::directory_iterator(dir, ec)) {
+        auto ext = file.path().extension().string();
+        if (ext != OPEN_SUFFIX && ext != SEALED_SUFFIX) continue;
+        int64_t index = std::stoll(file.path().stem().string());
+        bool sealed = ext == SEALED_SUFFIX;
+        auto it = segments.find(index);
+        if (it == segments.end()) segments.emplace(index, sealed);
+        else it->second = it->second && sealed;
+    }
+    return segments;
+}
+
+// header of any segment of the directory, to learn the phase and the segment size of the series
+static bool anySegmentHeader(const std::string& dir, const std::map<int64_t, bool>& segments, SegmentHeader& h) {
+    for (auto& [index, sealed] : segments) {
+        std::ifstream in(fs::path(dir) / segmentName(index, sealed ? SEALED_SUFFIX : OPEN_SUFFIX), std::ios::binary);
+        char buf[HEADER_SIZE];
+        if (in.read(buf, HEADER_SIZE) && readHeader(buf, HEADER_SIZE, h)) return true;
+    }
+    return false;
+}
+
+struct KlineArchiveWriter::Series {
+    std::mutex mutex;
+    std::string name;
+    std::string dir;
+    int64_t intervalMs = 0;
+    int64_t phase = -1; // start time modulo the interval, learned from the first kline
+    size_t bars = 0;
+    int64_t newestIndex = INT64_MIN;
+    std::map<int64_t, bool> onDisk; // index -> sealed
+    std::map<int64_t, std::unique_ptr<KlineArchiveSegment>> open;
+    std::map<int64_t, std::chrono::steady_clock::time_point> lastWrite; // unsealed segment -> last write
+};
+
+KlineArchiveWriter::KlineArchiveWriter(std::string root, size_t segmentBars, bool compressSealed) :
+    root_(std::move(root)), segmentBars_(std::clamp<size_t>(segmentBars, 1, UINT32_MAX)), compressSealed_(compressSealed)
+{
+    fs::create_directories(root_);
+}
+
+KlineArchiveWriter::~KlineArchiveWriter() = default;
+
+KlineArchiveWriter::Series* KlineArchiveWriter::series(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = series_.find(name);
+    if (it != series_.end()) return it->second.get();
+
+    auto s = std::make_unique<Series>();
+    s->name = name;
+    s->dir = (fs::path(root_) / name).string();
+    s->intervalMs = seriesIntervalMs(name);
+    if (s->intervalMs == 0) {
+        std::cout << "KlineArchive: " << name << " has no fixed interval, not archived" << std::endl;
+        series_.emplace(name, nullptr);
+        return nullptr;
+    }
+    fs::create_directories(s->dir);
+    s->onDisk = listSegments(s->dir);
+    s->bars = segmentBars_;
+
+    SegmentHeader h;
+    if (anySegmentHeader(s->dir, s->onDisk, h)) {
+        // the files on disk fix the geometry, a changed archive.segment_bars applies to new series only
+        s->phase = h.phase;
+        s->bars = h.bars;
+    }
+    if (!s->onDisk.empty()) s->newestIndex = s->onDisk.rbegin()->first;
+    // open files left behind by an earlier run are sealed like the ones written now
+    auto now = std::chrono::steady_clock::now();
+    for (auto& [index, sealed] : s->onDisk) {
+        if (!sealed) s->lastWrite[index] = now;
+    }
+
+    auto* ptr = s.get();
+    series_.emplace(name, std::move(s));
+    return ptr;
+}
+
+KlineArchiveSegment* KlineArchiveWriter::segmentForWrite(Series& s, int64_t index) {
+    auto it = s.open.find(index);
+    if (it != s.open.end()) return it->second.get();
+
+    std::string path = (fs::path(s.dir) / segmentName(index, OPEN_SUFFIX)).string();
+    auto disk = s.onDisk.find(index);
+    if (disk == s.onDisk.end()) {
+        SegmentHeader h;
+        h.intervalMs = s.intervalMs;
+        h.phase = s.phase;
+        h.firstSlot = index * static_cast<int64_t>(s.bars);
+        h.bars = static_cast<uint32_t>(s.bars);
+        {
+            char header[HEADER_SIZE];
+            writeHeader(header, h);
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+            out.write(header, HEADER_SIZE);
+        }
+        // zero filled: every slot empty
+        fs::resize_file(path, segmentBytes(s.bars));
+        auto seg = mapSegment(path, index, true);
+        if (!seg) return nullptr;
+        s.onDisk[index] = false;
+        return s.open.emplace(index, std::move(seg)).first->second.get();
+    }
+
+    if (disk->second) {
+        // a late write into a sealed segment: back to an open file, sealed again once it is idle
+        std::string sealedPath = (fs::path(s.dir) / segmentName(index, SEALED_SUFFIX)).string();
+        auto decoded = decodeSegment(sealedPath, index);
+        if (!decoded) return nullptr;
+        {
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+            decoded->header.flags &= ~FLAG_SEALED;
+            writeHeader(decoded->base, decoded->header);
+            out.write(decoded->base, static_cast<std::streamsize>(decoded->decoded.size()));
+            if (!out) return nullptr;
+        }
+        std::error_code ec;
+        fs::remove(sealedPath, ec);
+        disk->second = false;
+    }
+
+    auto seg = mapSegment(path, index, true);
+    if (!seg) return nullptr;
+    return s.open.emplace(index, std::move(seg)).first->second.get();
+}
+
+bool KlineArchiveWriter::append(const std::string& name, const std::vector<KlineResponseWs>& klines) {
+    KlineColumns columns;
+    columns.fields = KLINE_FIELDS_ALL;
+    columns.clear();
+    columns.reserve(klines.size());
+    for (const auto& k : klines) {
+        columns.startTime.push_back(k.StartTime);
+        columns.endTime.push_back(k.EndTime);
+        columns.open.push_back(k.Open.toDouble());
+        columns.high.push_back(k.High.toDouble());
+        columns.low.push_back(k.Low.toDouble());
+        columns.close.push_back(k.Close.toDouble());
+        columns.volume.push_back(k.Volume.toDouble());
+        columns.quoteVolume.push_back(k.QuoteVolume.toDouble());
+        columns.tradeNum.push_back(k.TradeNum);
+        columns.activeBuyVolume.push_back(k.ActiveBuyVolume.toDouble());
+        columns.activeBuyQuoteVolume.push_back(k.ActiveBuyQuoteVolume.toDouble());
+    }
+    return append(name, columns);
+}
+
+bool KlineArchiveWriter::append(const std::string& name, const KlineColumns& klines) {
+    if (klines.empty()) return true;
+    Series* s = series(name);
+    if (!s) return true;
+
+    try {
+        std::lock_guard<std::mutex> lock(s->mutex);
+        auto now = std::chrono::steady_clock::now();
+        bool ok = true;
+        for (size_t i = 0; i < klines.size(); ++i) {
+            int64_t start = klines.startTime[i];
+            if (start <= 0) continue;
+            if (s->phase < 0) s->phase = floorMod(start, s->intervalMs);
+            if (floorMod(start - s->phase, s->intervalMs) != 0) {
+                std::cerr << "KlineArchive: " << name << " kline " << start << " is off the interval grid, skipped" << std::endl;
+                ok = false;
+                continue;
+            }
+
+            int64_t slot = floorDiv(start - s->phase, s->intervalMs);
+            int64_t index = floorDiv(slot, static_cast<int64_t>(s->bars));
+            KlineArchiveSegment* seg = segmentForWrite(*s, index);
+            if (!seg) {
+                ok = false;
+                continue;
+            }
+            size_t offset = static_cast<size_t>(slot - index * static_cast<int64_t>(s->bars));
+
+            bool wasEmpty = reinterpret_cast<const int64_t*>(seg->column(0))[offset] == 0;
+            for (size_t c = 1; c < COLUMNS; ++c) {
+                auto f = static_cast<KlineField>(c);
+                char* dst = seg->column(c) + offset * VALUE_SIZE;
+                if (!klines.has(f)) {
+                    std::memset(dst, 0, VALUE_SIZE);
+                } else if (isIntColumn(c)) {
+                    std::memcpy(dst, &(*klines.intColumn(f))[i], VALUE_SIZE);
+                } else {
+                    std::memcpy(dst, &(*klines.numberColumn(f))[i], VALUE_SIZE);
+                }
+            }
+            // the start time last, a slot is present once it is set
+            std::memcpy(seg->column(0) + offset * VALUE_SIZE, &start, VALUE_SIZE);
+            if (wasEmpty) {
+                seg->header.count++;
+                storeLe(seg->base + 48, seg->header.count, 8);
+            }
+            s->newestIndex = std::max(s->newestIndex, index);
+            s->lastWrite[index] = now;
+        }
+        retireSegments(*s);
+        return ok;
+    } catch (const std::exception& e) {
+        std::cerr << "KlineArchive: " << name << " append error exception: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+// writes the sealed .kcz file of an open segment, the open file is left to the caller
+static bool sealSegment(const std::string& dir, const KlineArchiveSegment& seg) {
+    std::string encoded(seg.base, HEADER_SIZE);
+    SegmentHeader h = seg.header;
+    h.flags |= FLAG_SEALED;
+    writeHeader(&encoded[0], h);
+    for (size_t c = 0; c < COLUMNS; ++c) {
+        encodeColumn(seg.column(c), h.bars, isIntColumn(c), encoded);
+    }
+
+    fs::path sealedPath = fs::path(dir) / segmentName(seg.index, SEALED_SUFFIX);
+    fs::path tmp = sealedPath;
+    tmp += ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        out.write(encoded.data(), static_cast<std::streamsize>(encoded.size()));
+        if (!out) return false;
+    }
+    std::error_code ec;
+    fs::rename(tmp, sealedPath, ec);
+    return !ec;
+}
+
+void KlineArchiveWriter::retireSegments(Series& s) {
+    // segments two behind the newest one are done, except for backfills and late klines: seal them once no write
+    // reached them for SEAL_IDLE. A backfill lands page after page in the same older segment, sealing it at the end
+    // of every append would unseal and re-encode the whole segment for each page
+    auto now = std::chrono::steady_clock::now();
+    for (auto it = s.lastWrite.begin(); it != s.lastWrite.end();) {
+        int64_t index = it->first;
+        if (index >= s.newestIndex - 1 || now - it->second < SEAL_IDLE) {
+            ++it;
+            continue;
+        }
+        it = s.lastWrite.erase(it);
+
+        std::unique_ptr<KlineArchiveSegment> seg;
+        auto open = s.open.find(index);
+        if (open != s.open.end()) {
+            seg = std::move(open->second);
+            s.open.erase(open);
+        }
+        if (!compressSealed_) continue;
+        // unmapped for MAX_OPEN_SEGMENTS since its last write
+        if (!seg) seg = mapSegment((fs::path(s.dir) / segmentName(index, OPEN_SUFFIX)).string(), index, false);
+        if (!seg || !sealSegment(s.dir, *seg)) {
+            std::cerr << "KlineArchive: failed to seal " << s.dir << " segment " << index << ", kept open" << std::endl;
+            continue;
+        }
+        std::string openPath = seg->path;
+        seg.reset(); // unmapped before the file goes
+        std::error_code ec;
+        fs::remove(openPath, ec);
+        s.onDisk[index] = true;
+    }
+
+    // the oldest mapped segments go first, their files stay open and are mapped again by the next write
+    while (s.open.size() > MAX_OPEN_SEGMENTS) s.open.erase(s.open.begin());
+}
+
+KlineArchiveReader::KlineArchiveReader(std::string root, std::string series) :
+    dir_((fs::path(root) / series).string()), intervalMs_(seriesIntervalMs(series))
+{
+    refresh();
+}
+
+KlineArchiveReader::~KlineArchiveReader() = default;
+
+void KlineArchiveReader::refresh() {
+    segments_.clear();
+    indices_.clear();
+    auto onDisk = listSegments(dir_);
+    SegmentHeader h;
+    if (!anySegmentHeader(dir_, onDisk, h)) return;
+    intervalMs_ = h.intervalMs;
+    phase_ = h.phase;
+    bars_ = h.bars;
+    for (auto& [index, sealed] : onDisk) indices_.insert(index);
+}
+
+KlineArchiveSegment* KlineArchiveReader::segment(int64_t index) {
+    auto it = segments_.find(index);
+    if (it != segments_.end()) return it->second.get();
+    if (!indices_.count(index)) return nullptr;
+
+    std::unique_ptr<KlineArchiveSegment> seg;
+    fs::path open = fs::path(dir_) / segmentName(index, OPEN_SUFFIX);
+    std::error_code ec;
+    try {
+        if (fs::exists(open, ec)) {
+            seg = mapSegment(open.string(), index, false);
+        } else {
+            seg = decodeSegment((fs::path(dir_) / segmentName(index, SEALED_SUFFIX)).string(), index);
+        }
+    } catch (const std::exception& e) {
+        // sealed or unsealed by the writer in between, found after a refresh()
+        std::cerr << "KlineArchive: failed to load segment " << index << " of " << dir_ << ": " << e.what() << std::endl;
+    }
+    if (!seg || seg->header.bars != bars_) return nullptr;
+    return segments_.emplace(index, std::move(seg)).first->second.get();
+}
+
+KlineArchiveSpan KlineArchiveReader::span(const KlineArchiveSegment& seg, size_t from, size_t to) const {
+    KlineArchiveSpan span;
+    span.intervalMs = intervalMs_;
+    span.firstStart = phase_ + (seg.header.firstSlot + static_cast<int64_t>(from)) * intervalMs_;
+    span.count = to - from;
+    for (size_t c = 0; c < COLUMNS; ++c) {
+        span.columns[c] = seg.column(c) + from * VALUE_SIZE;
+    }
+    return span;
+}
+
+bool KlineArchiveReader::find(int64_t startTime, KlineArchiveSpan& span, size_t& index) {
+    if (indices_.empty() || floorMod(startTime - phase_, intervalMs_) != 0) return false;
+    int64_t slot = floorDiv(startTime - phase_, intervalMs_);
+    int64_t segIndex = floorDiv(slot, static_cast<int64_t>(bars_));
+    KlineArchiveSegment* seg = segment(segIndex);
+    if (!seg) return false;
+
+    span = this->span(*seg, 0, bars_);
+    index = static_cast<size_t>(slot - seg->header.firstSlot);
+    return span.present(index);
+}
+
+std::vector<KlineArchiveSpan> KlineArchiveReader::range(int64_t startTime, int64_t endTime) {
+    std::vector<KlineArchiveSpan> spans;
+    if (indices_.empty() || startTime > endTime) return spans;
+
+    // first and last slot of the range, rounded inwards
+    int64_t firstSlot = floorDiv(startTime - phase_ + intervalMs_ - 1, intervalMs_);
+    int64_t lastSlot = floorDiv(endTime - phase_, intervalMs_);
+    if (firstSlot > lastSlot) return spans;
+
+    int64_t bars = static_cast<int64_t>(bars_);
+    auto end = indices_.upper_bound(floorDiv(lastSlot, bars));
+    for (auto it = indices_.lower_bound(floorDiv(firstSlot, bars)); it != end; ++it) {
+        KlineArchiveSegment* seg = segment(*it);
+        if (!seg) continue;
+        int64_t segFirst = seg->header.firstSlot;
+        size_t from = static_cast<size_t>(std::max(firstSlot, segFirst) - segFirst);
+        size_t to = static_cast<size_t>(std::min(lastSlot, segFirst + bars - 1) - segFirst + 1);
+        spans.push_back(span(*seg, from, to));
+    }
+    return spans;
+}
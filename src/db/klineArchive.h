@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "dtos/kline.h"
+#include "dtos/klineColumns.h"
+
+// Columnar archive of closed klines on local disk, next to MongoDB, for research and backtests that read long
+// histories over and over.
+//
+// Every SYMBOL_INTERVAL_Binance series has a directory of segment files. A segment holds a fixed number of
+// consecutive interval slots, slot n is the kline starting at phase + n * interval, so the position of a start time
+// is plain arithmetic. A segment file is a 64 byte header followed by one column per KlineField, each `bars` values
+// of 8 bytes (int64 or double, host byte order), column f at 64 + f * bars * 8. Slots without a kline have
+// start time 0. Open segments (.kca) are written in place through a memory mapping; once the series moved two
+// segments past one and nothing was written to it for a minute, it can be sealed into a .kcz file, delta encoded
+// integer columns and XOR encoded doubles, which readers decode once when they load it.
+//
+// The archive is derived from what is written to MongoDB and is not synced to disk explicitly: after a crash the
+// klines written since are still in Mongo, and klineArchive (tools/) fills the archive from there.
+// Intervals without a fixed length (1M) are not archived.
+
+struct KlineArchiveSegment;
+
+// consecutive slots of one segment, the column pointers point into the mapped (or decoded) segment
+struct KlineArchiveSpan {
+    int64_t firstStart = 0; // start time of the first slot
+    int64_t intervalMs = 0;
+    size_t count = 0;
+    const char* columns[static_cast<size_t>(KlineField::Count)] = {};
+
+    const int64_t* intColumn(KlineField f) const { return reinterpret_cast<const int64_t*>(columns[static_cast<size_t>(f)]); }
+    const double* numberColumn(KlineField f) const { return reinterpret_cast<const double*>(columns[static_cast<size_t>(f)]); }
+    bool present(size_t i) const { return intColumn(KlineField::StartTime)[i] != 0; }
+};
+
+class KlineArchiveWriter {
+public:
+    KlineArchiveWriter(std::string root, size_t segmentBars, bool compressSealed);
+    ~KlineArchiveWriter();
+
+    KlineArchiveWriter(const KlineArchiveWriter&) = delete;
+    KlineArchiveWriter& operator=(const KlineArchiveWriter&) = delete;
+
+    // Stores the klines in their slots, overwriting what is there, in any order. Safe to call from several
+    // threads, writes of the same series are serialized. False if something could not be written.
+    bool append(const std::string& series, const std::vector<KlineResponseWs>& klines);
+    // the columns missing from klines.fields are stored as 0
+    bool append(const std::string& series, const KlineColumns& klines);
+
+private:
+    struct Series;
+
+    Series* series(const std::string& name); // nullptr if the series can't be archived
+    KlineArchiveSegment* segmentForWrite(Series& s, int64_t index);
+    void retireSegments(Series& s);
+
+    std::string root_;
+    size_t segmentBars_;
+    bool compressSealed_;
+    std::mutex mutex_;
+    std::unordered_map<std::string, std::unique_ptr<Series>> series_;
+};
+
+// Reads one series of an archive. Not thread safe, use one reader per thread.
+// Unsealed segments are mapped and seen live; a segment sealed or unsealed after it was loaded, and segments
+// created after the last refresh(), need a refresh() to be seen.
+class KlineArchiveReader {
+public:
+    KlineArchiveReader(std::string root, std::string series);
+    ~KlineArchiveReader();
+
+    // rescans the series directory and drops the loaded segments
+    void refresh();
+
+    bool empty() const { return indices_.empty(); }
+    int64_t intervalMs() const { return intervalMs_; }
+
+    // the segment holding the kline starting at startTime and its index in the span, false if it is not archived
+    bool find(int64_t startTime, KlineArchiveSpan& span, size_t& index);
+
+    // the slots of the start times in [startTime, endTime], one span per segment, ascending.
+    // Segments that don't exist are skipped, empty slots inside a span have start time 0.
+    std::vector<KlineArchiveSpan> range(int64_t startTime, int64_t endTime);
+
+private:
+    KlineArchiveSegment* segment(int64_t index);
+    KlineArchiveSpan span(const KlineArchiveSegment& seg, size_t from, size_t to) const;
+
+    std::string dir_;
+    int64_t intervalMs_ = 0;
+    int64_t phase_ = 0;
+    size_t bars_ = 0;
+    std::set<int64_t> indices_; // segments on disk
+    std::map<int64_t, std::unique_ptr<KlineArchiveSegment>> segments_; // loaded
+};
@@ -0,0 +1,238 @@
+#include "db/klineCache.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <thread>
+
+namespace {
+
+constexpr size_t COLUMNS = static_cast<size_t>(KlineField::Count);
+
+// a kline as the bits of its columns, int64 or double depending on the field
+using Row = std::array<uint64_t, COLUMNS>;
+
+uint64_t doubleBits(double d) {
+    uint64_t bits;
+    std::memcpy(&bits, &d, sizeof(bits));
+    return bits;
+}
+
+double bitsDouble(uint64_t bits) {
+    double d;
+    std::memcpy(&d, &bits, sizeof(d));
+    return d;
+}
+
+Row toRow(const KlineResponseWs& k) {
+    Row r;
+    r[static_cast<size_t>(KlineField::StartTime)] = static_cast<uint64_t>(k.StartTime);
+    r[static_cast<size_t>(KlineField::EndTime)] = static_cast<uint64_t>(k.EndTime);
+    r[static_cast<size_t>(KlineField::Open)] = doubleBits(k.Open.toDouble());
+    r[static_cast<size_t>(KlineField::High)] = doubleBits(k.High.toDouble());
+    r[static_cast<size_t>(KlineField::Low)] = doubleBits(k.Low.toDouble());
+    r[static_cast<size_t>(KlineField::Close)] = doubleBits(k.Close.toDouble());
+    r[static_cast<size_t>(KlineField::Volume)] = doubleBits(k.Volume.toDouble());
+    r[static_cast<size_t>(KlineField::QuoteVolume)] = doubleBits(k.QuoteVolume.toDouble());
+    r[static_cast<size_t>(KlineField::TradeNum)] = static_cast<uint64_t>(k.TradeNum);
+    r[static_cast<size_t>(KlineField::ActiveBuyVolume)] = doubleBits(k.ActiveBuyVolume.toDouble());
+    r[static_cast<size_t>(KlineField::ActiveBuyQuoteVolume)] = doubleBits(k.ActiveBuyQuoteVolume.toDouble());
+    return r;
+}
+
+} // namespace
+
+struct KlineCache::Series {
+    explicit Series(size_t capacity) : capacity(capacity) {
+        for (auto& c : columns) {
+            c.reset(new std::atomic<uint64_t>[capacity]);
+            for (size_t i = 0; i < capacity; ++i) c[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    size_t capacity;
+    std::mutex writeMutex;
+    std::atomic<uint64_t> version{ 0 }; // odd while a writer is changing the ring
+    std::atomic<uint64_t> head{ 0 };    // klines written since the last load, the next one goes to head % capacity
+    std::atomic<bool> complete{ false }; // the ring holds every kline of the series
+    std::atomic<bool> loaded{ false };   // until then the ring says nothing about what Mongo holds
+    std::unique_ptr<std::atomic<uint64_t>[]> columns[COLUMNS];
+
+    uint64_t get(size_t column, uint64_t pos) const { return columns[column][pos % capacity].load(std::memory_order_relaxed); }
+    int64_t startAt(uint64_t pos) const { return static_cast<int64_t>(get(0, pos)); }
+
+    void put(uint64_t pos, const Row& row) {
+        // the fields of a kline are copied one by one, only the version tells readers whether they got a whole one
+        for (size_t c = 0; c < COLUMNS; ++c) columns[c][pos % capacity].store(row[c], std::memory_order_relaxed);
+    }
+
+    Row row(uint64_t pos) const {
+        Row r;
+        for (size_t c = 0; c < COLUMNS; ++c) r[c] = get(c, pos);
+        return r;
+    }
+
+    uint64_t beginWrite() {
+        uint64_t v = version.load(std::memory_order_relaxed);
+        version.store(v + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        return v + 2;
+    }
+
+    void endWrite(uint64_t v) { version.store(v, std::memory_order_release); }
+
+    // logical positions [first, end) of the cached klines, oldest first
+    uint64_t first(uint64_t end) const { return end - std::min<uint64_t>(end, capacity); }
+
+    // number of cached klines in [first, end) starting at or before t
+    size_t countUpTo(uint64_t first, uint64_t end, int64_t t) const {
+        uint64_t lo = first, hi = end;
+        while (lo < hi) {
+            uint64_t mid = lo + (hi - lo) / 2;
+            if (startAt(mid) <= t) lo = mid + 1;
+            else hi = mid;
+        }
+        return static_cast<size_t>(lo - first);
+    }
+};
+
+KlineCache::KlineCache(size_t capacity) : capacity_(std::max<size_t>(1, capacity)) {
+}
+
+KlineCache::~KlineCache() = default;
+
+void KlineCache::addSeries(const std::string& series) {
+    if (!series_.count(series)) series_.emplace(series, std::make_unique<Series>(capacity_));
+}
+
+void KlineCache::load(const std::string& series, const KlineColumns& klines, bool complete) {
+    auto it = series_.find(series);
+    if (it == series_.end()) return;
+    Series& s = *it->second;
+
+    std::lock_guard<std::mutex> lock(s.writeMutex);
+    uint64_t v = s.beginWrite();
+    size_t from = klines.size() > capacity_ ? klines.size() - capacity_ : 0;
+    for (size_t i = from; i < klines.size(); ++i) {
+        Row r{};
+        for (size_t c = 0; c < COLUMNS; ++c) {
+            auto f = static_cast<KlineField>(c);
+            if (!klines.has(f)) continue;
+            if (auto* col = klines.intColumn(f)) r[c] = static_cast<uint64_t>((*col)[i]);
+            else r[c] = doubleBits((*klines.numberColumn(f))[i]);
+        }
+        s.put(i - from, r);
+    }
+    s.head.store(klines.size() - from, std::memory_order_relaxed);
+    s.complete.store(complete && from == 0, std::memory_order_relaxed);
+    s.loaded.store(true, std::memory_order_relaxed);
+    s.endWrite(v);
+}
+
+void KlineCache::append(const std::string& series, const std::vector<KlineResponseWs>& klines) {
+    auto it = series_.find(series);
+    if (it == series_.end() || klines.empty()) return;
+    Series& s = *it->second;
+
+    std::vector<const KlineResponseWs*> sorted;
+    sorted.reserve(klines.size());
+    for (const auto& k : klines) sorted.push_back(&k);
+    std::sort(sorted.begin(), sorted.end(), [](const KlineResponseWs* a, const KlineResponseWs* b) { return a->StartTime < b->StartTime; });
+
+    std::lock_guard<std::mutex> lock(s.writeMutex);
+    if (!s.loaded.load(std::memory_order_relaxed)) return;
+    uint64_t v = s.beginWrite();
+    std::vector<const KlineResponseWs*> inserted;
+    for (const KlineResponseWs* k : sorted) {
+        uint64_t end = s.head.load(std::memory_order_relaxed);
+        uint64_t first = s.first(end);
+        if (first == end || k->StartTime > s.startAt(end - 1)) {
+            // the usual case, the next kline of the series
+            s.put(end, toRow(*k));
+            s.head.store(end + 1, std::memory_order_relaxed);
+            if (end + 1 > capacity_) s.complete.store(false, std::memory_order_relaxed);
+            continue;
+        }
+        // older ones: closed klines never change, only missing ones are added
+        bool complete = s.complete.load(std::memory_order_relaxed);
+        if (k->StartTime < s.startAt(first) && !complete) continue;
+        size_t upTo = s.countUpTo(first, end, k->StartTime);
+        if (upTo > 0 && s.startAt(first + upTo - 1) == k->StartTime) continue;
+        inserted.push_back(k);
+    }
+    if (!inserted.empty()) rebuild(s, inserted);
+    s.endWrite(v);
+}
+
+void KlineCache::rebuild(Series& s, const std::vector<const KlineResponseWs*>& added) {
+    // a backfilled hole inside the cached range: rewrite the ring in order, rare enough to not be worth more
+    uint64_t end = s.head.load(std::memory_order_relaxed);
+    std::vector<Row> rows;
+    rows.reserve(static_cast<size_t>(end - s.first(end)) + added.size());
+    for (uint64_t pos = s.first(end); pos < end; ++pos) rows.push_back(s.row(pos));
+    for (const KlineResponseWs* k : added) rows.push_back(toRow(*k));
+    std::sort(rows.begin(), rows.end(), [](const Row& a, const Row& b) { return static_cast<int64_t>(a[0]) < static_cast<int64_t>(b[0]); });
+
+    size_t from = rows.size() > capacity_ ? rows.size() - capacity_ : 0;
+    for (size_t i = from; i < rows.size(); ++i) s.put(i - from, rows[i]);
+    s.head.store(rows.size() - from, std::memory_order_relaxed);
+    if (from > 0) s.complete.store(false, std::memory_order_relaxed);
+}
+
+template <typename Pick>
+bool KlineCache::snapshot(const std::string& series, KlineColumns& out, Pick&& pick) const {
+    auto it = series_.find(series);
+    if (it == series_.end()) return false;
+    const Series& s = *it->second;
+    if (!s.loaded.load(std::memory_order_acquire)) return false;
+
+    while (true) {
+        uint64_t v = s.version.load(std::memory_order_acquire);
+        if (v & 1) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        uint64_t end = s.head.load(std::memory_order_relaxed);
+        uint64_t first = s.first(end);
+        uint64_t from = first;
+        size_t count = 0;
+        bool answered = pick(s, first, end, s.complete.load(std::memory_order_relaxed), from, count);
+
+        out.clear();
+        out.resize(count);
+        for (size_t c = 0; c < COLUMNS; ++c) {
+            auto f = static_cast<KlineField>(c);
+            if (!out.has(f)) continue;
+            if (auto* col = out.intColumn(f)) {
+                for (size_t i = 0; i < count; ++i) (*col)[i] = static_cast<int64_t>(s.get(c, from + i));
+            } else {
+                auto& dst = *out.numberColumn(f);
+                for (size_t i = 0; i < count; ++i) dst[i] = bitsDouble(s.get(c, from + i));
+            }
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (s.version.load(std::memory_order_relaxed) == v) return answered;
+    }
+}
+
+bool KlineCache::latest(const std::string& series, size_t n, int64_t endTime, KlineColumns& out) const {
+    return snapshot(series, out, [&](const Series& s, uint64_t first, uint64_t end, bool complete, uint64_t& from, size_t& count) {
+        size_t available = s.countUpTo(first, end, endTime);
+        count = std::min(n, available);
+        from = first + available - count;
+        return count == n || complete;
+        });
+}
+
+bool KlineCache::range(const std::string& series, int64_t startTime, int64_t endTime, size_t limit, KlineColumns& out) const {
+    return snapshot(series, out, [&](const Series& s, uint64_t first, uint64_t end, bool complete, uint64_t& from, size_t& count) {
+        size_t before = startTime == INT64_MIN ? 0 : s.countUpTo(first, end, startTime - 1);
+        size_t upTo = std::max(before, s.countUpTo(first, end, endTime));
+        from = first + before;
+        count = limit ? std::min(limit, upTo - before) : upTo - before;
+        // everything from the oldest cached kline on is cached
+        return complete || (first < end && s.startAt(first) <= startTime);
+        });
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "dtos/kline.h"
+#include "dtos/klineColumns.h"
+
+// The last `capacity` closed klines of every subscribed series, in memory, so indicator warm-up and queries for
+// recent history don't go to MongoDB.
+//
+// Each series is a fixed struct-of-arrays ring, one column per KlineField. It is loaded once at startup and then
+// follows what BulkWriteClosedKlines stores. Writers of a series take its mutex; readers take no lock, they copy
+// under a sequence counter (odd while a write is in progress) and copy again if a write ran in between.
+// The ring always holds the newest klines stored in Mongo without holes: a kline older than the oldest cached one
+// is only taken while the ring holds the whole history of the series.
+class KlineCache {
+public:
+    explicit KlineCache(size_t capacity);
+    ~KlineCache();
+
+    KlineCache(const KlineCache&) = delete;
+    KlineCache& operator=(const KlineCache&) = delete;
+
+    size_t capacity() const { return capacity_; }
+
+    // Registers a series, all of them before the first append or read: the series map is not locked.
+    void addSeries(const std::string& series);
+
+    // Replaces the cached klines of a series with the newest `capacity` of klines (ascending, all fields).
+    // complete: klines is the whole history of the series.
+    void load(const std::string& series, const KlineColumns& klines, bool complete);
+
+    // klines just stored in Mongo, in any order; series that are unknown or not loaded yet are ignored
+    void append(const std::string& series, const std::vector<KlineResponseWs>& klines);
+
+    // The last n klines starting at or before endTime, ascending, into the out.fields columns of out.
+    // False if the cache can't answer: unknown or not loaded series, or fewer than n such klines cached while
+    // older ones may exist in Mongo.
+    bool latest(const std::string& series, size_t n, int64_t endTime, KlineColumns& out) const;
+
+    // The first `limit` (0: all) klines starting in [startTime, endTime], ascending, into out like latest().
+    // False if the cache can't answer: unknown or not loaded series, or the range starts before the oldest cached
+    // kline while older ones may exist in Mongo.
+    bool range(const std::string& series, int64_t startTime, int64_t endTime, size_t limit, KlineColumns& out) const;
+
+private:
+    struct Series;
+
+    void rebuild(Series& s, const std::vector<const KlineResponseWs*>& added);
+    // copies the klines pick chooses, pick(series, first, end, complete, from, count) returns whether they answer
+    template <typename Pick>
+    bool snapshot(const std::string& series, KlineColumns& out, Pick&& pick) const;
+
+    size_t capacity_;
+    std::unordered_map<std::string, std::unique_ptr<Series>> series_;
+};
@@ -0,0 +1,231 @@
+#include "db/klineJournal.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <boost/crc.hpp>
+
+namespace fs = std::filesystem;
+
+// entry layout, little endian: seq u64 | crc32 of bytes 12..160 | reserved u32 | symbol char[16] | kline record[128]
+namespace {
+
+constexpr size_t SEQ_OFFSET = 0;
+constexpr size_t CRC_OFFSET = 8;
+constexpr size_t SYMBOL_OFFSET = 16;
+constexpr size_t SYMBOL_SIZE = 16;
+constexpr size_t RECORD_OFFSET = 32;
+static_assert(RECORD_OFFSET + KLINE_RECORD_SIZE == KlineJournal::ENTRY_SIZE, "journal entry layout");
+
+const char* const SEGMENT_SUFFIX = ".wal";
+const char* const CHECKPOINT_FILE = "checkpoint";
+
+uint32_t entryCrc(const char* entry) {
+    boost::crc_32_type crc;
+    crc.process_bytes(entry + CRC_OFFSET + 4, KlineJournal::ENTRY_SIZE - CRC_OFFSET - 4);
+    return crc.checksum();
+}
+
+uint64_t entrySeq(const char* entry) {
+    return kline_record_detail::loadLe(entry + SEQ_OFFSET, 8);
+}
+
+bool entryValid(const char* entry, uint64_t seq) {
+    return entrySeq(entry) == seq && static_cast<uint32_t>(kline_record_detail::loadLe(entry + CRC_OFFSET, 4)) == entryCrc(entry);
+}
+
+std::string segmentName(uint64_t firstSeq) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%020llu", static_cast<unsigned long long>(firstSeq));
+    return std::string(name) + SEGMENT_SUFFIX;
+}
+
+} // namespace
+
+KlineJournal::KlineJournal(std::string dir, size_t segmentBytes) :
+    dir_(std::move(dir)), segmentEntries_(std::max<size_t>(1, segmentBytes / ENTRY_SIZE))
+{
+    fs::create_directories(dir_);
+
+    std::ifstream cp(fs::path(dir_) / CHECKPOINT_FILE);
+    unsigned long long checkpoint = 0;
+    if (cp >> checkpoint) checkpointSeq_ = checkpoint;
+
+    std::vector<uint64_t> firstSeqs;
+    for (auto& file : fs::directory_iterator(dir_)) {
+        if (file.path().extension() != SEGMENT_SUFFIX) continue;
+        firstSeqs.push_back(std::stoull(file.path().stem().string()));
+    }
+    std::sort(firstSeqs.begin(), firstSeqs.end());
+
+    for (uint64_t firstSeq : firstSeqs) {
+        segments_.push_back(openSegment(firstSeq, false));
+    }
+
+    if (segments_.empty()) {
+        nextSeq_ = checkpointSeq_ + 1;
+        segments_.push_back(openSegment(nextSeq_, true));
+    } else {
+        // only the segment written last can have a torn tail, the ones before were full when it was started
+        nextSeq_ = recoverTail(*segments_.back()) + 1;
+        if (nextSeq_ == segments_.back()->endSeq()) {
+            segments_.push_back(openSegment(nextSeq_, true));
+        }
+    }
+    syncedSeq_ = nextSeq_ - 1;
+
+    std::cout << "KlineJournal " << dir_ << ": " << segments_.size() << " segments, entries up to " << nextSeq_ - 1
+        << ", applied up to " << checkpointSeq_ << std::endl;
+}
+
+KlineJournal::~KlineJournal() {
+    sync();
+}
+
+std::unique_ptr<KlineJournal::Segment> KlineJournal::openSegment(uint64_t firstSeq, bool create) {
+    auto segment = std::make_unique<Segment>();
+    segment->firstSeq = firstSeq;
+    segment->path = (fs::path(dir_) / segmentName(firstSeq)).string();
+    if (create) {
+        // zero filled, an entry with seq 0 marks the end of the data
+        std::ofstream(segment->path, std::ios::binary | std::ios::trunc);
+        fs::resize_file(segment->path, segmentEntries_ * ENTRY_SIZE);
+    }
+    segment->capacity = static_cast<size_t>(fs::file_size(segment->path) / ENTRY_SIZE);
+    if (segment->capacity == 0) {
+        throw std::runtime_error("KlineJournal: empty segment " + segment->path);
+    }
+    segment->file = boost::interprocess::file_mapping(segment->path.c_str(), boost::interprocess::read_write);
+    segment->region = boost::interprocess::mapped_region(segment->file, boost::interprocess::read_write);
+    return segment;
+}
+
+uint64_t KlineJournal::recoverTail(Segment& segment) {
+    uint64_t seq = segment.firstSeq;
+    while (seq < segment.endSeq() && entryValid(segment.entry(seq), seq)) ++seq;
+
+    if (seq < segment.endSeq()) {
+        // clear whatever a crash left behind the last complete entry, so it can never be read as a newer one
+        size_t offset = static_cast<size_t>(seq - segment.firstSeq) * ENTRY_SIZE;
+        size_t size = segment.capacity * ENTRY_SIZE - offset;
+        std::memset(segment.entry(seq), 0, size);
+        segment.region.flush(offset, size, false);
+    }
+    return seq - 1;
+}
+
+uint64_t KlineJournal::append(const std::vector<KlineResponseWs>& klines) {
+    if (klines.empty()) return 0;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& k : klines) {
+        if (nextSeq_ == segments_.back()->endSeq()) {
+            // the full segment is flushed by the next sync() like the rest, it stays mapped until checkpointed
+            segments_.push_back(openSegment(nextSeq_, true));
+        }
+        char* entry = segments_.back()->entry(nextSeq_);
+
+        std::memset(entry + CRC_OFFSET, 0, RECORD_OFFSET - CRC_OFFSET);
+        std::memcpy(entry + SYMBOL_OFFSET, k.Symbol, std::min(SYMBOL_SIZE, sizeof(k.Symbol)));
+        encodeKlineRecord(KlineResponseWs::toRecord(k, 0), entry + RECORD_OFFSET);
+        kline_record_detail::storeLe(entry + CRC_OFFSET, entryCrc(entry), 4);
+        // the sequence number goes in last: a torn entry has either no seq or a wrong crc
+        kline_record_detail::storeLe(entry + SEQ_OFFSET, nextSeq_, 8);
+        ++nextSeq_;
+    }
+    appended_.notify_all();
+    return nextSeq_ - 1;
+}
+
+void KlineJournal::sync() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t from = syncedSeq_ + 1;
+    if (from >= nextSeq_) return;
+
+    for (auto& segment : segments_) {
+        if (segment->endSeq() <= from || segment->firstSeq >= nextSeq_) continue;
+        uint64_t first = std::max(from, segment->firstSeq);
+        uint64_t last = std::min(nextSeq_, segment->endSeq());
+        segment->region.flush(static_cast<size_t>(first - segment->firstSeq) * ENTRY_SIZE, static_cast<size_t>(last - first) * ENTRY_SIZE, false);
+    }
+    syncedSeq_ = nextSeq_ - 1;
+}
+
+KlineJournal::Segment* KlineJournal::segmentFor(uint64_t seq) {
+    for (auto& segment : segments_) {
+        if (seq >= segment->firstSeq && seq < segment->endSeq()) return segment.get();
+    }
+    return nullptr;
+}
+
+uint64_t KlineJournal::read(uint64_t fromSeq, size_t max, std::vector<KlineResponseWs>& out, std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    appended_.wait_for(lock, timeout, [&] { return fromSeq < nextSeq_; });
+
+    // entries below the oldest segment were checkpointed and deleted already
+    if (!segments_.empty() && fromSeq < segments_.front()->firstSeq) fromSeq = segments_.front()->firstSeq;
+
+    uint64_t seq = fromSeq;
+    Segment* segment = nullptr;
+    for (; seq < nextSeq_ && out.size() < max; ++seq) {
+        if (!segment || seq >= segment->endSeq()) segment = segmentFor(seq);
+        if (!segment) break;
+
+        const char* entry = segment->entry(seq);
+        KlineRecord record;
+        if (!entryValid(entry, seq) || !decodeKlineRecord(entry + RECORD_OFFSET, KLINE_RECORD_SIZE, record)) {
+            std::cerr << "KlineJournal: corrupt entry " << seq << " in " << segment->path << ", skipped" << std::endl;
+            continue;
+        }
+        const char* symbol = entry + SYMBOL_OFFSET;
+        out.push_back(KlineResponseWs::fromRecord(record, std::string_view(symbol, strnlen(symbol, SYMBOL_SIZE))));
+    }
+    return seq;
+}
+
+void KlineJournal::checkpoint(uint64_t seq) {
+    std::vector<std::string> drop;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (seq <= checkpointSeq_) return;
+        checkpointSeq_ = std::min(seq, nextSeq_ - 1);
+        writeCheckpoint(checkpointSeq_);
+
+        // segments entirely applied, except the one being written
+        while (segments_.size() > 1 && segments_.front()->endSeq() <= checkpointSeq_ + 1) {
+            drop.push_back(segments_.front()->path);
+            segments_.pop_front();
+        }
+    }
+    for (auto& path : drop) {
+        std::error_code ec;
+        fs::remove(path, ec);
+        if (ec) std::cerr << "KlineJournal: failed to remove " << path << ": " << ec.message() << std::endl;
+    }
+}
+
+void KlineJournal::writeCheckpoint(uint64_t seq) {
+    // a checkpoint that is lost or older than it should be only replays entries again, the writes are idempotent
+    fs::path tmp = fs::path(dir_) / (std::string(CHECKPOINT_FILE) + ".tmp");
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        out << seq << '\n';
+    }
+    std::error_code ec;
+    fs::rename(tmp, fs::path(dir_) / CHECKPOINT_FILE, ec);
+    if (ec) std::cerr << "KlineJournal: failed to write the checkpoint: " << ec.message() << std::endl;
+}
+
+uint64_t KlineJournal::replayStart() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return checkpointSeq_ + 1;
+}
+
+uint64_t KlineJournal::lastSeq() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return nextSeq_ - 1;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include "dtos/kline.h"
+
+// Append-only local journal of closed klines, the write-ahead log in front of MongoDB.
+//
+// Klines are appended as fixed 160 byte entries (sequence number, crc32, symbol, binary kline record) into
+// memory-mapped segment files of the journal directory, named after their first sequence number. sync() flushes
+// everything appended since the previous call with one msync, so a whole fetched batch is made durable at once.
+// The consumer reads entries back by sequence number and checkpoints the last one that is applied to Mongo;
+// segments entirely below the checkpoint are deleted. After a restart reading resumes after the checkpoint.
+// A torn tail (crash in the middle of an append) is detected by the crc and cut off on open.
+class KlineJournal {
+public:
+    static constexpr size_t ENTRY_SIZE = 160;
+
+    KlineJournal(std::string dir, size_t segmentBytes);
+    ~KlineJournal(); // syncs
+
+    KlineJournal(const KlineJournal&) = delete;
+    KlineJournal& operator=(const KlineJournal&) = delete;
+
+    // sequence number of the last appended kline, 0 if klines is empty
+    uint64_t append(const std::vector<KlineResponseWs>& klines);
+    void sync();
+
+    // appends the entries from fromSeq on, at most max, waiting up to timeout for the first one.
+    // Returns the sequence number to read next.
+    uint64_t read(uint64_t fromSeq, size_t max, std::vector<KlineResponseWs>& out, std::chrono::milliseconds timeout);
+
+    // everything up to seq is applied
+    void checkpoint(uint64_t seq);
+
+    // first sequence number that is not known to be applied
+    uint64_t replayStart() const;
+    uint64_t lastSeq() const;
+
+private:
+    struct Segment {
+        uint64_t firstSeq = 0;
+        size_t capacity = 0; // entries
+        std::string path;
+        boost::interprocess::file_mapping file;
+        boost::interprocess::mapped_region region;
+
+        char* entry(uint64_t seq) { return static_cast<char*>(region.get_address()) + (seq - firstSeq) * ENTRY_SIZE; }
+        uint64_t endSeq() const { return firstSeq + capacity; }
+    };
+
+    std::unique_ptr<Segment> openSegment(uint64_t firstSeq, bool create);
+    uint64_t recoverTail(Segment& segment); // last valid seq of the segment, the rest is zeroed
+    Segment* segmentFor(uint64_t seq);
+    void writeCheckpoint(uint64_t seq);
+
+    std::string dir_;
+    size_t segmentEntries_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable appended_;
+    std::deque<std::unique_ptr<Segment>> segments_; // by first seq, the last one is written
+    uint64_t nextSeq_ = 1;
+    uint64_t syncedSeq_ = 0;     // appended entries up to here are flushed
+    uint64_t checkpointSeq_ = 0; // applied entries up to here
+};
@@ -0,0 +1,116 @@
+#include "db/latestKlineTable.h"
+
+#include <cstring>
+#include <iostream>
+
+namespace bip = boost::interprocess;
+using namespace latest_kline_shm_detail;
+
+LatestKlineTable::LatestKlineTable(std::string shmName, const std::vector<std::string>& symbols, const std::vector<std::string>& intervals) :
+    name_(std::move(shmName))
+{
+    std::vector<std::string> names;
+    slots_.resize(1);
+    for (const auto& i : KLINE_INTERVALS) {
+        if (i.id >= slots_.size()) slots_.resize(i.id + 1);
+    }
+    for (const auto& symbol : symbols) {
+        for (const auto& interval : intervals) {
+            auto name = symbol + "_" + interval;
+            if (name.size() >= LATEST_KLINE_SHM_NAME || intervalId(interval) == 0) {
+                std::cerr << "LatestKlineTable: no slot for " << name << std::endl;
+                continue;
+            }
+            if (slots_[intervalId(interval)].emplace(symbol, static_cast<uint32_t>(names.size())).second) {
+                names.push_back(std::move(name));
+            }
+        }
+    }
+    count_ = names.size();
+
+    map(bip::shared_memory_object(bip::open_or_create, name_.c_str(), bip::read_write));
+    if (region_.get_size() == tableSize(count_) && matches(names)) {
+        std::cout << "LatestKlineTable: taking over " << name_ << ", " << count_ << " series" << std::endl;
+        return;
+    }
+    if (region_.get_size() != tableSize(count_)) {
+        if (region_.get_size() >= LATEST_KLINE_SHM_HEADER) {
+            // tell the readers of the old table that their slots are gone, then replace the object
+            word(base_, 24)->fetch_add(1, std::memory_order_acq_rel);
+        }
+        region_ = bip::mapped_region();
+        bip::shared_memory_object::remove(name_.c_str());
+        bip::shared_memory_object shm(bip::create_only, name_.c_str(), bip::read_write);
+        shm.truncate(static_cast<bip::offset_t>(tableSize(count_)));
+        map(std::move(shm));
+    }
+    layout(names);
+    std::cout << "LatestKlineTable: publishing " << count_ << " series to " << name_ << std::endl;
+}
+
+void LatestKlineTable::map(bip::shared_memory_object shm) {
+    shm_ = std::move(shm);
+    bip::offset_t size = 0;
+    shm_.get_size(size);
+    region_ = size > 0 ? bip::mapped_region(shm_, bip::read_write) : bip::mapped_region();
+    base_ = static_cast<char*>(region_.get_address());
+}
+
+bool LatestKlineTable::matches(const std::vector<std::string>& names) const {
+    using namespace kline_record_detail;
+    if (std::memcmp(base_, LATEST_KLINE_SHM_MAGIC, 8) != 0 || loadLe(base_ + 8, 4) != LATEST_KLINE_SHM_VERSION ||
+        loadLe(base_ + 12, 4) != LATEST_KLINE_SHM_SLOT || loadLe(base_ + 16, 4) != count_ || loadLe(base_ + 20, 4) != count_) {
+        return false;
+    }
+    for (size_t i = 0; i < names.size(); ++i) {
+        const char* entry = base_ + LATEST_KLINE_SHM_HEADER + i * LATEST_KLINE_SHM_NAME;
+        if (std::strncmp(entry, names[i].c_str(), LATEST_KLINE_SHM_NAME) != 0) return false;
+    }
+    return true;
+}
+
+void LatestKlineTable::layout(const std::vector<std::string>& names) {
+    using namespace kline_record_detail;
+    // no series while the directory is rewritten, and a new generation so readers drop the slots they resolved
+    storeLe(base_ + 20, 0, 4);
+    std::memcpy(base_, LATEST_KLINE_SHM_MAGIC, 8);
+    storeLe(base_ + 8, LATEST_KLINE_SHM_VERSION, 4);
+    storeLe(base_ + 12, LATEST_KLINE_SHM_SLOT, 4);
+    storeLe(base_ + 16, count_, 4);
+    word(base_, 24)->fetch_add(1, std::memory_order_acq_rel);
+
+    std::memset(base_ + LATEST_KLINE_SHM_HEADER, 0, slotsOffset(count_) - LATEST_KLINE_SHM_HEADER);
+    for (size_t i = 0; i < names.size(); ++i) {
+        std::memcpy(base_ + LATEST_KLINE_SHM_HEADER + i * LATEST_KLINE_SHM_NAME, names[i].data(), names[i].size());
+    }
+    for (size_t i = 0; i < count_ * LATEST_KLINE_SHM_SLOT / 8; ++i) {
+        word(base_, slotsOffset(count_) + i * 8)->store(0, std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    storeLe(base_ + 20, count_, 4);
+}
+
+void LatestKlineTable::publish(const KlineResponseWs& kline) {
+    uint8_t interval = intervalId(kline.Interval);
+    if (interval >= slots_.size()) return;
+    std::string_view symbol(kline.Symbol, strnlen(kline.Symbol, sizeof(kline.Symbol)));
+    auto it = slots_[interval].find(symbol);
+    if (it == slots_[interval].end()) return;
+
+    alignas(8) char record[KLINE_RECORD_SIZE];
+    encodeKlineRecord(KlineResponseWs::toRecord(kline, 0), record);
+
+    size_t at = slotsOffset(count_) + static_cast<size_t>(it->second) * LATEST_KLINE_SHM_SLOT;
+    auto* seq = word(base_, at);
+    uint64_t s = seq->load(std::memory_order_relaxed);
+    seq->store(s + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release); // odd before any word of the record changes
+    auto* updates = word(base_, at + 8);
+    updates->store(updates->load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    for (size_t w = 0; w < LATEST_KLINE_SHM_RECORD_WORDS; ++w) {
+        uint64_t v;
+        std::memcpy(&v, record + w * 8, 8);
+        word(base_, at + LATEST_KLINE_SHM_RECORD_OFFSET + w * 8)->store(v, std::memory_order_relaxed);
+    }
+    seq->store(s + 2, std::memory_order_release);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+
+#include "dtos/kline.h"
+#include "dtos/latestKlineShm.h"
+
+// Publishes the latest kline of every subscribed series, in progress or closed, to a shared memory table
+// (layout in dtos/latestKlineShm.h), so processes on the same host poll the current bar with a few loads instead of
+// reading the Redis streams.
+//
+// The series get their slots in construction order, the slot directory is written once. Each series is published by
+// the strand of its websocket shard, so a slot only ever has one writer and needs no lock, just the seqlock.
+// The object is left behind on exit: a restart with the same series takes it over as it is, readers keep their slots.
+class LatestKlineTable {
+public:
+    // symbols upper case as in the kline events; one slot per symbol x interval.
+    // throws boost::interprocess::interprocess_exception if the shared memory can't be created
+    LatestKlineTable(std::string shmName, const std::vector<std::string>& symbols, const std::vector<std::string>& intervals);
+
+    LatestKlineTable(const LatestKlineTable&) = delete;
+    LatestKlineTable& operator=(const LatestKlineTable&) = delete;
+
+    const std::string& name() const { return name_; }
+    size_t size() const { return count_; }
+
+    // copies the kline into the slot of its series, ignored for series without a slot
+    void publish(const KlineResponseWs& kline);
+
+private:
+    // true if the mapped table has this layout and directory already
+    bool matches(const std::vector<std::string>& names) const;
+    void layout(const std::vector<std::string>& names);
+    void map(boost::interprocess::shared_memory_object shm);
+
+    std::string name_;
+    boost::interprocess::shared_memory_object shm_;
+    boost::interprocess::mapped_region region_;
+    char* base_ = nullptr;
+    size_t count_ = 0;
+    // slot by symbol, one map per interval id, looked up with the symbol of the event without a copy
+    std::vector<std::map<std::string, uint32_t, std::less<>>> slots_;
+};
@@ -1,17 +1,33 @@
 #include "db/marketDataStreamManager.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <optional>
 
 std::string GLOBAL_KLINES_STREAM = "global_klines_stream";
 std::string GLOBAL_KLINES_GROUP = "global_klines_group";
+const std::string STREAM_MAXLEN = "10000"; // approximate length the kline streams are trimmed to
+
+StreamEncoding parseStreamEncoding(const std::string& name) {
+    if (name == "binary") return StreamEncoding::Binary;
+    if (name != "json") {
+        std::cerr << "Unknown stream encoding '" << name << "', using json" << std::endl;
+    }
+    return StreamEncoding::Json;
+}
 
 // MarketDataStreamManager Constructor
-MarketDataStreamManager::MarketDataStreamManager(const std::string& redisHost, int redisPort, std::string redisPassword) : redisHost(redisHost), redisPort(redisPort), redisContextProducer(nullptr), redisContextConsumer(nullptr) {
+MarketDataStreamManager::MarketDataStreamManager(const std::string& redisHost, int redisPort, std::string redisPassword, RedisProducerOptions producerOptions,
+    RedisConsumerOptions consumerOptions) : redisHost(redisHost), redisPort(redisPort), redisContextProducer(nullptr), redisContextConsumer(nullptr),
+    consumerOptions_(std::move(consumerOptions)) {
     // check the password
     if(!redisPassword.empty()) {
         this->redisPassword = redisPassword;
     }
 
     connectToRedis();
+
+    globalProducer_ = std::make_unique<RedisProducer>(this->redisHost, this->redisPort, this->redisPassword, GLOBAL_KLINES_STREAM, std::move(producerOptions));
 }
 
 // MarketDataStreamManager Destructor
@@ -21,31 +37,77 @@ MarketDataStreamManager::~MarketDataStreamManager() {
 
 // Data Publishing Methods
 void MarketDataStreamManager::publishGlobalKlines(const std::string& data) {
-    if (redisContextProducer) {
-        redisReply* reply = (redisReply*)redisCommand(redisContextProducer, "XADD %s * data %s", GLOBAL_KLINES_STREAM.c_str(), data.c_str());
-        if (reply == nullptr) {
-            std::cerr << "Failed to publish data to stream: " << GLOBAL_KLINES_STREAM << std::endl;
-        } else {
-            freeReplyObject(reply);
-        }
+    publishGlobalKlines(data.data(), data.size());
+}
+
+void MarketDataStreamManager::publishGlobalKlines(const char* data, size_t len) {
+    // the frame is copied into a recycled producer slot, XADD happens on the producer thread
+    globalProducer_->publish(data, len);
+}
+
+void MarketDataStreamManager::publishGlobalKline(const KlineResponseWs& kline, const char* raw, size_t len) {
+    uint32_t symbolId = globalStreamBinary() ? producerSymbols_.id(kline.Symbol) : 0;
+    if (symbolId == 0) {
+        globalProducer_->publish(raw, len, kline.IsFinal);
+        return;
     }
+    char record[KLINE_RECORD_SIZE];
+    encodeKlineRecord(KlineResponseWs::toRecord(kline, symbolId), record);
+    globalProducer_->publish(record, sizeof(record), kline.IsFinal);
 }
 
 void MarketDataStreamManager::publishMarketData(const std::string& asset, const std::string& timeframe, const std::string& data) {
     if (redisContextConsumer) {
-        std::string streamName = asset + "-" + timeframe + "-stream";
-        redisReply* reply = (redisReply*)redisCommand(redisContextConsumer, "XADD %s * data %s", streamName.c_str(), data.c_str());
-        if (reply == nullptr) {
-            std::cerr << "Failed to publish data to stream: " << streamName << std::endl;
-        } else {
-            freeReplyObject(reply);
+        appendAssetXadd(asset, timeframe, data);
+        flushPipeline();
+    }
+}
+
+// XADD <asset>-<timeframe>-stream MAXLEN ~ 10000 * data <payload>, trimmed by the add itself; binary safe
+void MarketDataStreamManager::appendAssetXadd(std::string_view asset, std::string_view timeframe, std::string_view payload) {
+    std::string streamName;
+    streamName.reserve(asset.size() + timeframe.size() + 8);
+    streamName.append(asset).append("-").append(timeframe).append("-stream");
+    const char* argv[] = { "XADD", streamName.c_str(), "MAXLEN", "~", STREAM_MAXLEN.c_str(), "*", "data", payload.data() };
+    size_t argvLen[] = { 4, streamName.size(), 6, 1, STREAM_MAXLEN.size(), 1, 4, payload.size() };
+    if (redisAppendCommandArgv(redisContextConsumer, 8, argv, argvLen) == REDIS_OK) ++pipelined_;
+}
+
+// XACK <global stream> <group> <id>..., at most 1000 ids per command
+void MarketDataStreamManager::appendGlobalAcks(const std::vector<std::string>& ids) {
+    static constexpr size_t IDS_PER_XACK = 1000;
+    std::vector<const char*> argv;
+    std::vector<size_t> argvLen;
+    for (size_t from = 0; from < ids.size(); from += IDS_PER_XACK) {
+        size_t to = std::min(ids.size(), from + IDS_PER_XACK);
+        argv.assign({ "XACK", GLOBAL_KLINES_STREAM.c_str(), GLOBAL_KLINES_GROUP.c_str() });
+        argvLen.assign({ 4, GLOBAL_KLINES_STREAM.size(), GLOBAL_KLINES_GROUP.size() });
+        for (size_t i = from; i < to; ++i) {
+            argv.push_back(ids[i].c_str());
+            argvLen.push_back(ids[i].size());
         }
+        if (redisAppendCommandArgv(redisContextConsumer, static_cast<int>(argv.size()), argv.data(), argvLen.data()) == REDIS_OK) ++pipelined_;
+    }
+}
 
-        // trim the symbol stream to keep the latest 10000 messages
-        std::cout << "Trimming stream " << streamName << " to keep the latest 10000 messages." << std::endl;
-        // redisCommand(redisContextConsumer, "XTRIM %s MAXLEN ~ %d", streamName.c_str(), 10000);
-        auto trim = exec(redisContextConsumer, "XTRIM %s MAXLEN ~ %d", streamName.c_str(), 10000);
+bool MarketDataStreamManager::flushPipeline() {
+    // the first redisGetReply writes out every appended command, then the replies are read back in order
+    bool ok = true;
+    for (; pipelined_ > 0; --pipelined_) {
+        void* raw = nullptr;
+        if (redisGetReply(redisContextConsumer, &raw) != REDIS_OK || raw == nullptr) {
+            // the connection is broken, ensureGlobalConsumer reconnects and unacked entries are delivered again
+            std::cerr << "Redis pipeline failed with " << pipelined_ << " replies outstanding: " << redisContextConsumer->errstr << std::endl;
+            pipelined_ = 0;
+            return false;
+        }
+        ReplyUPtr reply(static_cast<redisReply*>(raw));
+        if (reply->type == REDIS_REPLY_ERROR) {
+            if (ok) std::cerr << "Redis pipelined command failed: " << reply->str << std::endl;
+            ok = false;
+        }
     }
+    return ok;
 }
 
 std::optional<std::pair<std::string, std::string>> parseStreamMessage(redisReply* message) {
@@ -75,7 +137,7 @@ std::optional<std::pair<std::string, std::string>> parseStreamMessage(redisReply
         redisReply* value = fieldArray->element[i + 1];
         if (field->type == REDIS_REPLY_STRING && value->type == REDIS_REPLY_STRING) {
             if (std::string(field->str) == "data") {
-                return std::make_pair(messageId, value->str);
+                return std::make_pair(messageId, std::string(value->str, value->len)); // binary safe
             }
         }
     }
@@ -84,119 +146,173 @@ std::optional<std::pair<std::string, std::string>> parseStreamMessage(redisReply
     return std::nullopt;
 }
 
-// Data Consumption Methods
-std::vector<KlineResponseWs> MarketDataStreamManager::fetchGlobalKlinesAndDispatch(const std::string& consumerName) {
-    // Execute the XGROUP CREATE command
-    redisReply* reply = (redisReply*)redisCommand(redisContextConsumer,
-        "XGROUP CREATE %s %s $ MKSTREAM", GLOBAL_KLINES_STREAM.c_str(), GLOBAL_KLINES_GROUP.c_str());
-    if (reply != nullptr) {
-        freeReplyObject(reply);
-    }
-
-    // new a vector to store the data
-    std::vector<KlineResponseWs> finalklines;
-
-    reply = (redisReply*)redisCommand(redisContextConsumer, "XREADGROUP GROUP %s %s STREAMS %s >", GLOBAL_KLINES_GROUP.c_str(), consumerName.c_str(), GLOBAL_KLINES_STREAM.c_str());
-    if (reply != nullptr && reply->type == REDIS_REPLY_ARRAY && reply->elements > 0) {
-        // check how many messages are in the reply    
-        std::cout << "Fetched from Redis global_kline_stream " << reply->element[0]->element[1]->elements << " latest market info with different symbols" << std::endl;
-        redisReply* messages = reply->element[0]->element[1]; // reply->element[0] is the redis 0th stream if you Xread multi streams, and reply->element[0]->element[0] is the stream name
-        if (messages->type == REDIS_REPLY_ARRAY && messages->elements > 0) {
-            for (size_t i = 0; i < messages->elements; ++i) {
-                redisReply* message = messages->element[i];
-                auto parsed = parseStreamMessage(message);
-                if (!parsed.has_value()) {
-                    continue; // skip this message
-                }
-                const std::string& messageId = parsed->first;
-                const std::string& messageData = parsed->second;
-
-                std::cout << "fetchGlobalKlines data: " << messageData << std::endl;
-
-                // step 0: json parse and ack 0th message
-                nlohmann::json j;
-                try {
-                    j = nlohmann::json::parse(messageData);
-                    // first resp maybe like {"result":null,"id":1}
-                    auto result = j.find("result");
-                    if (result != j.end() && result->is_null()) {
-                        // redisCommand(redisContextConsumer, "XACK %s %s %s", GLOBAL_KLINES_STREAM.c_str(), GLOBAL_KLINES_GROUP.c_str(), messageId.c_str());
-                        auto ack = exec(redisContextConsumer, "XACK %s %s %s", GLOBAL_KLINES_STREAM.c_str(), GLOBAL_KLINES_GROUP.c_str(), messageId.c_str());
-                        continue;
-                    }
-                } catch (const std::exception& e) {
-                    std::cerr << "Error deserializing message: " << e.what() << std::endl;
-
-                    // free the reply object
-                    if (reply != nullptr) {
-                        freeReplyObject(reply);
-                        reply = nullptr;
-                    }
-
-                    return finalklines;
-                }
+bool MarketDataStreamManager::ensureGlobalConsumer() {
+    if (!redisContextConsumer || redisContextConsumer->err) {
+        connectConsumer();
+        if (!redisContextConsumer) return false;
+        globalGroupReady_ = false;
+        globalCursor_ = "0"; // what was read before the connection dropped and not acked yet is delivered again
+    }
+    if (globalGroupReady_) return true;
 
-                // step 1: deserialize from json
-                KlineResponseWs kline; 
-                try
-                {
-                    kline = KlineResponseWs::deserializeFromJson(j);
-                }
-                catch(const std::exception& e)
-                {
-                    std::cerr << e.what() << '\n';
-
-                    // free the reply object
-                    if (reply != nullptr) {
-                        freeReplyObject(reply);
-                        reply = nullptr;
-                    }
-
-                    return finalklines;
-                }  
-                
-                try
-                {
-                    // step 2: persistence to mongo
-                    if (kline.IsFinal) {
-                        // final kline found, put it in the finalklines vector
-                        finalklines.push_back(kline);
-                    }
-
-                    // step 3: publish to asset-timeframe stream
-                    std::cout << "Publishing to asset-timeframe:" << kline.Symbol << "-" << kline.Interval << "-stream" << std::endl;
-                    publishMarketData(kline.Symbol, kline.Interval, messageData);
-                    
-                    // step 4: ack the message
-                    // acknowledgeMessage(GLOBAL_KLINES_STREAM, GLOBAL_KLINES_GROUP, messageId);
-                    // redisCommand(redisContextConsumer, "XACK %s %s %s", GLOBAL_KLINES_STREAM.c_str(), GLOBAL_KLINES_GROUP.c_str(), messageId.c_str());
-                    auto ack = exec(redisContextConsumer, "XACK %s %s %s", GLOBAL_KLINES_STREAM.c_str(), GLOBAL_KLINES_GROUP.c_str(), messageId.c_str());
-                }
-                catch(const std::exception& e)
-                {
-                    std::cerr << e.what() << '\n';
-                    continue;
-                }
-            }
+    auto reply = exec(redisContextConsumer, "XGROUP CREATE %s %s $ MKSTREAM", GLOBAL_KLINES_STREAM.c_str(), GLOBAL_KLINES_GROUP.c_str());
+    if (!reply) return false;
+    if (reply->type == REDIS_REPLY_ERROR && std::strncmp(reply->str, "BUSYGROUP", 9) != 0) {
+        std::cerr << "XGROUP CREATE " << GLOBAL_KLINES_GROUP << " failed: " << reply->str << std::endl;
+        return false;
+    }
+    globalGroupReady_ = true;
+    return true;
+}
 
-            if (reply != nullptr) {
-                freeReplyObject(reply);
-                reply = nullptr;
-            }
+void MarketDataStreamManager::claimStaleGlobalKlines(const std::string& consumerName) {
+    // JUSTID: ownership only, the entries are read below with the rest of our pending ones
+    std::string cursor = "0-0";
+    size_t claimed = 0;
+    do {
+        auto reply = exec(redisContextConsumer, "XAUTOCLAIM %s %s %s %lld %s COUNT %d JUSTID",
+            GLOBAL_KLINES_STREAM.c_str(), GLOBAL_KLINES_GROUP.c_str(), consumerName.c_str(),
+            static_cast<long long>(consumerOptions_.claimIdleMs), cursor.c_str(), static_cast<int>(consumerOptions_.batchSize));
+        if (!reply || reply->type != REDIS_REPLY_ARRAY || reply->elements < 2 || reply->element[0]->type != REDIS_REPLY_STRING) {
+            // XAUTOCLAIM needs Redis 6.2, entries of other consumers then stay with them
+            std::cerr << "XAUTOCLAIM " << GLOBAL_KLINES_STREAM << " failed: "
+                << (reply && reply->type == REDIS_REPLY_ERROR ? reply->str : "no reply") << std::endl;
+            return;
         }
+        cursor.assign(reply->element[0]->str, reply->element[0]->len);
+        if (reply->element[1]->type == REDIS_REPLY_ARRAY) claimed += reply->element[1]->elements;
+    } while (cursor != "0-0");
+    if (claimed > 0) {
+        std::cout << "Took over " << claimed << " stale pending entries of " << GLOBAL_KLINES_STREAM << std::endl;
+    }
+}
 
-        // step 5: trim the stream
-        std::cout << "Trimming global klines stream to keep the latest 10000 messages." << std::endl;
-        // redisCommand(redisContextConsumer, "XTRIM %s MAXLEN ~ %d", GLOBAL_KLINES_STREAM.c_str(), 10000);
-        auto trim = exec(redisContextConsumer, "XTRIM %s MAXLEN ~ %d", GLOBAL_KLINES_STREAM.c_str(), 10000);
+// Data Consumption Methods
+bool MarketDataStreamManager::fetchGlobalKlinesAndDispatch(const std::string& consumerName, GlobalKlineBatch& batch) {
+    batch.closedKlines.clear();
+    batch.closedIds.clear();
+    if (!ensureGlobalConsumer()) return false;
+    if (!staleClaimed_) {
+        claimStaleGlobalKlines(consumerName);
+        staleClaimed_ = true;
+    }
+
+    // pending entries first (they may be dispatched twice, the stored klines are upserted), then block for new ones
+    bool pending = globalCursor_ != ">";
+    int count = static_cast<int>(consumerOptions_.batchSize);
+    ReplyUPtr reply = pending
+        ? exec(redisContextConsumer, "XREADGROUP GROUP %s %s COUNT %d STREAMS %s %s", GLOBAL_KLINES_GROUP.c_str(),
+            consumerName.c_str(), count, GLOBAL_KLINES_STREAM.c_str(), globalCursor_.c_str())
+        : exec(redisContextConsumer, "XREADGROUP GROUP %s %s COUNT %d BLOCK %d STREAMS %s >", GLOBAL_KLINES_GROUP.c_str(),
+            consumerName.c_str(), count, consumerOptions_.blockMs, GLOBAL_KLINES_STREAM.c_str());
+    if (!reply || reply->type == REDIS_REPLY_ERROR) {
+        std::cerr << "XREADGROUP " << GLOBAL_KLINES_STREAM << " failed: "
+            << (reply ? reply->str : redisContextConsumer->errstr) << std::endl;
+        globalGroupReady_ = false; // NOGROUP if the stream was deleted
+        return false;
+    }
+
+    // nil when the block timed out
+    redisReply* messages = nullptr;
+    if (reply->type == REDIS_REPLY_ARRAY && reply->elements > 0 && reply->element[0]->type == REDIS_REPLY_ARRAY &&
+        reply->element[0]->elements == 2 && reply->element[0]->element[1]->type == REDIS_REPLY_ARRAY) {
+        messages = reply->element[0]->element[1]; // reply->element[0] is the redis 0th stream if you Xread multi streams, and reply->element[0]->element[0] is the stream name
+    }
+    size_t n = messages ? messages->elements : 0;
+    if (pending && n == 0) {
+        globalCursor_ = ">";
+        return true;
     }
+    if (n == 0) return true;
+    std::cout << "Fetched " << n << " entries from " << GLOBAL_KLINES_STREAM << (pending ? " (pending)" : "") << std::endl;
+
+    std::vector<std::string> acks; // entries that don't carry a closed kline
+    for (size_t i = 0; i < n; ++i) {
+        redisReply* message = messages->element[i];
+        if (message->type != REDIS_REPLY_ARRAY || message->elements < 1 || message->element[0]->type != REDIS_REPLY_STRING) continue;
+        std::string messageId(message->element[0]->str, message->element[0]->len);
+        if (pending) globalCursor_ = messageId;
+
+        // a pending entry trimmed from the stream comes back without fields, nothing is left to store
+        if (message->elements >= 2 && message->element[1]->type == REDIS_REPLY_NIL) {
+            std::cerr << "Pending entry " << messageId << " of " << GLOBAL_KLINES_STREAM << " was trimmed before it was stored, "
+                << "its kline is lost until a history gap fill covers it" << std::endl;
+            acks.push_back(std::move(messageId));
+            continue;
+        }
+        auto parsed = parseStreamMessage(message);
+        if (!parsed.has_value()) {
+            acks.push_back(std::move(messageId));
+            continue;
+        }
+        const std::string& messageData = parsed->second;
+
+        // step 0: decode the binary record or single-pass parse the json, and ack the subscription reply like {"result":null,"id":1}
+        KlineResponseWs kline;
+        bool binary = isKlineRecord(messageData.data(), messageData.size());
+        KlineParseStatus status;
+        if (binary) {
+            status = decodeRecord(messageData, kline) ? KlineParseStatus::Ok : KlineParseStatus::Invalid;
+        } else {
+            status = parseKlineEvent(messageData, kline);
+        }
+        if (status == KlineParseStatus::Invalid) {
+            // it will never parse, acked so it isn't delivered again and again
+            std::cerr << "Error deserializing message " << messageId << ": malformed kline event" << std::endl;
+        }
+        if (status != KlineParseStatus::Ok) {
+            acks.push_back(std::move(messageId));
+            continue;
+        }
+
+        try
+        {
+            // step 1: publish to asset-timeframe stream, pipelined with the rest of the batch
+            dispatchKline(kline, messageData, binary);
+        }
+        catch(const std::exception& e)
+        {
+            std::cerr << e.what() << '\n';
+        }
 
-    if (reply != nullptr) {
-        freeReplyObject(reply);
-        reply = nullptr;
+        // step 2: closed klines go to persistence and are acked once stored, the in-progress updates now
+        if (kline.IsFinal) {
+            batch.closedKlines.push_back(kline);
+            batch.closedIds.push_back(std::move(messageId));
+        } else {
+            acks.push_back(std::move(messageId));
+        }
     }
 
-    return finalklines;
+    // step 3: ack what was dispatched in the same pipeline: one round-trip for the batch, and the XACKs run after
+    // the XADDs
+    appendGlobalAcks(acks);
+    flushPipeline();
+
+    // step 4: trim the stream
+    trimGlobalStream();
+    return true;
+}
+
+void MarketDataStreamManager::trimGlobalStream() {
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastGlobalTrim_ < std::chrono::seconds(1)) return;
+    lastGlobalTrim_ = now;
+
+    // pending entries are closed klines not stored yet (e.g. MongoDB is down), a trim could take them with it:
+    // the stream grows until they are acknowledged
+    auto pending = exec(redisContextConsumer, "XPENDING %s %s", GLOBAL_KLINES_STREAM.c_str(), GLOBAL_KLINES_GROUP.c_str());
+    if (!pending || pending->type != REDIS_REPLY_ARRAY || pending->elements < 1 || pending->element[0]->type != REDIS_REPLY_INTEGER) return;
+    if (pending->element[0]->integer > 0) return;
+    auto trim = exec(redisContextConsumer, "XTRIM %s MAXLEN ~ %s", GLOBAL_KLINES_STREAM.c_str(), STREAM_MAXLEN.c_str());
+}
+
+bool MarketDataStreamManager::acknowledgeGlobalKlines(const std::vector<std::string>& ids) {
+    if (ids.empty()) return true;
+    if (!redisContextConsumer) return false;
+    // entries whose XACK fails stay pending, delivered again after a reconnect or a restart
+    appendGlobalAcks(ids);
+    return flushPipeline();
 }
 
 std::string MarketDataStreamManager::consumeData(const std::string& asset, const std::string& timeframe, const std::string& consumerName) {
@@ -238,6 +354,104 @@ void MarketDataStreamManager::acknowledgeMessage(const std::string& asset, const
     }
 }
 
+void MarketDataStreamManager::dispatchKline(const KlineResponseWs& kline, const std::string& payload, bool payloadBinary) {
+    bool wantBinary = assetEncoding_ == StreamEncoding::Binary;
+    if (wantBinary == payloadBinary) {
+        appendAssetXadd(kline.Symbol, kline.Interval, payload);
+        return;
+    }
+
+    if (wantBinary) {
+        uint32_t symbolId = consumerSymbols_.id(kline.Symbol);
+        if (symbolId == 0) {
+            loadSymbolRegistry(consumerSymbols_);
+            symbolId = consumerSymbols_.id(kline.Symbol);
+        }
+        if (symbolId != 0) {
+            std::string record(KLINE_RECORD_SIZE, '\0');
+            encodeKlineRecord(KlineResponseWs::toRecord(kline, symbolId), &record[0]);
+            appendAssetXadd(kline.Symbol, kline.Interval, record);
+            return;
+        }
+        // not interned (yet), json keeps the message readable for every consumer
+    }
+    appendAssetXadd(kline.Symbol, kline.Interval, KlineResponseWs::serializeToJson(kline).dump());
+}
+
+bool MarketDataStreamManager::decodeRecord(const std::string& payload, KlineResponseWs& kline) {
+    KlineRecord record;
+    if (!decodeKlineRecord(payload.data(), payload.size(), record)) {
+        std::cerr << "Unsupported kline record version " << static_cast<int>(static_cast<uint8_t>(payload[1])) << std::endl;
+        return false;
+    }
+
+    const std::string* symbol = consumerSymbols_.name(record.symbolId);
+    if (symbol == nullptr) {
+        // registered by the producer after our last load
+        loadSymbolRegistry(consumerSymbols_);
+        symbol = consumerSymbols_.name(record.symbolId);
+    }
+    if (symbol == nullptr) {
+        std::cerr << "Unknown symbol id " << record.symbolId << " in kline record" << std::endl;
+        return false;
+    }
+    kline = KlineResponseWs::fromRecord(record, *symbol);
+    return true;
+}
+
+void MarketDataStreamManager::registerSymbols(const std::vector<std::string>& symbols) {
+    for (const auto& s : symbols) {
+        std::string symbol = s;
+        std::transform(symbol.begin(), symbol.end(), symbol.begin(), ::toupper); // as in the ws events
+        uint32_t id = internSymbol(symbol);
+        if (id == 0) {
+            std::cerr << "Failed to intern symbol " << symbol << ", its klines are published as json" << std::endl;
+            continue;
+        }
+        producerSymbols_.add(id, symbol);
+    }
+    std::cout << "Interned " << producerSymbols_.size() << " symbols in " << KLINE_SYMBOL_REGISTRY << std::endl;
+}
+
+// symbol -> id in the KLINE_SYMBOL_REGISTRY hash; ids come from a counter and the first writer wins, so several
+// producers agree on the id. Returns 0 on failure.
+uint32_t MarketDataStreamManager::internSymbol(const std::string& symbol) {
+    if (!redisContextProducer) return 0;
+
+    auto lookup = [&]() -> uint32_t {
+        auto r = exec(redisContextProducer, "HGET %s %s", KLINE_SYMBOL_REGISTRY, symbol.c_str());
+        if (r && r->type == REDIS_REPLY_STRING) return static_cast<uint32_t>(std::strtoul(r->str, nullptr, 10));
+        return 0;
+    };
+
+    uint32_t id = lookup();
+    if (id != 0) return id;
+
+    std::string counterKey = std::string(KLINE_SYMBOL_REGISTRY) + ":next";
+    auto next = exec(redisContextProducer, "INCR %s", counterKey.c_str());
+    if (!next || next->type != REDIS_REPLY_INTEGER) return 0;
+    std::string candidate = std::to_string(next->integer);
+
+    auto set = exec(redisContextProducer, "HSETNX %s %s %s", KLINE_SYMBOL_REGISTRY, symbol.c_str(), candidate.c_str());
+    if (set && set->type == REDIS_REPLY_INTEGER && set->integer == 1) {
+        return static_cast<uint32_t>(next->integer);
+    }
+    return lookup(); // another producer was first
+}
+
+void MarketDataStreamManager::loadSymbolRegistry(KlineSymbolTable& table) {
+    if (!redisContextConsumer) return;
+    flushPipeline(); // called mid-batch, the replies of the pipelined commands come first
+    auto r = exec(redisContextConsumer, "HGETALL %s", KLINE_SYMBOL_REGISTRY);
+    if (!r || r->type != REDIS_REPLY_ARRAY) return;
+    for (size_t i = 0; i + 1 < r->elements; i += 2) {
+        redisReply* field = r->element[i];
+        redisReply* value = r->element[i + 1];
+        if (field->type != REDIS_REPLY_STRING || value->type != REDIS_REPLY_STRING) continue;
+        table.add(static_cast<uint32_t>(std::strtoul(value->str, nullptr, 10)), std::string_view(field->str, field->len));
+    }
+}
+
 // Persistence Methods
 void MarketDataStreamManager::persistData() {
     // Placeholder: Logic to persist data to MongoDB or other storage.
@@ -283,47 +497,20 @@ void MarketDataStreamManager::connectToRedis() {
     if (redisContextProducer) { redisFree(redisContextProducer); redisContextProducer = nullptr; }
     if (redisContextConsumer) { redisFree(redisContextConsumer); redisContextConsumer = nullptr; }
 
-    auto connect_and_auth = [&](redisContext*& ctx, const char* tag) -> bool {
-        // 1) connect redis
-        ctx = redisConnect(redisHost.c_str(), redisPort);
-        if (!ctx || ctx->err) {
-            std::cerr << tag << " connection error: "
-                << (ctx && ctx->errstr ? ctx->errstr : "can't allocate redis context")
-                << std::endl;
-            if (ctx) { redisFree(ctx); ctx = nullptr; }
-            return false;
-        }
-
-        // 2) auth
-        if (!redisPassword.empty()) {
-            ReplyUPtr reply{ static_cast<redisReply*>(
-                redisCommand(ctx, "AUTH %s", redisPassword.c_str()))
-            };
-
-            // when reply is nullptr, or ctx has an error, or reply is an error type
-            if (!reply || (ctx && ctx->err) || reply->type == REDIS_REPLY_ERROR) {
-                std::cerr << tag << " authentication failed: "
-                    << (ctx && ctx->errstr ? ctx->errstr : "Unknown error")
-                    << std::endl;
-                if (ctx) { redisFree(ctx); ctx = nullptr; }
-                return false;
-            }
-
-            // some redis server return "OK" as status, some return "OK" as string
-            if (reply->type == REDIS_REPLY_STATUS) {
-                if (!(reply->str && std::string(reply->str) == "OK")) {
-                    std::cerr << tag << " AUTH unexpected status: "
-                        << (reply->str ? reply->str : "(null)") << std::endl;
-                }
-            }
-        }
+    // Producer & Consumer setup
+    redisContextProducer = connectRedisWithAuth(redisHost, redisPort, redisPassword, "Producer");
+    connectConsumer();
+}
 
-        return true;
-        };
+void MarketDataStreamManager::connectConsumer() {
+    if (redisContextConsumer) { redisFree(redisContextConsumer); redisContextConsumer = nullptr; }
+    redisContextConsumer = connectRedisWithAuth(redisHost, redisPort, redisPassword, "Consumer");
+    if (!redisContextConsumer) return;
 
-    // Producer & Consumer setup
-    (void)connect_and_auth(redisContextProducer, "Producer");
-    (void)connect_and_auth(redisContextConsumer, "Consumer");
+    // longer than a blocking XREADGROUP, a hung server then shows up as a broken connection
+    int64_t timeoutMs = consumerOptions_.blockMs + 5000;
+    struct timeval tv { static_cast<time_t>(timeoutMs / 1000), static_cast<suseconds_t>((timeoutMs % 1000) * 1000) };
+    redisSetTimeout(redisContextConsumer, tv);
 }
 
 void MarketDataStreamManager::disconnectFromRedis() {
@@ -1,9 +1,16 @@
 #include <hiredis/hiredis.h>
+#include "db/redisProducer.h"
 #include "dtos/kline.h"
+#include "dtos/klineParser.h"
+#include "dtos/klineRecord.h"
 #include <iostream>
 #include <thread>
 #include <atomic>
+#include <chrono>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
 
 // Example "reply" format from XREADGROUP command:
 // for multiple streams:
@@ -22,19 +29,51 @@
 struct RedisReplyDeleter { void operator()(redisReply* r) const { if (r) freeReplyObject(r); } };
 using ReplyUPtr = std::unique_ptr<redisReply, RedisReplyDeleter>;
 
+// payload format of a kline stream, see klineRecord.h for the binary one
+enum class StreamEncoding { Json, Binary };
+StreamEncoding parseStreamEncoding(const std::string& name);
+
+struct RedisConsumerOptions {
+    size_t batchSize = 500;       // XREADGROUP COUNT
+    int blockMs = 100;            // XREADGROUP BLOCK, how long a read waits for new entries before it returns empty
+    int64_t claimIdleMs = 60000;  // at startup, entries other consumers read and left unacked this long are taken over
+};
+
+// one XREADGROUP of global_klines_stream
+struct GlobalKlineBatch {
+    std::vector<KlineResponseWs> closedKlines; // in stream order
+    std::vector<std::string> closedIds;        // their entry ids, to acknowledge once the klines are stored
+};
+
 // A Redis wrapper class for managing market data streams
 class MarketDataStreamManager {
 public:
     // Constructor & Destructor
-    MarketDataStreamManager(const std::string& redisHost, int redisPort, std::string redisPassword);
+    MarketDataStreamManager(const std::string& redisHost, int redisPort, std::string redisPassword, RedisProducerOptions producerOptions = {},
+        RedisConsumerOptions consumerOptions = {});
     ~MarketDataStreamManager();
 
     // Data Publishing Methods
     void publishGlobalKlines(const std::string& data);
+    void publishGlobalKlines(const char* data, size_t len); // binary safe, queued to the async producer and returns at once
+    size_t globalProducerQueueDepth() const { return globalProducer_ ? globalProducer_->queueDepth() : 0; }
+    void publishGlobalKline(const KlineResponseWs& kline, const char* raw, size_t len); // binary record if enabled and the symbol is registered, else raw
     void publishMarketData(const std::string& asset, const std::string& timeframe, const std::string& data);
 
+    // Binary encoding: pick the format per stream, and intern the symbols before publishing
+    void setStreamEncodings(StreamEncoding global, StreamEncoding asset) { globalEncoding_ = global; assetEncoding_ = asset; }
+    bool globalStreamBinary() const { return globalEncoding_ == StreamEncoding::Binary; }
+    bool usesBinaryEncoding() const { return globalEncoding_ == StreamEncoding::Binary || assetEncoding_ == StreamEncoding::Binary; }
+    void registerSymbols(const std::vector<std::string>& symbols); // call before publishing starts, the producer table is read lock-free afterwards
+
     // Data Consumption Methods
-    std::vector<KlineResponseWs> fetchGlobalKlinesAndDispatch(const std::string& consumerName);
+    // Reads the next batch of global_klines_stream, waiting up to blockMs for new entries, and dispatches it to the
+    // per-symbol streams. The entries without a closed kline are acknowledged here, the closed ones stay pending
+    // until acknowledgeGlobalKlines: after a crash they are delivered again. The first call (and the first after a
+    // reconnect) first takes over stale entries of other consumers and re-reads the entries still pending for
+    // consumerName. False if Redis could not be read.
+    bool fetchGlobalKlinesAndDispatch(const std::string& consumerName, GlobalKlineBatch& batch);
+    bool acknowledgeGlobalKlines(const std::vector<std::string>& ids); // pipelined, one XACK per 1000 ids
     std::string consumeData(const std::string& asset, const std::string& timeframe, const std::string& consumerName); // todo:: strategy is the consumer for those dispatched data
     
     void acknowledgeMessage(const std::string& asset, const std::string& timeframe, const std::string& messageId);
@@ -52,8 +91,24 @@ private:
         return ReplyUPtr(raw);
     }
 
+    // Commands of a batch are appended to the consumer connection and sent together by flushPipeline, which
+    // reads all their replies back; false if one failed.
+    void dispatchKline(const KlineResponseWs& kline, const std::string& payload, bool payloadBinary);
+    void appendAssetXadd(std::string_view asset, std::string_view timeframe, std::string_view payload);
+    void appendGlobalAcks(const std::vector<std::string>& ids);
+    bool flushPipeline();
+    bool decodeRecord(const std::string& payload, KlineResponseWs& kline);
+    uint32_t internSymbol(const std::string& symbol);
+    void loadSymbolRegistry(KlineSymbolTable& table);
+
     void connectToRedis();
+    void connectConsumer();
     void disconnectFromRedis();
+    // (re)connects the consumer and creates the global group once, false if Redis is unreachable
+    bool ensureGlobalConsumer();
+    void claimStaleGlobalKlines(const std::string& consumerName);
+    // MAXLEN ~ 10000, at most once a second and only while the group has no pending entries
+    void trimGlobalStream();
     void createConsumerGroup(const std::string& asset, const std::string& timeframe);
     void trimStream(const std::string& asset, const std::string& timeframe);
 
@@ -63,5 +118,18 @@ private:
     std::string redisPassword;
     redisContext* redisContextProducer;
     redisContext* redisContextConsumer;
+    std::unique_ptr<RedisProducer> globalProducer_; // pipelined writer of global_klines_stream, off the ws read path
     std::atomic<bool> keepRunning;
+
+    RedisConsumerOptions consumerOptions_;
+    bool globalGroupReady_ = false;
+    bool staleClaimed_ = false;
+    std::string globalCursor_ = "0"; // XREADGROUP id: "0" re-reads our pending entries, ">" new ones
+    size_t pipelined_ = 0;           // commands appended to the consumer connection, replies not read yet
+    std::chrono::steady_clock::time_point lastGlobalTrim_{};
+
+    StreamEncoding globalEncoding_ = StreamEncoding::Json;
+    StreamEncoding assetEncoding_ = StreamEncoding::Json;
+    KlineSymbolTable producerSymbols_; // filled by registerSymbols, then only read by the ws threads
+    KlineSymbolTable consumerSymbols_; // dispatch thread only, reloaded when an unknown id shows up
 };
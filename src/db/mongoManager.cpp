@@ -1,8 +1,16 @@
 #include "db/mongoManager.h"
+#include "db/klineArchive.h"
+#include "db/klineCache.h"
+#include "dtos/intervals.h"
+#include <algorithm>
 #include <iomanip> // std::setw, std::setfill
 #include <sstream>
 #include <iostream>
+#include <charconv>
+#include <climits>
 #include <chrono>
+#include <map>
+#include <optional>
 #include <thread>
 #include <unordered_set>
 
@@ -10,9 +18,550 @@ using bsoncxx::builder::basic::kvp;
 using bsoncxx::builder::basic::make_document;
 
 
-MongoManager::MongoManager(const std::string uriStr):uriStr(uriStr), mongoPool(mongocxx::uri{ this->uriStr.c_str() }){
+MongoManager::MongoManager(const std::string uriStr, KlineStorageOptions storage):uriStr(uriStr), storage_(storage), mongoPool(mongocxx::uri{ this->uriStr.c_str() }){
 };
 
+KlineLayout parseKlineLayout(const std::string& name) {
+    if (name == "timeseries") return KlineLayout::TimeSeries;
+    if (name == "buckets") return KlineLayout::Buckets;
+    if (name != "documents") {
+        std::cerr << "Unknown kline layout '" << name << "', using documents" << std::endl;
+    }
+    return KlineLayout::Documents;
+}
+
+KlinePriceEncoding parseKlinePriceEncoding(const std::string& name) {
+    if (name == "double") return KlinePriceEncoding::Double;
+    if (name == "decimal128") return KlinePriceEncoding::Decimal128;
+    if (name != "string") {
+        std::cerr << "Unknown kline price encoding '" << name << "', using string" << std::endl;
+    }
+    return KlinePriceEncoding::String;
+}
+
+static const char* const KLINE_PRICE_FIELDS[] = {
+    "open", "high", "low", "close", "volume", "quotevolume", "activebuyvolume", "activebuyquotevolume",
+};
+
+// calls put with the BSON value of d in the given encoding
+template <class Put>
+static void withPriceValue(const Decimal& d, KlinePriceEncoding encoding, Put&& put) {
+    switch (encoding) {
+    case KlinePriceEncoding::Double:
+        put(d.toDouble());
+        break;
+    case KlinePriceEncoding::Decimal128: {
+        uint64_t high, low;
+        d.toDecimal128(high, low);
+        put(bsoncxx::types::b_decimal128{ bsoncxx::decimal128{ high, low } });
+        break;
+    }
+    default:
+        put(d.toString());
+        break;
+    }
+}
+
+static void appendPrice(bsoncxx::builder::basic::document& doc, const char* key, const Decimal& d, KlinePriceEncoding encoding) {
+    withPriceValue(d, encoding, [&](auto&& v) { doc.append(kvp(key, std::forward<decltype(v)>(v))); });
+}
+
+// a price or volume field in any of the encodings, 0 if it is missing or of another type
+static Decimal priceToDecimal(const bsoncxx::document::element& e) {
+    Decimal d;
+    if (!e) return d;
+    switch (e.type()) {
+    case bsoncxx::type::k_string: {
+        auto sv = e.get_string().value;
+        return Decimal::fromString(std::string_view(sv.data(), sv.size()));
+    }
+    case bsoncxx::type::k_decimal128: {
+        auto v = e.get_decimal128().value;
+        if (!Decimal::fromDecimal128(v.high(), v.low(), d)) d = Decimal::fromString(v.to_string());
+        return d;
+    }
+    case bsoncxx::type::k_double: {
+        // shortest text that reads back as the same double
+        char buf[64];
+        auto res = std::to_chars(buf, buf + sizeof(buf), e.get_double().value, std::chars_format::fixed);
+        if (res.ec == std::errc()) d = Decimal::fromString(std::string_view(buf, res.ptr - buf));
+        return d;
+    }
+    default:
+        return d;
+    }
+}
+
+static double priceToDouble(const bsoncxx::document::element& e) {
+    if (e && e.type() == bsoncxx::type::k_double) return e.get_double().value;
+    return priceToDecimal(e).toDouble();
+}
+
+// the stored kline document, shared by the upsert and the time-series insert paths
+static void appendKlineFields(bsoncxx::builder::basic::document& doc, const KlineResponseWs& kline, KlinePriceEncoding encoding) {
+    doc.append(
+        kvp("eventtype", std::string(kline.EventType)),
+        kvp("eventtime", kline.EventTime),
+        kvp("symbol", std::string(kline.Symbol)),
+        kvp("starttime", kline.StartTime),
+        kvp("endtime", kline.EndTime),
+        kvp("interval", std::string(kline.Interval)),
+        kvp("firsttradeid", kline.FirstTradeID),
+        kvp("lasttradeid", kline.LastTradeID));
+    appendPrice(doc, "open", kline.Open, encoding);
+    appendPrice(doc, "high", kline.High, encoding);
+    appendPrice(doc, "low", kline.Low, encoding);
+    appendPrice(doc, "close", kline.Close, encoding);
+    appendPrice(doc, "volume", kline.Volume, encoding);
+    doc.append(
+        kvp("tradenum", kline.TradeNum),
+        kvp("isfinal", kline.IsFinal));
+    appendPrice(doc, "quotevolume", kline.QuoteVolume, encoding);
+    appendPrice(doc, "activebuyvolume", kline.ActiveBuyVolume, encoding);
+    appendPrice(doc, "activebuyquotevolume", kline.ActiveBuyQuoteVolume, encoding);
+    doc.append(kvp("ignoreparam", kline.IgnoreParam));
+}
+
+static const char* klineLayoutName(KlineLayout layout) {
+    switch (layout) {
+    case KlineLayout::TimeSeries: return "time-series";
+    case KlineLayout::Buckets: return "buckets";
+    default: return "documents";
+    }
+}
+
+// what an existing collection holds: time-series by its type, buckets by the starttime column of a document.
+// nullopt if the collection does not exist or is a regular collection without documents yet.
+static std::optional<KlineLayout> storedKlineLayout(mongocxx::database& db, const std::string& colName) {
+    bool exists = false;
+    auto infos = db.list_collections(make_document(kvp("name", colName)));
+    for (auto&& info : infos) {
+        exists = true;
+        auto type = info["type"];
+        if (type && type.get_string().value == "timeseries") return KlineLayout::TimeSeries;
+    }
+    if (!exists) return std::nullopt;
+
+    mongocxx::options::find opts;
+    opts.projection(make_document(kvp("starttime", 1)));
+    auto sample = db[colName].find_one({}, opts);
+    if (!sample) return std::nullopt;
+    auto starttime = sample->view()["starttime"];
+    return starttime && starttime.type() == bsoncxx::type::k_array ? KlineLayout::Buckets : KlineLayout::Documents;
+}
+
+// Bucket documents: {_id: bucket start, symbol, interval, span, count, last (latest starttime), rev, and one
+// array per kline field}. Element i of every array belongs to the i-th kline, arrays are sorted by starttime.
+static void appendBucketColumns(bsoncxx::builder::basic::document& doc, const std::vector<const KlineResponseWs*>& bars,
+    KlinePriceEncoding encoding, bool asPushEach)
+{
+    auto column = [&](const char* key, auto&& value) {
+        bsoncxx::builder::basic::array arr;
+        for (const KlineResponseWs* k : bars) value(arr, *k);
+        if (asPushEach) {
+            doc.append(kvp(key, make_document(kvp("$each", arr.extract()))));
+        } else {
+            doc.append(kvp(key, arr.extract()));
+        }
+    };
+    auto integer = [&](const char* key, int64_t KlineResponseWs::* field) {
+        column(key, [&](bsoncxx::builder::basic::array& arr, const KlineResponseWs& k) { arr.append(k.*field); });
+    };
+    auto price = [&](const char* key, Decimal KlineResponseWs::* field) {
+        column(key, [&](bsoncxx::builder::basic::array& arr, const KlineResponseWs& k) {
+            withPriceValue(k.*field, encoding, [&](auto&& v) { arr.append(std::forward<decltype(v)>(v)); });
+            });
+    };
+
+    integer("starttime", &KlineResponseWs::StartTime);
+    integer("endtime", &KlineResponseWs::EndTime);
+    integer("eventtime", &KlineResponseWs::EventTime);
+    integer("firsttradeid", &KlineResponseWs::FirstTradeID);
+    integer("lasttradeid", &KlineResponseWs::LastTradeID);
+    integer("tradenum", &KlineResponseWs::TradeNum);
+    price("open", &KlineResponseWs::Open);
+    price("high", &KlineResponseWs::High);
+    price("low", &KlineResponseWs::Low);
+    price("close", &KlineResponseWs::Close);
+    price("volume", &KlineResponseWs::Volume);
+    price("quotevolume", &KlineResponseWs::QuoteVolume);
+    price("activebuyvolume", &KlineResponseWs::ActiveBuyVolume);
+    price("activebuyquotevolume", &KlineResponseWs::ActiveBuyQuoteVolume);
+}
+
+static std::vector<bsoncxx::array::element> bucketColumn(const bsoncxx::document::view& doc, const char* key) {
+    std::vector<bsoncxx::array::element> column;
+    auto e = doc[key];
+    if (e && e.type() == bsoncxx::type::k_array) {
+        for (auto&& v : e.get_array().value) column.push_back(v);
+    }
+    return column;
+}
+
+static int64_t intValue(const bsoncxx::document::element& e) {
+    if (e.type() == bsoncxx::type::k_int64) return e.get_int64().value;
+    if (e.type() == bsoncxx::type::k_int32) return e.get_int32().value;
+    return 0;
+}
+
+static int64_t bucketInt(const std::vector<bsoncxx::array::element>& column, size_t i) {
+    return i < column.size() ? intValue(column[i]) : 0;
+}
+
+// the columns of a bucket document, indexed like its starttime array
+struct BucketColumns {
+    std::vector<bsoncxx::array::element> starttime, endtime, eventtime, firsttradeid, lasttradeid, tradenum;
+    std::vector<bsoncxx::array::element> open, high, low, close, volume, quotevolume, activebuyvolume, activebuyquotevolume;
+
+    explicit BucketColumns(const bsoncxx::document::view& doc) :
+        starttime(bucketColumn(doc, "starttime")), endtime(bucketColumn(doc, "endtime")),
+        eventtime(bucketColumn(doc, "eventtime")), firsttradeid(bucketColumn(doc, "firsttradeid")),
+        lasttradeid(bucketColumn(doc, "lasttradeid")), tradenum(bucketColumn(doc, "tradenum")),
+        open(bucketColumn(doc, "open")), high(bucketColumn(doc, "high")), low(bucketColumn(doc, "low")),
+        close(bucketColumn(doc, "close")), volume(bucketColumn(doc, "volume")), quotevolume(bucketColumn(doc, "quotevolume")),
+        activebuyvolume(bucketColumn(doc, "activebuyvolume")), activebuyquotevolume(bucketColumn(doc, "activebuyquotevolume"))
+    {
+    }
+
+    static Decimal decimal(const std::vector<bsoncxx::array::element>& column, size_t i) {
+        return i < column.size() ? priceToDecimal(column[i]) : Decimal{};
+    }
+    static double number(const std::vector<bsoncxx::array::element>& column, size_t i) {
+        return i < column.size() ? priceToDouble(column[i]) : 0.0;
+    }
+};
+
+// full klines of a bucket, for merging new ones into it
+static void unpackBucketBars(const bsoncxx::document::view& doc, std::map<int64_t, KlineResponseWs>& bars) {
+    BucketColumns c(doc);
+    auto symbol = doc["symbol"].get_string().value;
+    auto interval = doc["interval"].get_string().value;
+    for (size_t i = 0; i < c.starttime.size(); ++i) {
+        KlineResponseWs k{};
+        setFixedString(k.EventType, "kline");
+        setFixedString(k.Symbol, std::string_view(symbol.data(), symbol.size()));
+        setFixedString(k.Interval, std::string_view(interval.data(), interval.size()));
+        k.StartTime = bucketInt(c.starttime, i);
+        k.EndTime = bucketInt(c.endtime, i);
+        k.EventTime = bucketInt(c.eventtime, i);
+        k.FirstTradeID = bucketInt(c.firsttradeid, i);
+        k.LastTradeID = bucketInt(c.lasttradeid, i);
+        k.TradeNum = bucketInt(c.tradenum, i);
+        k.Open = BucketColumns::decimal(c.open, i);
+        k.High = BucketColumns::decimal(c.high, i);
+        k.Low = BucketColumns::decimal(c.low, i);
+        k.Close = BucketColumns::decimal(c.close, i);
+        k.Volume = BucketColumns::decimal(c.volume, i);
+        k.QuoteVolume = BucketColumns::decimal(c.quotevolume, i);
+        k.ActiveBuyVolume = BucketColumns::decimal(c.activebuyvolume, i);
+        k.ActiveBuyQuoteVolume = BucketColumns::decimal(c.activebuyquotevolume, i);
+        k.IsFinal = true;
+        bars[k.StartTime] = k;
+    }
+}
+
+// the klines of a bucket in [startTime, endTime], ascending
+static void unpackBucket(const bsoncxx::document::view& doc, int64_t startTime, int64_t endTime, std::vector<Kline>& out) {
+    BucketColumns c(doc);
+    auto symbol = doc["symbol"].get_string().value;
+    auto interval = doc["interval"].get_string().value;
+    for (size_t i = 0; i < c.starttime.size(); ++i) {
+        int64_t start = bucketInt(c.starttime, i);
+        if (start < startTime || start > endTime) continue;
+        Kline k{};
+        setFixedString(k.Symbol, std::string_view(symbol.data(), symbol.size()));
+        setFixedString(k.Interval, std::string_view(interval.data(), interval.size()));
+        k.StartTime = start;
+        k.EndTime = bucketInt(c.endtime, i);
+        k.FirstTradeID = bucketInt(c.firsttradeid, i);
+        k.LastTradeID = bucketInt(c.lasttradeid, i);
+        k.TradeNum = bucketInt(c.tradenum, i);
+        k.Open = BucketColumns::number(c.open, i);
+        k.High = BucketColumns::number(c.high, i);
+        k.Low = BucketColumns::number(c.low, i);
+        k.Close = BucketColumns::number(c.close, i);
+        k.Volume = BucketColumns::number(c.volume, i);
+        k.QuoteVolume = BucketColumns::number(c.quotevolume, i);
+        k.ActiveBuyVolume = BucketColumns::number(c.activebuyvolume, i);
+        k.ActiveBuyQuoteVolume = BucketColumns::number(c.activebuyquotevolume, i);
+        k.IsFinal = true;
+        out.push_back(k);
+    }
+}
+
+static constexpr int BUCKET_MERGE_ATTEMPTS = 5;
+
+static bool isDuplicateKey(const mongocxx::operation_exception& e) {
+    return e.code().value() == 11000;
+}
+
+// read the bucket, merge the klines in, replace it if nobody changed it meanwhile (rev), retry otherwise
+static bool mergeKlineBucket(mongocxx::collection& col, int64_t bucketStart, int64_t span,
+    const std::map<int64_t, KlineResponseWs>& bars, KlinePriceEncoding encoding)
+{
+    auto id = make_document(kvp("_id", bsoncxx::types::b_int64{ bucketStart }));
+    for (int attempt = 0; attempt < BUCKET_MERGE_ATTEMPTS; ++attempt) {
+        auto existing = col.find_one(id.view());
+        std::map<int64_t, KlineResponseWs> merged;
+        int64_t rev = 0;
+        if (existing) {
+            unpackBucketBars(existing->view(), merged);
+            if (auto r = existing->view()["rev"]) rev = r.get_int64().value;
+        }
+        for (auto& [startTime, k] : bars) merged[startTime] = k;
+
+        std::vector<const KlineResponseWs*> ordered;
+        ordered.reserve(merged.size());
+        for (auto& [startTime, k] : merged) ordered.push_back(&k);
+        const KlineResponseWs& last = *ordered.back();
+
+        bsoncxx::builder::basic::document doc;
+        doc.append(
+            kvp("_id", bsoncxx::types::b_int64{ bucketStart }),
+            kvp("symbol", std::string(last.Symbol)),
+            kvp("interval", std::string(last.Interval)),
+            kvp("span", bsoncxx::types::b_int64{ span }),
+            kvp("count", bsoncxx::types::b_int64{ static_cast<int64_t>(ordered.size()) }),
+            kvp("last", bsoncxx::types::b_int64{ last.StartTime }),
+            kvp("rev", bsoncxx::types::b_int64{ rev + 1 }));
+        appendBucketColumns(doc, ordered, encoding, false);
+
+        if (existing) {
+            auto res = col.replace_one(
+                make_document(kvp("_id", bsoncxx::types::b_int64{ bucketStart }), kvp("rev", bsoncxx::types::b_int64{ rev })).view(),
+                doc.view());
+            if (!res || res->matched_count() == 1) return true;
+        } else {
+            try {
+                col.insert_one(doc.view());
+                return true;
+            } catch (const mongocxx::operation_exception& e) {
+                if (!isDuplicateKey(e)) throw;
+            }
+        }
+        // another writer got there first, merge into its version
+    }
+    std::cerr << "mergeKlineBucket " << col.name() << " bucket " << bucketStart << " kept changing, giving up after "
+        << BUCKET_MERGE_ATTEMPTS << " attempts" << std::endl;
+    return false;
+}
+
+// buckets are sized by the granularity, pick the one matching the kline spacing
+static const char* timeSeriesGranularity(const std::string& interval) {
+    const KlineInterval* itv = intervalById(intervalId(interval));
+    if (!itv || itv->ms < 60LL * 1000) return "seconds";
+    if (itv->ms < 60LL * 60 * 1000) return "minutes";
+    return "hours";
+}
+
+bool MongoManager::EnsureKlineCollection(std::string dbName, std::string colName, const std::string& interval) {
+    try {
+        auto client = this->mongoPool.acquire();
+        auto db = (*client)[dbName];
+
+        auto stored = storedKlineLayout(db, colName);
+        KlineLayout layout = stored ? *stored : storage_.layout;
+        if (stored && *stored != storage_.layout) {
+            std::cout << "EnsureKlineCollection " << dbName << "." << colName << " already holds "
+                << klineLayoutName(*stored) << ", keeping it" << std::endl;
+        } else if (!stored && layout == KlineLayout::TimeSeries) {
+            if (db.has_collection(colName)) {
+                // an empty regular collection can't become a time-series one, it has to be dropped first
+                std::cout << "EnsureKlineCollection " << dbName << "." << colName << " exists as a regular collection, keeping documents" << std::endl;
+                layout = KlineLayout::Documents;
+            } else {
+                db.create_collection(colName, make_document(kvp("timeseries", make_document(
+                    kvp("timeField", "time"),
+                    kvp("metaField", "meta"),
+                    kvp("granularity", timeSeriesGranularity(interval))))));
+            }
+        }
+
+        auto col = db[colName];
+        if (layout == KlineLayout::Documents) {
+            // fails if the collection already holds duplicated start times, they have to be removed by hand first
+            mongocxx::options::index opts;
+            opts.unique(true);
+            opts.name("starttime_unique");
+            col.create_index(make_document(kvp("starttime", 1)), opts);
+        } else if (layout == KlineLayout::TimeSeries) {
+            // time-series collections can't have unique indexes, InsertNewKlines keeps start times unique
+            col.create_index(make_document(kvp("starttime", 1)));
+        }
+        // bucket collections are keyed by their _id, the bucket start
+
+        std::lock_guard<std::mutex> lock(layoutsMutex_);
+        layouts_[dbName + "." + colName] = layout;
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "EnsureKlineCollection " << dbName << "." << colName << " error exception: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+bool MongoManager::EnsureBackfillChunkIndex(std::string dbName) {
+    try {
+        auto client = this->mongoPool.acquire();
+        auto col = (*client)[dbName][BACKFILL_CHUNKS_COLLECTION];
+        mongocxx::options::index opts;
+        opts.unique(true);
+        col.create_index(make_document(kvp("series", 1), kvp("chunkms", 1), kvp("start", 1)), opts);
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "EnsureBackfillChunkIndex error exception: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+int64_t MongoManager::MigrateKlinePrices(std::string dbName, std::string colName, KlinePriceEncoding encoding, size_t batchSize) {
+    try {
+        auto client = this->mongoPool.acquire();
+        auto db = (*client)[dbName];
+
+        auto layout = storedKlineLayout(db, colName);
+        if (!layout) {
+            std::cout << "MigrateKlinePrices " << dbName << "." << colName << " holds no klines, skipped" << std::endl;
+            return 0;
+        }
+        if (*layout != KlineLayout::Documents) {
+            // measurements of time-series collections can't be updated in place on every server version,
+            // buckets take the configured encoding whenever they are rewritten
+            std::cerr << "MigrateKlinePrices " << dbName << "." << colName << " holds " << klineLayoutName(*layout) << ", skipped" << std::endl;
+            return -1;
+        }
+        auto col = db[colName];
+
+        const char* bsonType = encoding == KlinePriceEncoding::Double ? "double"
+            : encoding == KlinePriceEncoding::Decimal128 ? "decimal" : "string";
+        // all price fields of a document are written together, open tells the encoding of the whole document
+        auto filter = make_document(kvp("open", make_document(
+            kvp("$exists", true),
+            kvp("$not", make_document(kvp("$type", bsonType))))));
+        bsoncxx::builder::basic::document projection;
+        for (const char* field : KLINE_PRICE_FIELDS) {
+            projection.append(kvp(field, 1));
+        }
+        mongocxx::options::find opts;
+        opts.projection(projection.view());
+        opts.batch_size(static_cast<int32_t>(std::max<size_t>(1, batchSize)));
+
+        int64_t migrated = 0;
+        mongocxx::options::bulk_write bw_opts;
+        bw_opts.ordered(false);
+        auto bulk = col.create_bulk_write(bw_opts);
+        size_t queued = 0;
+        auto flush = [&] {
+            if (queued == 0) return;
+            bulk.execute();
+            migrated += static_cast<int64_t>(queued);
+            bulk = col.create_bulk_write(bw_opts);
+            queued = 0;
+            std::cout << "MigrateKlinePrices " << dbName << "." << colName << ": " << migrated << " documents rewritten" << std::endl;
+        };
+
+        auto cursor = col.find(filter.view(), opts);
+        for (auto&& doc : cursor) {
+            bsoncxx::builder::basic::document fields;
+            for (const char* field : KLINE_PRICE_FIELDS) {
+                if (auto e = doc[field]) appendPrice(fields, field, priceToDecimal(e), encoding);
+            }
+            auto idFilter = make_document(kvp("_id", doc["_id"].get_oid()));
+            auto update = make_document(kvp("$set", fields.view()));
+            mongocxx::model::update_one op{ idFilter.view(), update.view() };
+            bulk.append(op);
+            if (++queued >= batchSize) flush();
+        }
+        flush();
+        return migrated;
+    } catch (const std::exception& e) {
+        std::cerr << "MigrateKlinePrices " << dbName << "." << colName << " error exception: " << e.what() << std::endl;
+        return -1;
+    }
+}
+
+KlineLayout MongoManager::ResolveLayout(mongocxx::client& client, const std::string& dbName, const std::string& colName) {
+    std::string key = dbName + "." + colName;
+    {
+        std::lock_guard<std::mutex> lock(layoutsMutex_);
+        auto it = layouts_.find(key);
+        if (it != layouts_.end()) return it->second;
+    }
+
+    auto db = client[dbName];
+    auto stored = storedKlineLayout(db, colName);
+    if (!stored) {
+        // nothing stored yet: buckets need no setup, time-series collections are only created by EnsureKlineCollection
+        return storage_.layout == KlineLayout::Buckets ? KlineLayout::Buckets : KlineLayout::Documents;
+    }
+    std::lock_guard<std::mutex> lock(layoutsMutex_);
+    layouts_[key] = *stored;
+    return *stored;
+}
+
+bool MongoManager::FindWatermark(mongocxx::client& client, const std::string& dbName, const std::string& colName, SyncWatermark& wm) {
+    {
+        std::lock_guard<std::mutex> lock(watermarksMutex_);
+        auto db = watermarks_.find(dbName);
+        if (db != watermarks_.end()) {
+            auto it = db->second.find(colName);
+            if (it == db->second.end()) return false;
+            wm = it->second;
+            return true;
+        }
+    }
+
+    // first use of this database: the whole manifest in one query
+    std::unordered_map<std::string, SyncWatermark> loaded;
+    auto cursor = client[dbName][SYNC_MANIFEST_COLLECTION].find({});
+    for (auto&& doc : cursor) {
+        SyncWatermark entry;
+        entry.startTime = doc["starttime"].get_int64().value;
+        entry.endTime = doc["endtime"].get_int64().value;
+        loaded.emplace(std::string(doc["_id"].get_string().value), entry);
+    }
+    std::cout << "Loaded " << loaded.size() << " sync watermarks of " << dbName << std::endl;
+
+    std::lock_guard<std::mutex> lock(watermarksMutex_);
+    auto& db = watermarks_[dbName];
+    for (auto& [name, entry] : loaded) {
+        auto& current = db[name]; // a concurrent write may have advanced it meanwhile
+        if (entry.startTime > current.startTime) current = entry;
+    }
+    auto it = db.find(colName);
+    if (it == db.end()) return false;
+    wm = it->second;
+    return true;
+}
+
+void MongoManager::AdvanceWatermark(mongocxx::client& client, const std::string& dbName, const std::string& colName, SyncWatermark wm) {
+    {
+        std::lock_guard<std::mutex> lock(watermarksMutex_);
+        auto db = watermarks_.find(dbName);
+        if (db != watermarks_.end()) {
+            auto& current = db->second[colName];
+            if (wm.startTime <= current.startTime) return;
+            current = wm;
+        }
+    }
+
+    // $max keeps the manifest monotonic when writer threads race on the same collection
+    try {
+        mongocxx::options::update opts;
+        opts.upsert(true);
+        client[dbName][SYNC_MANIFEST_COLLECTION].update_one(
+            make_document(kvp("_id", colName)),
+            make_document(
+                kvp("$max", make_document(
+                    kvp("starttime", bsoncxx::types::b_int64{ wm.startTime }),
+                    kvp("endtime", bsoncxx::types::b_int64{ wm.endTime }))),
+                kvp("$set", make_document(kvp("updatedat", bsoncxx::types::b_date{ std::chrono::system_clock::now() })))),
+            opts);
+    } catch (const std::exception& e) {
+        // the cache is ahead, the manifest catches up with the next write of the collection
+        std::cerr << "AdvanceWatermark " << dbName << "." << colName << " error exception: " << e.what() << std::endl;
+    }
+}
+
 int64_t MongoManager::GetSynedFlag(std::string dbName, std::string colName) {
     auto client = this->mongoPool.acquire();
     auto col = (*client)[dbName.c_str()][colName.c_str()];
@@ -57,41 +606,26 @@ bool MongoManager::ParseKline(const bsoncxx::document::view& doc, Kline& k) {
     k.EndTime = doc["endtime"].get_int64().value;
 
     // symbol / interval
-    std::string sym = std::string(doc["symbol"].get_string().value);
-    std::string itv = std::string(doc["interval"].get_string().value);
-#ifdef _WIN32
-    strcpy_s(k.Symbol, sym.c_str());
-    strcpy_s(k.Interval, itv.c_str());
-#else
-    strcpy(k.Symbol, sym.c_str());
-    strcpy(k.Interval, itv.c_str());
-#endif
-
-    // to double lambda function
-    auto to_double = [&](const char* key) -> double {
-        try {
-            return std::stod(std::string(doc[key].get_string().value));
-        }
-        catch (...) {
-            return 0.0;
-        }
-        };
+    auto sym = doc["symbol"].get_string().value;
+    auto itv = doc["interval"].get_string().value;
+    setFixedString(k.Symbol, std::string_view(sym.data(), sym.size()));
+    setFixedString(k.Interval, std::string_view(itv.data(), itv.size()));
 
-    // OHLCV
-    k.Open = to_double("open");
-    k.High = to_double("high");
-    k.Low = to_double("low");
-    k.Close = to_double("close");
-    k.Volume = to_double("volume");
-    k.QuoteVolume = to_double("quotevolume");
+    // OHLCV, stored as strings, doubles or decimal128 depending on the price encoding the collection was written with
+    k.Open = priceToDouble(doc["open"]);
+    k.High = priceToDouble(doc["high"]);
+    k.Low = priceToDouble(doc["low"]);
+    k.Close = priceToDouble(doc["close"]);
+    k.Volume = priceToDouble(doc["volume"]);
+    k.QuoteVolume = priceToDouble(doc["quotevolume"]);
 
     // trade info
     k.TradeNum = doc["tradenum"].get_int64().value;
     k.IsFinal = doc["isfinal"].get_bool().value;
 
     // optional fields
-    if (auto v = doc["activebuyvolume"]) { k.ActiveBuyVolume = std::stod(std::string(v.get_string().value)); }
-    if (auto v = doc["activebuyquotevolume"]) { k.ActiveBuyQuoteVolume = std::stod(std::string(v.get_string().value)); }
+    if (auto v = doc["activebuyvolume"]) { k.ActiveBuyVolume = priceToDouble(v); }
+    if (auto v = doc["activebuyquotevolume"]) { k.ActiveBuyQuoteVolume = priceToDouble(v); }
 
     return true;
 }
@@ -103,9 +637,15 @@ void MongoManager::GetKline(int64_t startTime, int64_t endTime, int limit, int s
     auto client = this->mongoPool.acquire();
     auto col = (*client)[dbName.c_str()][colName.c_str()];
 
+    if (ResolveLayout(*client, dbName, colName) == KlineLayout::Buckets) {
+        ReadKlineBuckets(col, startTime, endTime, limit > 0 ? static_cast<size_t>(limit) : 0, sortOrder, targetKlineList);
+        return;
+    }
+
     mongocxx::options::find opts;
     opts.sort(make_document(kvp("starttime", sortOrder)));
     opts.limit(limit);
+    if (limit > 0) targetKlineList.reserve(targetKlineList.size() + limit);
 
     auto cursor_filtered = 
         col.find( 
@@ -124,27 +664,63 @@ void MongoManager::GetKline(int64_t startTime, int64_t endTime, int limit, int s
 }
 
 void MongoManager::GetLatestSyncedKlines(int64_t endTime, int limit, std::string dbName, std::string colName, std::vector<Kline>& fetchedDataPerCol) {    
+    KlineColumns cached;
+    cached.fields = KLINE_FIELDS_ALL;
+    if (cache_ && limit > 0 && cache_->latest(colName, static_cast<size_t>(limit), endTime != 0 ? endTime : INT64_MAX, cached)) {
+        // SYMBOL_INTERVAL_Binance
+        auto first = colName.find('_');
+        auto second = colName.find('_', first + 1);
+        std::string_view symbol = std::string_view(colName).substr(0, first);
+        std::string_view interval = first == std::string::npos ? std::string_view() : std::string_view(colName).substr(first + 1, second - first - 1);
+
+        fetchedDataPerCol.reserve(fetchedDataPerCol.size() + cached.size());
+        for (size_t i = 0; i < cached.size(); ++i) {
+            Kline k{};
+            setFixedString(k.Symbol, symbol);
+            setFixedString(k.Interval, interval);
+            k.StartTime = cached.startTime[i];
+            k.EndTime = cached.endTime[i];
+            k.Open = cached.open[i];
+            k.High = cached.high[i];
+            k.Low = cached.low[i];
+            k.Close = cached.close[i];
+            k.Volume = cached.volume[i];
+            k.QuoteVolume = cached.quoteVolume[i];
+            k.TradeNum = cached.tradeNum[i];
+            k.ActiveBuyVolume = cached.activeBuyVolume[i];
+            k.ActiveBuyQuoteVolume = cached.activeBuyQuoteVolume[i];
+            k.IsFinal = true;
+            fetchedDataPerCol.push_back(k);
+        }
+        return;
+    }
+
     auto client = this->mongoPool.acquire();
     auto db = (*client)[dbName];
     auto col = db[colName];
 
-    mongocxx::options::find opts;
-    opts.sort(make_document(kvp("starttime", -1)));
-    opts.limit(limit);
+    if (ResolveLayout(*client, dbName, colName) == KlineLayout::Buckets) {
+        ReadKlineBuckets(col, 0, endTime != 0 ? endTime : INT64_MAX, limit > 0 ? static_cast<size_t>(limit) : 0, -1, fetchedDataPerCol);
+    } else {
+        mongocxx::options::find opts;
+        opts.sort(make_document(kvp("starttime", -1)));
+        opts.limit(limit);
+        if (limit > 0) fetchedDataPerCol.reserve(fetchedDataPerCol.size() + limit);
 
-    bsoncxx::builder::basic::document filter;
-    if (endTime != 0) {
-        filter.append(kvp("starttime", make_document(kvp("$lte", bsoncxx::types::b_int64{ endTime }))));
-    }
-    auto cursor_filtered = col.find(filter.view(), opts);
+        bsoncxx::builder::basic::document filter;
+        if (endTime != 0) {
+            filter.append(kvp("starttime", make_document(kvp("$lte", bsoncxx::types::b_int64{ endTime }))));
+        }
+        auto cursor_filtered = col.find(filter.view(), opts);
 
-    for (auto&& doc : cursor_filtered) {
-        // std::cout << "GetLatestSyncedKlines, doc: " << bsoncxx::to_json(doc) << std::endl;
-        Kline klineInst;
-        auto existed = this->ParseKline(doc, klineInst);
-        if (existed) {
-            fetchedDataPerCol.push_back(klineInst);
-        } 
+        for (auto&& doc : cursor_filtered) {
+            // std::cout << "GetLatestSyncedKlines, doc: " << bsoncxx::to_json(doc) << std::endl;
+            Kline klineInst;
+            auto existed = this->ParseKline(doc, klineInst);
+            if (existed) {
+                fetchedDataPerCol.push_back(klineInst);
+            }
+        }
     }
     std::reverse(fetchedDataPerCol.begin(), fetchedDataPerCol.end());
 
@@ -153,13 +729,196 @@ void MongoManager::GetLatestSyncedKlines(int64_t endTime, int limit, std::string
     std::cout << ss.str();
 }
 
+// Fills the columns of a range read. Forward reads write from the front and grow the columns by doubling when
+// there's no limit; latest reads get the klines newest first and write them backward from the end of the limit,
+// so the columns come out ascending without a reverse. finish() trims what was sized but not filled.
+namespace {
+class KlineColumnsFill {
+public:
+    KlineColumnsFill(KlineColumns& out, const KlineRangeQuery& query, size_t growBy) :
+        out_(out), backward_(query.latest && query.limit), limit_(query.limit), growBy_(std::max<size_t>(1, growBy))
+    {
+        out_.clear();
+        if (limit_) out_.resize(limit_);
+        pos_ = backward_ ? limit_ : 0;
+    }
+
+    size_t count() const { return count_; }
+    size_t remaining() const { return limit_ ? limit_ - count_ : SIZE_MAX; }
+
+    // index of the first of n klines to write, in ascending order
+    size_t take(size_t n) {
+        count_ += n;
+        if (backward_) return pos_ -= n;
+        if (pos_ + n > out_.size()) out_.resize(std::max(pos_ + n, out_.size() + std::max(out_.size(), growBy_)));
+        size_t first = pos_;
+        pos_ += n;
+        return first;
+    }
+
+    void finish() {
+        if (backward_) out_.eraseFront(pos_);
+        else out_.resize(pos_);
+    }
+
+    void set(KlineField f, size_t i, const bsoncxx::document::element& e) {
+        if (auto* c = out_.intColumn(f)) (*c)[i] = intValue(e);
+        else (*out_.numberColumn(f))[i] = priceToDouble(e);
+    }
+
+private:
+    KlineColumns& out_;
+    bool backward_;
+    size_t limit_;
+    size_t growBy_;
+    size_t pos_ = 0;
+    size_t count_ = 0;
+};
+} // namespace
+
+int64_t MongoManager::ReadKlineColumns(std::string dbName, std::string colName, const KlineRangeQuery& query, KlineColumns& out) {
+    try {
+        auto client = this->mongoPool.acquire();
+        auto col = (*client)[dbName][colName];
+        int32_t batchSize = query.batchSize > 0 ? query.batchSize : std::max<int32_t>(1, storage_.readBatchSize);
+
+        if (ResolveLayout(*client, dbName, colName) == KlineLayout::Buckets) {
+            return ReadKlineBucketColumns(col, query, batchSize, out);
+        }
+
+        KlineColumnsFill fill(out, query, static_cast<size_t>(batchSize));
+
+        bsoncxx::builder::basic::document projection;
+        projection.append(kvp("_id", 0));
+        for (uint32_t i = 0; i < static_cast<uint32_t>(KlineField::Count); ++i) {
+            if (out.has(static_cast<KlineField>(i))) projection.append(kvp(klineFieldName(static_cast<KlineField>(i)), 1));
+        }
+
+        mongocxx::options::find opts;
+        opts.projection(projection.extract());
+        opts.sort(make_document(kvp("starttime", query.latest && query.limit ? -1 : 1)));
+        if (query.limit) {
+            opts.limit(static_cast<int64_t>(query.limit));
+            batchSize = static_cast<int32_t>(std::min<size_t>(static_cast<size_t>(batchSize), query.limit));
+        }
+        opts.batch_size(batchSize);
+
+        auto cursor = col.find(make_document(kvp("starttime", make_document(
+            kvp("$gte", bsoncxx::types::b_int64{ query.startTime }),
+            kvp("$lte", bsoncxx::types::b_int64{ query.endTime })))), opts);
+
+        for (auto&& doc : cursor) {
+            if (!fill.remaining()) break;
+            size_t i = fill.take(1);
+            // one pass over the projected fields instead of a lookup per field
+            for (auto&& e : doc) {
+                KlineField f = klineFieldOf(std::string_view(e.key().data(), e.key().size()));
+                if (f != KlineField::Count && out.has(f)) fill.set(f, i, e);
+            }
+        }
+        fill.finish();
+        return static_cast<int64_t>(fill.count());
+    } catch (const std::exception& e) {
+        std::cerr << "ReadKlineColumns " << dbName << "." << colName << " error exception: " << e.what() << std::endl;
+        out.clear();
+        return -1;
+    }
+}
+
+int64_t MongoManager::ReadKlineBucketColumns(mongocxx::collection& col, const KlineRangeQuery& query, int32_t batchSize, KlineColumns& out) {
+    int64_t bucketBars = std::max<int64_t>(1, storage_.bucketBars);
+    KlineColumnsFill fill(out, query, static_cast<size_t>(bucketBars));
+
+    // the bucket holding startTime is the last one starting at or before it
+    int64_t lower = query.startTime;
+    mongocxx::options::find firstOpts;
+    firstOpts.sort(make_document(kvp("_id", -1)));
+    firstOpts.projection(make_document(kvp("_id", 1)));
+    auto first = col.find_one(make_document(kvp("_id", make_document(kvp("$lte", bsoncxx::types::b_int64{ query.startTime })))), firstOpts);
+    if (first) lower = first->view()["_id"].get_int64().value;
+
+    bsoncxx::builder::basic::document projection;
+    for (uint32_t i = 0; i < static_cast<uint32_t>(KlineField::Count); ++i) {
+        if (out.has(static_cast<KlineField>(i))) projection.append(kvp(klineFieldName(static_cast<KlineField>(i)), 1));
+    }
+
+    mongocxx::options::find opts;
+    opts.projection(projection.extract());
+    bool newestFirst = query.latest && query.limit;
+    opts.sort(make_document(kvp("_id", newestFirst ? -1 : 1)));
+    size_t barsPerBatch = query.limit ? std::min<size_t>(static_cast<size_t>(batchSize), query.limit) : static_cast<size_t>(batchSize);
+    opts.batch_size(static_cast<int32_t>(barsPerBatch / static_cast<size_t>(bucketBars) + 1));
+
+    auto cursor = col.find(make_document(kvp("_id", make_document(
+        kvp("$gte", bsoncxx::types::b_int64{ lower }),
+        kvp("$lte", bsoncxx::types::b_int64{ query.endTime })))), opts);
+
+    for (auto&& doc : cursor) {
+        if (!fill.remaining()) break;
+
+        // the starttime column is sorted, the klines of the range are the elements [from, to)
+        size_t from = 0, to = 0, n = 0;
+        auto starttime = doc["starttime"];
+        if (!starttime || starttime.type() != bsoncxx::type::k_array) continue;
+        for (auto&& v : starttime.get_array().value) {
+            int64_t start = intValue(v);
+            if (start < query.startTime) from = n + 1;
+            if (start <= query.endTime) to = n + 1;
+            ++n;
+        }
+        if (to <= from) continue;
+
+        // forward reads take the first klines of the bucket, latest reads (buckets newest first) the last ones
+        size_t count = std::min(to - from, fill.remaining());
+        if (newestFirst) from = to - count;
+        else to = from + count;
+        size_t base = fill.take(count);
+
+        for (uint32_t f = 0; f < static_cast<uint32_t>(KlineField::Count); ++f) {
+            auto field = static_cast<KlineField>(f);
+            if (!out.has(field)) continue;
+            auto column = doc[klineFieldName(field)];
+            if (!column || column.type() != bsoncxx::type::k_array) continue;
+            size_t j = 0;
+            for (auto&& v : column.get_array().value) {
+                if (j >= to) break;
+                if (j >= from) fill.set(field, base + j - from, v);
+                ++j;
+            }
+        }
+    }
+    fill.finish();
+    return static_cast<int64_t>(fill.count());
+}
+
 void MongoManager::GetLatestSyncedTime(std::string dbName, std::string colName, int64_t& latestSyncedStartTime, int64_t& latestSyncedEndTime) {
     try{
         // locate the coll
         auto client = this->mongoPool.acquire();
         auto db = (*client)[dbName];
         auto col = db[colName];
-        
+
+        SyncWatermark wm;
+        if (FindWatermark(*client, dbName, colName, wm)) {
+            latestSyncedStartTime = wm.startTime;
+            latestSyncedEndTime = wm.endTime;
+            std::cout << "GetLatestSyncedTime " << colName << " from the sync manifest, time range: ["
+                << latestSyncedStartTime << ", " << latestSyncedEndTime << "]" << std::endl;
+            return;
+        }
+
+        // not in the manifest yet (new collection, or written before the manifest existed): ask the collection
+        if (ResolveLayout(*client, dbName, colName) == KlineLayout::Buckets) {
+            std::vector<Kline> latest;
+            ReadKlineBuckets(col, 0, INT64_MAX, 1, -1, latest);
+            latestSyncedStartTime = latest.empty() ? 0 : latest.front().StartTime;
+            latestSyncedEndTime = latest.empty() ? 0 : latest.front().EndTime;
+            if (!latest.empty()) AdvanceWatermark(*client, dbName, colName, { latestSyncedStartTime, latestSyncedEndTime });
+            std::cout << "GetLatestSyncedTime " << colName << " from the latest bucket, time range: ["
+                << latestSyncedStartTime << ", " << latestSyncedEndTime << "]" << std::endl;
+            return;
+        }
+
         // Check if a document with the same starttime exists
         mongocxx::options::find opts;
         opts.sort(make_document(kvp("starttime", -1)));
@@ -171,6 +930,7 @@ void MongoManager::GetLatestSyncedTime(std::string dbName, std::string colName,
             auto latest_kline = *cursor_filtered.begin();
             latestSyncedStartTime = latest_kline["starttime"].get_int64();
             latestSyncedEndTime = latest_kline["endtime"].get_int64();
+            AdvanceWatermark(*client, dbName, colName, { latestSyncedStartTime, latestSyncedEndTime });
             std::cout << "GetLatestSyncedTime " << colName << " found latest kline, time range: [" 
                 << latestSyncedStartTime << ", " << latestSyncedEndTime << "]" << std::endl;
             // auto sync_start_time = latestSyncedEndTime + 1;
@@ -190,6 +950,48 @@ void MongoManager::GetLatestSyncedTime(std::string dbName, std::string colName,
     }
 }
 
+// Backfill completion map, one document per finished chunk of a series
+std::vector<int64_t> MongoManager::GetCompletedBackfillChunks(std::string dbName, std::string series, int64_t chunkMs) {
+    std::vector<int64_t> starts;
+    try {
+        auto client = this->mongoPool.acquire();
+        auto col = (*client)[dbName][BACKFILL_CHUNKS_COLLECTION];
+
+        // chunks of another size are ignored, changing chunk_pages just starts a new map
+        mongocxx::options::find opts;
+        opts.projection(make_document(kvp("start", 1)));
+        auto cursor = col.find(make_document(kvp("series", series), kvp("chunkms", bsoncxx::types::b_int64{ chunkMs })), opts);
+        for (auto&& doc : cursor) {
+            starts.push_back(doc["start"].get_int64().value);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "GetCompletedBackfillChunks error exception: " << e.what() << std::endl;
+    }
+    return starts;
+}
+
+bool MongoManager::MarkBackfillChunkCompleted(std::string dbName, std::string series, int64_t chunkMs, int64_t start, int64_t end) {
+    try {
+        auto client = this->mongoPool.acquire();
+        auto col = (*client)[dbName][BACKFILL_CHUNKS_COLLECTION];
+
+        auto filter = make_document(
+            kvp("series", series),
+            kvp("chunkms", bsoncxx::types::b_int64{ chunkMs }),
+            kvp("start", bsoncxx::types::b_int64{ start }));
+        auto update = make_document(kvp("$set", make_document(
+            kvp("end", bsoncxx::types::b_int64{ end }),
+            kvp("completedat", bsoncxx::types::b_date{ std::chrono::system_clock::now() }))));
+        mongocxx::options::update opts;
+        opts.upsert(true);
+        col.update_one(filter.view(), update.view(), opts);
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "MarkBackfillChunkCompleted error exception: " << e.what() << std::endl;
+        return false;
+    }
+}
+
 // Mongo Write Function Implementation
 void MongoManager::WriteClosedKlines(std::string dbName, std::vector<KlineResponseWs>& rawData) {
     try {
@@ -212,27 +1014,7 @@ void MongoManager::WriteClosedKlines(std::string dbName, std::vector<KlineRespon
 
             // Build the insert or update document
             bsoncxx::builder::basic::document doc_builder;
-            doc_builder.append(
-                kvp("eventtype", kline.EventType),
-                kvp("eventtime", kline.EventTime),
-                kvp("symbol", kline.Symbol),
-                kvp("starttime", kline.StartTime),
-                kvp("endtime", kline.EndTime),
-                kvp("interval", kline.Interval),
-                kvp("firsttradeid", kline.FirstTradeID),
-                kvp("lasttradeid", kline.LastTradeID),
-                kvp("open", kline.Open),
-                kvp("high", kline.High),
-                kvp("low", kline.Low),
-                kvp("close", kline.Close),
-                kvp("volume", kline.Volume),
-                kvp("tradenum", kline.TradeNum),
-                kvp("isfinal", kline.IsFinal),
-                kvp("quotevolume", kline.QuoteVolume),
-                kvp("activebuyvolume", kline.ActiveBuyVolume),
-                kvp("activebuyquotevolume", kline.ActiveBuyQuoteVolume),
-                kvp("ignoreparam", kline.IgnoreParam)
-            );
+            appendKlineFields(doc_builder, kline, storage_.priceEncoding);
 
             if (existing_doc) {
                 // Update the existing document
@@ -262,15 +1044,63 @@ void MongoManager::WriteClosedKlines(std::string dbName, std::vector<KlineRespon
     }
 }
 
-void MongoManager::BulkWriteClosedKlines(std::string dbName,
+bool MongoManager::BulkWriteClosedKlines(std::string dbName,
     std::string colName,
-    std::vector<KlineResponseWs>& rawData) 
+    std::vector<KlineResponseWs>& rawData,
+    bool skipSynced)
 {
-    if (rawData.empty()) return;
+    if (rawData.empty()) return true;
 
     try {
         auto client = mongoPool.acquire();
-        auto col = (*client)[dbName][colName];
+        return BulkWriteClosedKlines(*client, dbName, colName, rawData, skipSynced);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "BulkWriteClosedKlines acquire error: " << e.what() << '\n';
+        return false;
+    }
+}
+
+bool MongoManager::BulkWriteClosedKlines(mongocxx::client& client,
+    std::string dbName,
+    std::string colName,
+    std::vector<KlineResponseWs>& rawData,
+    bool skipSynced)
+{
+    if (rawData.empty()) return true;
+
+    try {
+        if (skipSynced) {
+            // closed klines never change: a gap fill or a replayed live batch needs no rewrite of what is stored
+            SyncWatermark wm;
+            if (FindWatermark(client, dbName, colName, wm)) {
+                size_t before = rawData.size();
+                rawData.erase(std::remove_if(rawData.begin(), rawData.end(),
+                    [&](const KlineResponseWs& k) { return k.StartTime <= wm.startTime; }), rawData.end());
+                if (rawData.size() != before) {
+                    std::cout << "[BulkUpsert] " << dbName << "." << colName << " skipped " << before - rawData.size()
+                        << " klines at or below the watermark " << wm.startTime << std::endl;
+                }
+                if (rawData.empty()) return true;
+            }
+        }
+
+        // the watermark only moves once the batch is stored
+        auto latest = std::max_element(rawData.begin(), rawData.end(),
+            [](const KlineResponseWs& a, const KlineResponseWs& b) { return a.StartTime < b.StartTime; });
+        SyncWatermark written{ latest->StartTime, latest->EndTime };
+
+        auto col = client[dbName][colName];
+        KlineLayout layout = ResolveLayout(client, dbName, colName);
+        if (layout != KlineLayout::Documents) {
+            bool ok = layout == KlineLayout::TimeSeries
+                ? InsertNewKlines(col, dbName, colName, rawData)
+                : WriteKlineBuckets(col, dbName, colName, rawData);
+            if (!ok) return false;
+            AdvanceWatermark(client, dbName, colName, written);
+            KlinesStored(colName, rawData);
+            return true;
+        }
 
         // unordered bulk faster, as it wont block on errors
         mongocxx::options::bulk_write bw_opts;
@@ -288,27 +1118,7 @@ void MongoManager::BulkWriteClosedKlines(std::string dbName,
 
             // entire kline document
             bsoncxx::builder::basic::document doc;
-            doc.append(
-                kvp("eventtype", kline.EventType),
-                kvp("eventtime", kline.EventTime),
-                kvp("symbol", kline.Symbol),
-                kvp("starttime", kline.StartTime),
-                kvp("endtime", kline.EndTime),
-                kvp("interval", kline.Interval),
-                kvp("firsttradeid", kline.FirstTradeID),
-                kvp("lasttradeid", kline.LastTradeID),
-                kvp("open", kline.Open),
-                kvp("high", kline.High),
-                kvp("low", kline.Low),
-                kvp("close", kline.Close),
-                kvp("volume", kline.Volume),
-                kvp("tradenum", kline.TradeNum),
-                kvp("isfinal", kline.IsFinal),
-                kvp("quotevolume", kline.QuoteVolume),
-                kvp("activebuyvolume", kline.ActiveBuyVolume),
-                kvp("activebuyquotevolume", kline.ActiveBuyQuoteVolume),
-                kvp("ignoreparam", kline.IgnoreParam)
-            );
+            appendKlineFields(doc, kline, storage_.priceEncoding);
 
             // $set + upsert
             auto update = bsoncxx::builder::basic::make_document(
@@ -327,8 +1137,12 @@ void MongoManager::BulkWriteClosedKlines(std::string dbName,
         }
 
         auto res = bulk.execute();
+        AdvanceWatermark(client, dbName, colName, written);
+        KlinesStored(colName, rawData);
         if (!res) {
+            // unacknowledged write concern, there is no result to report
             std::cerr << "Bulk upsert failed\n";
+            return true;
         }
 
         // statistics for the bulk operation
@@ -363,12 +1177,160 @@ void MongoManager::BulkWriteClosedKlines(std::string dbName,
             std::cout << "]\n";
         }
         // it's not necessary to return the inserted ids, but can be useful for debugging
+        return true;
     }
     catch (const std::exception& e) {
         std::cerr << "BulkWriteClosedKlines upsert error: " << e.what() << '\n';
+        return false;
     }
 }
 
+void MongoManager::KlinesStored(const std::string& colName, const std::vector<KlineResponseWs>& klines) {
+    if (archive_) archive_->append(colName, klines);
+    if (cache_) cache_->append(colName, klines);
+}
+
+bool MongoManager::WriteKlineBuckets(mongocxx::collection& col,
+    std::string dbName,
+    std::string colName,
+    std::vector<KlineResponseWs>& rawData)
+{
+    const KlineInterval* itv = intervalById(intervalId(rawData.front().Interval));
+    const int64_t span = (itv ? itv->ms : 60LL * 1000) * std::max<int64_t>(1, storage_.bucketBars);
+
+    // bucket start -> start time -> kline, the latest copy of a kline wins like with the upserts
+    std::map<int64_t, std::map<int64_t, KlineResponseWs>> buckets;
+    for (auto& k : rawData) {
+        buckets[k.StartTime - k.StartTime % span][k.StartTime] = k;
+    }
+
+    size_t appended = 0;
+    size_t merged = 0;
+    for (auto& [bucketStart, bars] : buckets) {
+        std::vector<const KlineResponseWs*> ordered;
+        ordered.reserve(bars.size());
+        for (auto& [startTime, k] : bars) ordered.push_back(&k);
+        const KlineResponseWs& last = *ordered.back();
+
+        // the common case, klines after the last one of the bucket or a new bucket: append in place
+        try {
+            bsoncxx::builder::basic::document push;
+            appendBucketColumns(push, ordered, storage_.priceEncoding, true);
+            auto filter = make_document(
+                kvp("_id", bsoncxx::types::b_int64{ bucketStart }),
+                kvp("last", make_document(kvp("$lt", bsoncxx::types::b_int64{ ordered.front()->StartTime }))));
+            auto update = make_document(
+                kvp("$push", push.view()),
+                kvp("$set", make_document(kvp("last", bsoncxx::types::b_int64{ last.StartTime }))),
+                kvp("$inc", make_document(
+                    kvp("count", bsoncxx::types::b_int64{ static_cast<int64_t>(ordered.size()) }),
+                    kvp("rev", bsoncxx::types::b_int64{ 1 }))),
+                kvp("$setOnInsert", make_document(
+                    kvp("symbol", std::string(last.Symbol)),
+                    kvp("interval", std::string(last.Interval)),
+                    kvp("span", bsoncxx::types::b_int64{ span }))));
+            mongocxx::options::update opts;
+            opts.upsert(true);
+            col.update_one(filter.view(), update.view(), opts);
+            ++appended;
+            continue;
+        } catch (const mongocxx::operation_exception& e) {
+            // the bucket exists and reaches past the first kline, so the upsert tried to insert it a second time
+            if (!isDuplicateKey(e)) throw;
+        }
+
+        if (!mergeKlineBucket(col, bucketStart, span, bars, storage_.priceEncoding)) return false;
+        ++merged;
+    }
+
+    std::cout << "[BucketWrite] " << dbName << "." << colName
+        << " total_ops=" << rawData.size()
+        << " appended_buckets=" << appended
+        << " merged_buckets=" << merged
+        << std::endl;
+    return true;
+}
+
+void MongoManager::ReadKlineBuckets(mongocxx::collection& col, int64_t startTime, int64_t endTime, size_t limit, int sortOrder, std::vector<Kline>& out) {
+    // the bucket holding startTime is the last one starting at or before it
+    int64_t lower = startTime;
+    mongocxx::options::find firstOpts;
+    firstOpts.sort(make_document(kvp("_id", -1)));
+    firstOpts.projection(make_document(kvp("_id", 1)));
+    auto first = col.find_one(make_document(kvp("_id", make_document(kvp("$lte", bsoncxx::types::b_int64{ startTime })))), firstOpts);
+    if (first) lower = first->view()["_id"].get_int64().value;
+
+    mongocxx::options::find opts;
+    opts.sort(make_document(kvp("_id", sortOrder < 0 ? -1 : 1)));
+    if (limit) {
+        // a bucket holds up to bucketBars klines, don't let the first batch pull a hundred of them for a few klines
+        opts.batch_size(static_cast<int32_t>(std::min<int64_t>(100, static_cast<int64_t>(limit) / std::max<int64_t>(1, storage_.bucketBars) + 2)));
+    }
+    auto cursor = col.find(make_document(kvp("_id", make_document(
+        kvp("$gte", bsoncxx::types::b_int64{ lower }),
+        kvp("$lte", bsoncxx::types::b_int64{ endTime })))), opts);
+
+    size_t added = 0;
+    std::vector<Kline> bars;
+    for (auto&& doc : cursor) {
+        bars.clear();
+        unpackBucket(doc, startTime, endTime, bars);
+        if (sortOrder < 0) std::reverse(bars.begin(), bars.end());
+        for (auto& k : bars) {
+            if (limit && added == limit) return;
+            out.push_back(k);
+            ++added;
+        }
+        if (limit && added == limit) return;
+    }
+}
+
+bool MongoManager::InsertNewKlines(mongocxx::collection& col,
+    std::string dbName,
+    std::string colName,
+    std::vector<KlineResponseWs>& rawData)
+{
+    auto [minIt, maxIt] = std::minmax_element(rawData.begin(), rawData.end(),
+        [](const KlineResponseWs& a, const KlineResponseWs& b) { return a.StartTime < b.StartTime; });
+
+    // closed klines never change, so a start time that is already stored needs no write
+    mongocxx::options::find opts;
+    opts.projection(make_document(kvp("starttime", 1), kvp("_id", 0)));
+    auto cursor = col.find(make_document(kvp("starttime", make_document(
+        kvp("$gte", bsoncxx::types::b_int64{ minIt->StartTime }),
+        kvp("$lte", bsoncxx::types::b_int64{ maxIt->StartTime })))), opts);
+    std::unordered_set<int64_t> stored;
+    for (auto&& doc : cursor) {
+        stored.insert(doc["starttime"].get_int64().value);
+    }
+
+    mongocxx::options::bulk_write bw_opts;
+    bw_opts.ordered(false);
+    auto bulk = col.create_bulk_write(bw_opts);
+    size_t inserts = 0;
+    for (auto& kline : rawData) {
+        if (!stored.insert(kline.StartTime).second) continue; // also drops duplicates within the batch
+
+        bsoncxx::builder::basic::document doc;
+        doc.append(
+            kvp("time", bsoncxx::types::b_date{ std::chrono::milliseconds{ kline.StartTime } }),
+            kvp("meta", make_document(kvp("symbol", std::string(kline.Symbol)), kvp("interval", std::string(kline.Interval)))));
+        appendKlineFields(doc, kline, storage_.priceEncoding);
+        bulk.append(mongocxx::model::insert_one{ doc.view() });
+        ++inserts;
+    }
+    if (inserts > 0) {
+        bulk.execute();
+    }
+
+    std::cout << "[BulkInsert] " << dbName << "." << colName
+        << " total_ops=" << rawData.size()
+        << " inserted=" << inserts
+        << " skipped=" << rawData.size() - inserts
+        << std::endl;
+    return true;
+}
+
 std::string MongoManager::SetSettlementItems(std::string dbName, std::string colName, SettlementItem& data) {
     // locate the coll
     auto client = this->mongoPool.acquire();
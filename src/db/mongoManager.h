@@ -1,6 +1,10 @@
 #ifndef MONGOMANAGER_H
 #define MONGOMANAGER_H
 
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 #include <vector>
 #include <bsoncxx/json.hpp>
 #include <bsoncxx/builder/basic/document.hpp>
@@ -14,15 +18,73 @@
 #include <mongocxx/exception/exception.hpp>
 
 #include "dtos/kline.h"
+#include "dtos/klineColumns.h"
 #include "dtos/settlementItem.h"
 
+class KlineArchiveWriter;
+class KlineCache;
+
 using bsoncxx::to_json;
 using bsoncxx::builder::basic::make_document;
 using bsoncxx::builder::basic::kvp;
 
+inline const char* const BACKFILL_CHUNKS_COLLECTION = "backfill_chunks";
+inline const char* const SYNC_MANIFEST_COLLECTION = "sync_manifest";
+
+// latest closed kline stored in a kline collection
+struct SyncWatermark {
+    int64_t startTime = 0;
+    int64_t endTime = 0;
+};
+
+// How kline collections are stored. Documents: one regular document per kline, unique on starttime.
+// TimeSeries: native time-series collections (timeField "time", metaField "meta" = {symbol, interval}),
+// smaller on disk and faster for range scans, but they can't have a unique index so writes skip the
+// start times already stored instead of upserting.
+// Buckets: one document per bucketBars klines of a series, _id = bucket start, one array per field
+// (starttime, endtime, open, ...), so the field names and the index entries are paid once per bucket.
+enum class KlineLayout { Documents, TimeSeries, Buckets };
+
+// "documents", "timeseries" or "buckets", anything else falls back to documents
+KlineLayout parseKlineLayout(const std::string& name);
+
+// BSON type of the price and volume fields. String keeps the exchange text, Double is the cheapest to read,
+// Decimal128 is numeric and exact. ParseKline reads all three, so collections can be migrated one at a time.
+enum class KlinePriceEncoding { String, Double, Decimal128 };
+
+// "string", "double" or "decimal128", anything else falls back to string
+KlinePriceEncoding parseKlinePriceEncoding(const std::string& name);
+
+struct KlineStorageOptions {
+    KlineLayout layout = KlineLayout::Documents;
+    KlinePriceEncoding priceEncoding = KlinePriceEncoding::String;
+    int64_t bucketBars = 1440; // klines per bucket document in the Buckets layout, a day of 1m klines
+    int32_t readBatchSize = 1000; // klines per cursor batch of the column reads
+};
+
+// range of a ReadKlineColumns call, start times in [startTime, endTime]
+struct KlineRangeQuery {
+    int64_t startTime = 0;
+    int64_t endTime = INT64_MAX;
+    size_t limit = 0;      // 0: the whole range
+    bool latest = false;   // with a limit, the last `limit` klines of the range instead of the first ones
+    int32_t batchSize = 0; // klines per cursor batch, 0: KlineStorageOptions::readBatchSize
+};
+
 class MongoManager {
 public:
-    MongoManager(std::string uriStr);
+    MongoManager(std::string uriStr, KlineStorageOptions storage = {});
+
+    // Startup provisioning, idempotent. Creates the collection in the configured layout if it doesn't exist yet
+    // and the starttime index the reads and the upserts rely on. An existing collection keeps its layout.
+    bool EnsureKlineCollection(std::string dbName, std::string colName, const std::string& interval);
+    // unique {series, chunkms, start} on the backfill completion map
+    bool EnsureBackfillChunkIndex(std::string dbName);
+
+    // Rewrites the price and volume fields of a regular kline collection to the given encoding in place, with
+    // unordered bulk updates of batchSize documents. Documents already in that encoding are not touched, so an
+    // interrupted migration just runs again. Returns the number of documents rewritten, -1 on error.
+    int64_t MigrateKlinePrices(std::string dbName, std::string colName, KlinePriceEncoding encoding, size_t batchSize);
     
     int64_t GetSynedFlag(std::string dbName, std::string colName);
     
@@ -32,11 +94,34 @@ public:
 
     void GetLatestSyncedKlines(int64_t endTime, int limit, std::string dbName, std::string colName, std::vector<Kline>& fetchedDataPerCol);
 
+    // Range read into columns, for backtests and indicator backfills. Only the fields selected by out.fields are
+    // requested from the server (a projection) and decoded, straight into the columns, which are sized up front
+    // from the limit and keep their capacity across calls. The klines come out ascending also for latest reads.
+    // Returns the number of klines read, -1 on error (out is left empty).
+    int64_t ReadKlineColumns(std::string dbName, std::string colName, const KlineRangeQuery& query, KlineColumns& out);
+
     void GetLatestSyncedTime(std::string dbName, std::string colName, int64_t& latestSyncedStartTime, int64_t& latestSyncedEndTime);
 
     void WriteClosedKlines(std::string dbName, std::vector<KlineResponseWs>& rawData);
 
-    void BulkWriteClosedKlines(std::string dbName, std::string colName, std::vector<KlineResponseWs>& rawData);
+    // false if the bulk write failed, the caller may retry: the upserts are idempotent.
+    // With skipSynced the klines at or below the collection watermark are removed from rawData first, they are
+    // stored already. The watermark is the newest kline stored, not the end of a gap-free run: writers that fill
+    // holes below it (history and gap-fill pages) pass false.
+    bool BulkWriteClosedKlines(std::string dbName, std::string colName, std::vector<KlineResponseWs>& rawData, bool skipSynced = true);
+    // same, on a client the caller already holds (writer threads keep one for their lifetime)
+    bool BulkWriteClosedKlines(mongocxx::client& client, std::string dbName, std::string colName, std::vector<KlineResponseWs>& rawData, bool skipSynced = true);
+
+    mongocxx::pool::entry AcquireClient() { return mongoPool.acquire(); }
+
+    // every batch BulkWriteClosedKlines stores is also appended to the archive, null to stop; set before the writes start
+    void SetKlineArchive(KlineArchiveWriter* archive) { archive_ = archive; }
+    // same for the cache of the latest klines, which then answers GetLatestSyncedKlines when it can
+    void SetKlineCache(KlineCache* cache) { cache_ = cache; }
+
+    // completion map of the partitioned history backfill: start times of the finished chunks of a series
+    std::vector<int64_t> GetCompletedBackfillChunks(std::string dbName, std::string series, int64_t chunkMs);
+    bool MarkBackfillChunkCompleted(std::string dbName, std::string series, int64_t chunkMs, int64_t start, int64_t end);
 
     std::string SetSettlementItems(std::string dbName, std::string colName,SettlementItem& data);
 
@@ -46,7 +131,32 @@ public:
     void WatchKlineUpdate(std::string dbName, std::string colName, std::vector<Kline>& PreviousTwoKlines);
 
 private:
+    // a batch is in Mongo, hands it to the archive and the cache
+    void KlinesStored(const std::string& colName, const std::vector<KlineResponseWs>& klines);
+    // starttimes already stored in a time-series collection are skipped, the rest is inserted
+    bool InsertNewKlines(mongocxx::collection& col, std::string dbName, std::string colName, std::vector<KlineResponseWs>& rawData);
+    // merges the klines into their bucket documents: a $push for klines after the last one of the bucket,
+    // a read-merge-replace guarded by the bucket revision otherwise
+    bool WriteKlineBuckets(mongocxx::collection& col, std::string dbName, std::string colName, std::vector<KlineResponseWs>& rawData);
+    // the klines in [startTime, endTime] of a bucket collection, at most limit (0: all), in sortOrder
+    void ReadKlineBuckets(mongocxx::collection& col, int64_t startTime, int64_t endTime, size_t limit, int sortOrder, std::vector<Kline>& out);
+    int64_t ReadKlineBucketColumns(mongocxx::collection& col, const KlineRangeQuery& query, int32_t batchSize, KlineColumns& out);
+    // layout of a kline collection, from the provisioning or detected from what it stores
+    KlineLayout ResolveLayout(mongocxx::client& client, const std::string& dbName, const std::string& colName);
+
+    // Watermarks, the latest closed kline per collection, cached here and persisted in SYNC_MANIFEST_COLLECTION by
+    // every successful write. The manifest of a database is loaded with one query the first time it is needed.
+    bool FindWatermark(mongocxx::client& client, const std::string& dbName, const std::string& colName, SyncWatermark& wm);
+    void AdvanceWatermark(mongocxx::client& client, const std::string& dbName, const std::string& colName, SyncWatermark wm);
+
     std::string uriStr;
+    KlineStorageOptions storage_;
+    KlineArchiveWriter* archive_ = nullptr;
+    KlineCache* cache_ = nullptr;
+    std::mutex layoutsMutex_;
+    std::unordered_map<std::string, KlineLayout> layouts_; // "db.collection" -> layout, for collections that hold klines or were provisioned
+    std::mutex watermarksMutex_;
+    std::unordered_map<std::string, std::unordered_map<std::string, SyncWatermark>> watermarks_; // db -> collection, only loaded dbs
     mongocxx::instance inst;
     //mongocxx::client mongoClient;
     mongocxx::pool mongoPool;
@@ -0,0 +1,64 @@
+#include "db/mongoWriterPool.h"
+
+#include <algorithm>
+#include <iostream>
+
+MongoWriterPool::MongoWriterPool(MongoManager& mongo, std::string dbName, size_t threads) :
+    mongo_(mongo), dbName_(std::move(dbName))
+{
+    threads = std::max<size_t>(1, threads);
+    for (size_t i = 0; i < threads; ++i) {
+        lanes_.push_back(std::make_unique<Lane>());
+    }
+    for (auto& lane : lanes_) {
+        Lane* l = lane.get();
+        l->thread = std::thread([this, l] { run(*l); });
+    }
+}
+
+MongoWriterPool::~MongoWriterPool() {
+    stopping_ = true;
+    for (auto& lane : lanes_) {
+        std::lock_guard<std::mutex> lock(lane->mutex);
+        lane->cv.notify_all();
+    }
+    for (auto& lane : lanes_) {
+        if (lane->thread.joinable()) lane->thread.join();
+    }
+}
+
+void MongoWriterPool::submit(std::string colName, std::vector<KlineResponseWs> klines, Completion done, Guard guard, bool skipSynced) {
+    // every writer of a collection, live flushes and history pages alike, lands on the same lane
+    Lane& lane = *lanes_[std::hash<std::string>{}(colName) % lanes_.size()];
+    std::lock_guard<std::mutex> lock(lane.mutex);
+    lane.writes.push_back(Write{ std::move(colName), std::move(klines), std::move(done), std::move(guard), skipSynced });
+    lane.cv.notify_one();
+}
+
+void MongoWriterPool::run(Lane& lane) {
+    // one client per writer thread, taken lazily so a pool that never writes holds none
+    mongocxx::pool::entry client;
+    while (true) {
+        Write write;
+        {
+            std::unique_lock<std::mutex> lock(lane.mutex);
+            lane.cv.wait(lock, [&] { return !lane.writes.empty() || stopping_; });
+            if (lane.writes.empty()) return; // stopping and nothing left
+            write = std::move(lane.writes.front());
+            lane.writes.pop_front();
+        }
+
+        bool ok = true;
+        if (!write.guard || write.guard()) {
+            try {
+                if (!client) client = mongo_.AcquireClient();
+                ok = mongo_.BulkWriteClosedKlines(*client, dbName_, write.colName, write.klines, write.skipSynced);
+            }
+            catch (const std::exception& e) {
+                std::cerr << "MongoWriterPool acquire error: " << e.what() << std::endl;
+                ok = false;
+            }
+        }
+        if (write.done) write.done(ok);
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "db/mongoManager.h"
+#include "dtos/kline.h"
+
+// Pool of writer threads for kline bulk upserts. Writes are sharded over the threads by collection name, so
+// writes of one collection are applied in submission order while different collections are written in parallel. Every thread holds its own client from the MongoManager pool for its whole life.
+class MongoWriterPool {
+public:
+    // called on the writer thread once the write is done, with the BulkWriteClosedKlines result; callers that
+    // need to wait for their writes count these down
+    using Completion = std::function<void(bool ok)>;
+    // called on the writer thread right before the write, false skips it (done still runs, with ok = true)
+    using Guard = std::function<bool()>;
+
+    MongoWriterPool(MongoManager& mongo, std::string dbName, size_t threads);
+    ~MongoWriterPool(); // writes whatever is queued, then joins
+
+    MongoWriterPool(const MongoWriterPool&) = delete;
+    MongoWriterPool& operator=(const MongoWriterPool&) = delete;
+
+    // skipSynced as in MongoManager::BulkWriteClosedKlines
+    void submit(std::string colName, std::vector<KlineResponseWs> klines, Completion done = {}, Guard guard = {}, bool skipSynced = true);
+
+    size_t threads() const { return lanes_.size(); }
+
+private:
+    struct Write {
+        std::string colName;
+        std::vector<KlineResponseWs> klines;
+        Completion done;
+        Guard guard;
+        bool skipSynced = true;
+    };
+
+    struct Lane {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<Write> writes;
+        std::thread thread;
+    };
+
+    void run(Lane& lane);
+
+    MongoManager& mongo_;
+    std::string dbName_;
+    std::vector<std::unique_ptr<Lane>> lanes_;
+    std::atomic<bool> stopping_{ false };
+};
@@ -0,0 +1,324 @@
+#include "db/redisProducer.h"
+#include "dtos/klineRecord.h"
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+
+namespace {
+struct ReplyFree { void operator()(redisReply* r) const { if (r) freeReplyObject(r); } };
+}
+
+redisContext* connectRedisWithAuth(const std::string& host, int port, const std::string& password, const char* tag) {
+    // 1) connect redis
+    redisContext* ctx = redisConnect(host.c_str(), port);
+    if (!ctx || ctx->err) {
+        std::cerr << tag << " connection error: "
+            << (ctx && ctx->errstr ? ctx->errstr : "can't allocate redis context")
+            << std::endl;
+        if (ctx) { redisFree(ctx); }
+        return nullptr;
+    }
+
+    // 2) auth
+    if (!password.empty()) {
+        std::unique_ptr<redisReply, ReplyFree> reply{ static_cast<redisReply*>(
+            redisCommand(ctx, "AUTH %s", password.c_str()))
+        };
+
+        // when reply is nullptr, or ctx has an error, or reply is an error type
+        if (!reply || ctx->err || reply->type == REDIS_REPLY_ERROR) {
+            std::cerr << tag << " authentication failed: "
+                << (ctx->errstr ? ctx->errstr : "Unknown error")
+                << std::endl;
+            redisFree(ctx);
+            return nullptr;
+        }
+
+        // some redis server return "OK" as status, some return "OK" as string
+        if (reply->type == REDIS_REPLY_STATUS) {
+            if (!(reply->str && std::string(reply->str) == "OK")) {
+                std::cerr << tag << " AUTH unexpected status: "
+                    << (reply->str ? reply->str : "(null)") << std::endl;
+            }
+        }
+    }
+
+    return ctx;
+}
+
+RedisProducerOptions::OverflowPolicy RedisProducerOptions::parsePolicy(const std::string& name) {
+    if (name == "block") return OverflowPolicy::Block;
+    if (name == "spill") return OverflowPolicy::SpillToDisk;
+    if (name != "drop_oldest_non_final") {
+        std::cerr << "Unknown redis producer overflow policy: " << name << ", use drop_oldest_non_final" << std::endl;
+    }
+    return OverflowPolicy::DropOldestNonFinal;
+}
+
+RedisProducer::RedisProducer(std::string host, int port, std::string password, std::string stream, RedisProducerOptions options) :
+    host_(std::move(host)), port_(port), password_(std::move(password)), stream_(std::move(stream)), options_(std::move(options))
+{
+    options_.queueCapacity = std::max<size_t>(1, options_.queueCapacity);
+    options_.batchSize = std::max<size_t>(1, options_.batchSize);
+    finals_.slots.resize(options_.queueCapacity);
+    nonFinals_.slots.resize(options_.queueCapacity);
+    batch_.resize(options_.batchSize);
+
+    if (options_.overflowPolicy == RedisProducerOptions::OverflowPolicy::SpillToDisk) {
+        // frames spilled by a previous run are replayed first, the file keeps them in publish order
+        std::error_code ec;
+        auto existing = std::filesystem::file_size(options_.spillPath, ec);
+        spillOut_.open(options_.spillPath, std::ios::out | std::ios::app | std::ios::binary);
+        spillIn_.open(options_.spillPath, std::ios::in | std::ios::binary);
+        if (!ec && existing > 0) {
+            spilling_ = true;
+            spillWritten_ = existing;
+            std::cout << "RedisProducer " << stream_ << " replaying " << existing << " spilled bytes from " << options_.spillPath << std::endl;
+        }
+    }
+
+    writer_ = std::thread(&RedisProducer::writerLoop, this);
+}
+
+RedisProducer::~RedisProducer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    notEmpty_.notify_all();
+    notFull_.notify_all();
+    if (writer_.joinable()) {
+        writer_.join();
+    }
+    if (ctx_) {
+        redisFree(ctx_);
+        ctx_ = nullptr;
+    }
+}
+
+void RedisProducer::publish(const char* data, size_t len) {
+    publish(data, len, looksFinal(data, len));
+}
+
+void RedisProducer::publish(const char* data, size_t len, bool isFinal) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (stop_) return;
+
+    // once spilling, everything goes to disk until the writer has replayed it, to keep the stream in order
+    if (spilling_) {
+        spill(data, len);
+        notEmpty_.notify_one();
+        return;
+    }
+
+    while (count_ == options_.queueCapacity) {
+        switch (options_.overflowPolicy) {
+        case RedisProducerOptions::OverflowPolicy::SpillToDisk:
+            spilling_ = true;
+            spill(data, len);
+            notEmpty_.notify_one();
+            return;
+        case RedisProducerOptions::OverflowPolicy::DropOldestNonFinal:
+            if (evictOldestNonFinal()) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            [[fallthrough]]; // only finals queued, never drop them
+        case RedisProducerOptions::OverflowPolicy::Block:
+            notFull_.wait(lock, [this] { return count_ < options_.queueCapacity || stop_; });
+            if (stop_) return;
+            break;
+        }
+    }
+
+    Slot& slot = isFinal ? finals_.push() : nonFinals_.push();
+    slot.payload.assign(data, len); // no allocation once the slot has seen a frame this large
+    slot.isFinal = isFinal;
+    slot.seq = nextSeq_++;
+    ++count_;
+    depth_.store(count_, std::memory_order_relaxed);
+    notEmpty_.notify_one();
+}
+
+bool RedisProducer::looksFinal(const char* data, size_t len) {
+    if (isKlineRecord(data, len)) {
+        return (static_cast<uint8_t>(data[3]) & KLINE_RECORD_FINAL) != 0;
+    }
+    // binance sends compact json, a closed kline carries "x":true
+    return std::string_view(data, len).find("\"x\":true") != std::string_view::npos;
+}
+
+bool RedisProducer::evictOldestNonFinal() {
+    if (nonFinals_.count == 0) return false;
+    nonFinals_.pop(); // the slot keeps its buffer for the next frame
+    --count_;
+    return true;
+}
+
+void RedisProducer::spill(const char* data, size_t len) {
+    // record: uint32 length + payload
+    uint32_t n = static_cast<uint32_t>(len);
+    spillOut_.write(reinterpret_cast<const char*>(&n), sizeof(n));
+    spillOut_.write(data, len); // flushed by the writer before it reads the file back
+    spillWritten_ += sizeof(n) + len;
+    spilled_.fetch_add(1, std::memory_order_relaxed);
+}
+
+size_t RedisProducer::takeBatch(std::unique_lock<std::mutex>& lock) {
+    size_t n = std::min(count_, batch_.size());
+    for (size_t i = 0; i < n; ++i) {
+        // the older front of the two queues goes first, so Redis gets the frames in publish order
+        SlotFifo& from = finals_.count == 0 ? nonFinals_
+            : nonFinals_.count == 0 ? finals_
+            : finals_.front().seq < nonFinals_.front().seq ? finals_ : nonFinals_;
+        // swap instead of copy: the batch slot's old buffer goes back to the queue for reuse
+        std::swap(batch_[i], from.front());
+        from.pop();
+    }
+    count_ -= n;
+    depth_.store(count_, std::memory_order_relaxed);
+    lock.unlock();
+    notFull_.notify_all();
+    return n;
+}
+
+size_t RedisProducer::readSpillBatch() {
+    uint64_t written = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        spillOut_.flush(); // once per batch read back, publishers only buffer their writes
+        written = spillWritten_;
+    }
+
+    spillIn_.clear();
+    spillIn_.seekg(static_cast<std::streamoff>(spillRead_)); // drop whatever was buffered before the file grew
+
+    size_t n = 0;
+    while (n < batch_.size() && spillRead_ + sizeof(uint32_t) <= written) {
+        uint32_t len = 0;
+        if (!spillIn_.read(reinterpret_cast<char*>(&len), sizeof(len))) break;
+        if (spillRead_ + sizeof(len) + len > written) break;
+        batch_[n].payload.resize(len);
+        if (!spillIn_.read(batch_[n].payload.data(), len)) break;
+        batch_[n].isFinal = looksFinal(batch_[n].payload.data(), len);
+        spillRead_ += sizeof(len) + len;
+        ++n;
+    }
+    return n;
+}
+
+// XADD <stream> * data <payload>, length-delimited so the payload is binary safe
+void RedisProducer::appendXadd(std::string_view payload) {
+    auto appendBulk = [this](std::string_view arg) {
+        cmdBuf_ += '$';
+        cmdBuf_ += std::to_string(arg.size());
+        cmdBuf_ += "\r\n";
+        cmdBuf_.append(arg.data(), arg.size());
+        cmdBuf_ += "\r\n";
+        };
+
+    cmdBuf_ += "*5\r\n";
+    appendBulk("XADD");
+    appendBulk(stream_);
+    appendBulk("*");
+    appendBulk("data");
+    appendBulk(payload);
+}
+
+bool RedisProducer::ensureConnected() {
+    if (ctx_ && !ctx_->err) return true;
+    if (ctx_) {
+        redisFree(ctx_);
+        ctx_ = nullptr;
+    }
+
+    ctx_ = connectRedisWithAuth(host_, port_, password_, "Producer");
+    if (!ctx_) return false;
+
+    // a hung server must not park the writer forever, treat it as a broken connection instead
+    struct timeval tv { 5, 0 };
+    redisSetTimeout(ctx_, tv);
+    return true;
+}
+
+bool RedisProducer::sendBatch(std::vector<Slot>& batch, size_t count) {
+    if (!ensureConnected()) return false;
+
+    // the whole batch goes out in one write, then the replies are read back in order
+    cmdBuf_.clear(); // keeps capacity
+    for (size_t i = 0; i < count; ++i) {
+        appendXadd(batch[i].payload);
+    }
+    if (redisAppendFormattedCommand(ctx_, cmdBuf_.data(), cmdBuf_.size()) != REDIS_OK) {
+        std::cerr << "RedisProducer " << stream_ << " append failed: " << ctx_->errstr << std::endl;
+        return false;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        void* raw = nullptr;
+        if (redisGetReply(ctx_, &raw) != REDIS_OK || raw == nullptr) {
+            // the connection is gone, the whole batch is resent: consumers upsert by starttime so duplicates are harmless
+            std::cerr << "RedisProducer " << stream_ << " lost connection: " << ctx_->errstr << std::endl;
+            redisFree(ctx_);
+            ctx_ = nullptr;
+            return false;
+        }
+        std::unique_ptr<redisReply, ReplyFree> reply(static_cast<redisReply*>(raw));
+        if (reply->type == REDIS_REPLY_ERROR) {
+            std::cerr << "XADD to " << stream_ << " error: " << (reply->str ? reply->str : "") << std::endl;
+        }
+    }
+
+    published_.fetch_add(count, std::memory_order_relaxed);
+    return true;
+}
+
+void RedisProducer::writerLoop() {
+    while (true) {
+        size_t n = 0;
+        bool fromSpill = false;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            notEmpty_.wait(lock, [this] { return stop_ || count_ > 0 || spilling_; });
+            if (stop_) break; // what is still spilled on disk is replayed by the next run
+
+            // ring entries are always older than the spilled ones, drain them first
+            if (count_ > 0) {
+                n = takeBatch(lock);
+            } else {
+                fromSpill = true;
+            }
+        }
+
+        if (fromSpill) {
+            n = readSpillBatch();
+            if (n == 0) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (spillRead_ >= spillWritten_) {
+                    // caught up, back to the in-memory ring and start a fresh spill file
+                    spilling_ = false;
+                    spillOut_.close();
+                    spillOut_.open(options_.spillPath, std::ios::out | std::ios::trunc | std::ios::binary);
+                    spillIn_.close();
+                    spillIn_.open(options_.spillPath, std::ios::in | std::ios::binary);
+                    spillWritten_ = 0;
+                    spillRead_ = 0;
+                    continue;
+                }
+            }
+            if (n == 0) {
+                std::cerr << "RedisProducer " << stream_ << " failed to read spill file " << options_.spillPath << std::endl;
+                std::this_thread::sleep_for(std::chrono::seconds(1));
+                continue;
+            }
+        }
+
+        // retry the batch until Redis takes it, publishers keep going meanwhile under the overflow policy
+        while (!sendBatch(batch_, n)) {
+            if (stop_) return;
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+        }
+    }
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <hiredis/hiredis.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// connect (and AUTH if a password is set), returns nullptr on failure with the reason logged under tag
+redisContext* connectRedisWithAuth(const std::string& host, int port, const std::string& password, const char* tag);
+
+struct RedisProducerOptions {
+    enum class OverflowPolicy {
+        Block,              // the publisher waits for room, back pressure reaches the caller
+        DropOldestNonFinal, // evict the oldest non-final kline, finals are never dropped (falls back to Block if all are final)
+        SpillToDisk,        // append to spillPath and replay in order once Redis catches up
+    };
+
+    size_t queueCapacity = 65536;   // frames buffered between the publisher and the writer thread
+    size_t batchSize = 256;         // max XADDs pipelined per round-trip, i.e. the in-flight cap
+    OverflowPolicy overflowPolicy = OverflowPolicy::DropOldestNonFinal;
+    std::string spillPath = "redis_spill.bin";
+
+    static OverflowPolicy parsePolicy(const std::string& name);
+};
+
+// Asynchronous XADD producer for one stream.
+// publish() copies the frame into a recycled slot of a bounded ring and returns, a dedicated writer thread
+// drains the ring and pipelines the XADDs in batches, so Redis latency never reaches the ws read loop.
+class RedisProducer {
+public:
+    RedisProducer(std::string host, int port, std::string password, std::string stream, RedisProducerOptions options);
+    ~RedisProducer();
+
+    RedisProducer(const RedisProducer&) = delete;
+    RedisProducer& operator=(const RedisProducer&) = delete;
+
+    // thread safe, may be called from several io threads. isFinal: the frame carries a closed kline, which the
+    // overflow policy never drops; without it the frame is inspected (json "x":true, or the record flag)
+    void publish(const char* data, size_t len);
+    void publish(const char* data, size_t len, bool isFinal);
+
+    size_t queueDepth() const { return depth_.load(std::memory_order_relaxed); }
+    uint64_t publishedCount() const { return published_.load(std::memory_order_relaxed); }
+    uint64_t droppedCount() const { return dropped_.load(std::memory_order_relaxed); }
+    uint64_t spilledCount() const { return spilled_.load(std::memory_order_relaxed); }
+
+private:
+    struct Slot {
+        std::string payload; // capacity is recycled between the queues and the writer batch
+        bool isFinal = false;
+        uint64_t seq = 0;    // publish order
+    };
+
+    // ring of slots in publish order
+    struct SlotFifo {
+        std::vector<Slot> slots;
+        size_t head = 0;
+        size_t count = 0;
+
+        Slot& front() { return slots[head]; }
+        Slot& push() { Slot& s = slots[(head + count) % slots.size()]; ++count; return s; }
+        void pop() { head = (head + 1) % slots.size(); --count; }
+    };
+
+    void writerLoop();
+    bool ensureConnected();
+    bool sendBatch(std::vector<Slot>& batch, size_t count);
+    size_t takeBatch(std::unique_lock<std::mutex>& lock);
+    size_t readSpillBatch();
+    bool evictOldestNonFinal();
+    void spill(const char* data, size_t len);
+    void appendXadd(std::string_view payload);
+
+    static bool looksFinal(const char* data, size_t len);
+
+    std::string host_;
+    int port_;
+    std::string password_;
+    std::string stream_;
+    RedisProducerOptions options_;
+
+    redisContext* ctx_ = nullptr;
+
+    // queued frames, guarded by mutex_. Finals and non-finals wait in separate rings so the oldest non-final is
+    // dropped in O(1); the writer merges them back by seq. count_ is the total, at most queueCapacity.
+    SlotFifo finals_;
+    SlotFifo nonFinals_;
+    size_t count_ = 0;
+    uint64_t nextSeq_ = 0;
+    std::mutex mutex_;
+    std::condition_variable notEmpty_;
+    std::condition_variable notFull_;
+
+    // spill file, guarded by mutex_ for the write side; the writer thread owns the read side
+    bool spilling_ = false;
+    std::ofstream spillOut_;
+    uint64_t spillWritten_ = 0;
+    std::ifstream spillIn_;
+    uint64_t spillRead_ = 0;
+
+    // writer side, only touched by writer_
+    std::vector<Slot> batch_;
+    std::string cmdBuf_;
+
+    std::atomic<size_t> depth_{ 0 };
+    std::atomic<uint64_t> published_{ 0 };
+    std::atomic<uint64_t> dropped_{ 0 };
+    std::atomic<uint64_t> spilled_{ 0 };
+    std::atomic<bool> stop_{ false };
+    std::thread writer_;
+};
@@ -0,0 +1,141 @@
+#ifndef DECIMAL_H
+#define DECIMAL_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+// Scaled int64 decimal for exchange prices and volumes: value = mantissa / 10^scale.
+// The scale is the number of fraction digits the exchange sent, so "16541.77000000" round-trips exactly.
+// Parsing does not allocate and does not depend on the C locale, unlike std::stod.
+struct Decimal {
+    int64_t mantissa = 0;
+    uint8_t scale = 0;
+
+    static constexpr uint8_t MAX_SCALE = 18;
+    static constexpr size_t MAX_CHARS = 22; // sign + 19 digits + '.' + leading '0'
+    static constexpr int DECIMAL128_BIAS = 6176;
+
+    // false if s is not a plain decimal number ([-]digits[.digits]).
+    // Fraction digits beyond what fits into int64 are truncated, binance never sends more than 8.
+    static bool parse(std::string_view s, Decimal& out) {
+        size_t i = 0;
+        bool neg = false;
+        if (i < s.size() && (s[i] == '-' || s[i] == '+')) {
+            neg = s[i] == '-';
+            ++i;
+        }
+
+        uint64_t m = 0;
+        uint8_t scale = 0;
+        bool digits = false;
+        bool fraction = false;
+        bool full = false;
+        for (; i < s.size(); ++i) {
+            char c = s[i];
+            if (c == '.') {
+                if (fraction) return false;
+                fraction = true;
+                continue;
+            }
+            if (c < '0' || c > '9') return false;
+            digits = true;
+            if (full) {
+                if (!fraction) return false; // integer part does not fit
+                continue;
+            }
+            uint64_t next = m * 10 + static_cast<uint64_t>(c - '0');
+            if (m > (UINT64_C(0x7FFFFFFFFFFFFFFF) - static_cast<uint64_t>(c - '0')) / 10 || (fraction && scale == MAX_SCALE)) {
+                full = true;
+                if (!fraction) return false;
+                continue;
+            }
+            m = next;
+            if (fraction) ++scale;
+        }
+        if (!digits) return false;
+
+        out.mantissa = neg ? -static_cast<int64_t>(m) : static_cast<int64_t>(m);
+        out.scale = scale;
+        return true;
+    }
+
+    // like parse, but an unparsable string yields 0
+    static Decimal fromString(std::string_view s) {
+        Decimal d;
+        if (!parse(s, d)) d = Decimal{};
+        return d;
+    }
+
+    double toDouble() const {
+        // both operands are exact doubles for realistic values, so the division is correctly rounded like strtod
+        return static_cast<double>(mantissa) / pow10(scale);
+    }
+
+    // writes the canonical text (with all scale digits) to buf, returns the length; buf needs MAX_CHARS
+    size_t format(char* buf) const {
+        char digits[20];
+        size_t n = 0;
+        uint64_t m = mantissa < 0 ? static_cast<uint64_t>(-(mantissa + 1)) + 1 : static_cast<uint64_t>(mantissa);
+        do {
+            digits[n++] = static_cast<char>('0' + m % 10);
+            m /= 10;
+        } while (m);
+        while (n <= scale) digits[n++] = '0'; // at least one integer digit
+
+        size_t len = 0;
+        if (mantissa < 0) buf[len++] = '-';
+        for (size_t i = n; i > 0; --i) {
+            if (i == scale && scale > 0) buf[len++] = '.';
+            buf[len++] = digits[i - 1];
+        }
+        return len;
+    }
+
+    std::string toString() const {
+        char buf[MAX_CHARS];
+        return std::string(buf, format(buf));
+    }
+
+    // IEEE 754-2008 decimal128, BID encoding as stored by BSON: coefficient |mantissa|, exponent -scale. Exact.
+    void toDecimal128(uint64_t& high, uint64_t& low) const {
+        uint64_t m = mantissa < 0 ? static_cast<uint64_t>(-(mantissa + 1)) + 1 : static_cast<uint64_t>(mantissa);
+        high = (static_cast<uint64_t>(DECIMAL128_BIAS - scale) << 49) | (mantissa < 0 ? UINT64_C(1) << 63 : 0);
+        low = m;
+    }
+
+    // false for infinities, NaNs and coefficients beyond int64. Digits past MAX_SCALE are truncated like parse does.
+    static bool fromDecimal128(uint64_t high, uint64_t low, Decimal& out) {
+        if (((high >> 61) & 3) == 3) return false; // inf, NaN or the non-canonical large coefficient form
+        if ((high & UINT64_C(0x1FFFFFFFFFFFF)) != 0 || low > UINT64_C(0x7FFFFFFFFFFFFFFF)) return false;
+
+        int exponent = static_cast<int>((high >> 49) & 0x3FFF) - DECIMAL128_BIAS;
+        uint64_t m = low;
+        for (; exponent > 0; --exponent) {
+            if (m > UINT64_C(0x7FFFFFFFFFFFFFFF) / 10) return false;
+            m *= 10;
+        }
+        for (; exponent < -static_cast<int>(MAX_SCALE); ++exponent) {
+            m /= 10;
+        }
+
+        bool neg = (high >> 63) != 0;
+        out.mantissa = neg ? -static_cast<int64_t>(m) : static_cast<int64_t>(m);
+        out.scale = static_cast<uint8_t>(-exponent);
+        return true;
+    }
+
+    bool operator==(const Decimal& o) const { return mantissa == o.mantissa && scale == o.scale; }
+    bool operator!=(const Decimal& o) const { return !(*this == o); }
+
+    static double pow10(uint8_t n) {
+        static const double table[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+            1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18,
+        };
+        return table[n <= MAX_SCALE ? n : MAX_SCALE];
+    }
+};
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef INTERVALS_H
+#define INTERVALS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Binance kline intervals with stable small ids, used wherever an interval is stored as a number
+// (binary kline records, on-disk layouts). Ids are part of those formats: only ever append to the table.
+struct KlineInterval {
+    uint8_t id;
+    const char* name;
+    int64_t ms; // nominal length, 1M is taken as 30 days
+};
+
+inline constexpr KlineInterval KLINE_INTERVALS[] = {
+    {1, "1s", 1000LL},
+    {2, "1m", 60LL * 1000},
+    {3, "3m", 3LL * 60 * 1000},
+    {4, "5m", 5LL * 60 * 1000},
+    {5, "15m", 15LL * 60 * 1000},
+    {6, "30m", 30LL * 60 * 1000},
+    {7, "1h", 60LL * 60 * 1000},
+    {8, "2h", 2LL * 60 * 60 * 1000},
+    {9, "4h", 4LL * 60 * 60 * 1000},
+    {10, "6h", 6LL * 60 * 60 * 1000},
+    {11, "8h", 8LL * 60 * 60 * 1000},
+    {12, "12h", 12LL * 60 * 60 * 1000},
+    {13, "1d", 24LL * 60 * 60 * 1000},
+    {14, "3d", 3LL * 24 * 60 * 60 * 1000},
+    {15, "1w", 7LL * 24 * 60 * 60 * 1000},
+    {16, "1M", 30LL * 24 * 60 * 60 * 1000},
+};
+
+// 0 if the interval is unknown
+inline uint8_t intervalId(std::string_view name) {
+    for (const auto& i : KLINE_INTERVALS) {
+        if (name == i.name) return i.id;
+    }
+    return 0;
+}
+
+// nullptr if the id is unknown
+inline const KlineInterval* intervalById(uint8_t id) {
+    for (const auto& i : KLINE_INTERVALS) {
+        if (i.id == id) return &i;
+    }
+    return nullptr;
+}
+
+#endif
@@ -2,9 +2,23 @@
 #define KLINE_H
 
 #include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
 #include <nlohmann/json.hpp>
 #include <iostream>
 
+#include "dtos/decimal.h"
+#include "dtos/klineRecord.h"
+
+// copy into a fixed char field, truncating and always null terminated
+template <size_t N>
+inline void setFixedString(char (&dst)[N], std::string_view src) {
+    size_t n = src.size() < N - 1 ? src.size() : N - 1;
+    std::memcpy(dst, src.data(), n);
+    dst[n] = '\0';
+}
+
 class Kline {
 public:
     // kline info
@@ -51,33 +65,38 @@ public:
     inline static std::vector<KlineResponseRest> parseKlineRest(const std::string& klineString);
 };
 
+// Trivially copyable: fixed char fields and scaled decimals keep the exchange text exactly without heap storage.
 class KlineResponseWs {
 public:
     // kline info
-    std::string EventType;       // "e": "kline" - Event type
+    char EventType[16]{};        // "e": "kline" - Event type
     int64_t EventTime;           // "E": 1672515782136 - Event time
-    std::string Symbol;          // "s": "BNBBTC" - Trading pair
+    char Symbol[16]{};           // "s": "BNBBTC" - Trading pair
     int64_t StartTime;           // "t": 1672515780000 - Start time of this Kline
     int64_t EndTime;             // "T": 1672515839999 - End time of this Kline
-    std::string Interval;        // "i": "1m" - Kline interval
+    char Interval[8]{};          // "i": "1m" - Kline interval
     int64_t FirstTradeID;        // "f": 100 - First trade ID during this Kline
     int64_t LastTradeID;         // "L": 200 - Last trade ID during this Kline
-    std::string Open;            // "o": "0.0010" - Opening price
-    std::string Close;           // "c": "0.0020" - Closing price
-    std::string High;            // "h": "0.0025" - Highest price during this Kline
-    std::string Low;             // "l": "0.0015" - Lowest price during this Kline
-    std::string Volume;          // "v": "1000" - Volume during this Kline
+    Decimal Open;                // "o": "0.0010" - Opening price
+    Decimal Close;               // "c": "0.0020" - Closing price
+    Decimal High;                // "h": "0.0025" - Highest price during this Kline
+    Decimal Low;                 // "l": "0.0015" - Lowest price during this Kline
+    Decimal Volume;              // "v": "1000" - Volume during this Kline
     int64_t TradeNum;            // "n": 100 - Number of trades during this Kline
     bool IsFinal;                // "x": false - Whether this Kline is final
-    std::string QuoteVolume;     // "q": "1.0000" - Quote asset volume during this Kline
-    std::string ActiveBuyVolume; // "V": "500" - Volume of active buy during this Kline
-    std::string ActiveBuyQuoteVolume; // "Q": "0.500" - Quote asset volume of active buy during this Kline
+    Decimal QuoteVolume;         // "q": "1.0000" - Quote asset volume during this Kline
+    Decimal ActiveBuyVolume;     // "V": "500" - Volume of active buy during this Kline
+    Decimal ActiveBuyQuoteVolume; // "Q": "0.500" - Quote asset volume of active buy during this Kline
     int64_t IgnoreParam;         // "B": "123456" - Ignore this parameter
 
     // Conversion method to convert from KlineResponseRest
     inline static KlineResponseWs fromRest(const KlineResponseRest& rest);
     inline static Kline toKline(const KlineResponseWs& ws);
 
+    // Conversion from/to the binary stream record, the symbol is interned as symbolId
+    inline static KlineResponseWs fromRecord(const KlineRecord& r, std::string_view symbol);
+    inline static KlineRecord toRecord(const KlineResponseWs& ws, uint32_t symbolId);
+
     // Serialization/Deserialization methods
     inline static KlineResponseWs deserializeFromJson(const nlohmann::json& j);
     inline static KlineResponseWs deserializeFromJsonRestArrary(const nlohmann::json& j);
@@ -85,21 +104,23 @@ public:
     inline static nlohmann::json serializeToJson(const KlineResponseWs& kline);
 };
 
+static_assert(std::is_trivially_copyable<KlineResponseWs>::value, "KlineResponseWs must stay trivially copyable");
+
 // ------------------ Inline KlineResponseRest ------------------
 
 inline KlineResponseRest KlineResponseRest::fromWs(const KlineResponseWs& ws) {
     KlineResponseRest rest;
     rest.OpenTime = ws.StartTime;
     rest.CloseTime = ws.EndTime;
-    rest.Open = ws.Open;
-    rest.Close = ws.Close;
-    rest.High = ws.High;
-    rest.Low = ws.Low;
-    rest.Volume = ws.Volume;
+    rest.Open = ws.Open.toString();
+    rest.Close = ws.Close.toString();
+    rest.High = ws.High.toString();
+    rest.Low = ws.Low.toString();
+    rest.Volume = ws.Volume.toString();
     rest.NumberOfTrades = ws.TradeNum;
-    rest.QuoteAssetVolume = ws.QuoteVolume;
-    rest.TakerBuyBaseAssetVolume = ws.ActiveBuyVolume;
-    rest.TakerBuyQuoteAssetVolume = ws.ActiveBuyQuoteVolume;
+    rest.QuoteAssetVolume = ws.QuoteVolume.toString();
+    rest.TakerBuyBaseAssetVolume = ws.ActiveBuyVolume.toString();
+    rest.TakerBuyQuoteAssetVolume = ws.ActiveBuyQuoteVolume.toString();
     return rest;
 }
 
@@ -145,15 +166,15 @@ inline KlineResponseWs KlineResponseWs::fromRest(const KlineResponseRest& rest)
     KlineResponseWs ws;
     ws.StartTime = rest.OpenTime;
     ws.EndTime = rest.CloseTime;
-    ws.Open = rest.Open;
-    ws.Close = rest.Close;
-    ws.High = rest.High;
-    ws.Low = rest.Low;
-    ws.Volume = rest.Volume;
+    ws.Open = Decimal::fromString(rest.Open);
+    ws.Close = Decimal::fromString(rest.Close);
+    ws.High = Decimal::fromString(rest.High);
+    ws.Low = Decimal::fromString(rest.Low);
+    ws.Volume = Decimal::fromString(rest.Volume);
     ws.TradeNum = rest.NumberOfTrades;
-    ws.QuoteVolume = rest.QuoteAssetVolume;
-    ws.ActiveBuyVolume = rest.TakerBuyBaseAssetVolume;
-    ws.ActiveBuyQuoteVolume = rest.TakerBuyQuoteAssetVolume;
+    ws.QuoteVolume = Decimal::fromString(rest.QuoteAssetVolume);
+    ws.ActiveBuyVolume = Decimal::fromString(rest.TakerBuyBaseAssetVolume);
+    ws.ActiveBuyQuoteVolume = Decimal::fromString(rest.TakerBuyQuoteAssetVolume);
     return ws;
 }
 
@@ -161,32 +182,78 @@ inline Kline KlineResponseWs::toKline(const KlineResponseWs& ws) {
     Kline kline;
     kline.StartTime = ws.StartTime;
     kline.EndTime = ws.EndTime;
-    std::strncpy(kline.Symbol, ws.Symbol.c_str(), sizeof(kline.Symbol) - 1);
-    std::strncpy(kline.Interval, ws.Interval.c_str(), sizeof(kline.Interval) - 1);
+    setFixedString(kline.Symbol, ws.Symbol);
+    setFixedString(kline.Interval, ws.Interval);
     kline.FirstTradeID = ws.FirstTradeID;
     kline.LastTradeID = ws.LastTradeID;
-    kline.Open = std::stod(ws.Open);
-    kline.Close = std::stod(ws.Close);
-    kline.High = std::stod(ws.High);
-    kline.Low = std::stod(ws.Low);
-    kline.Volume = std::stod(ws.Volume);
+    kline.Open = ws.Open.toDouble();
+    kline.Close = ws.Close.toDouble();
+    kline.High = ws.High.toDouble();
+    kline.Low = ws.Low.toDouble();
+    kline.Volume = ws.Volume.toDouble();
     kline.TradeNum = ws.TradeNum;
     kline.IsFinal = ws.IsFinal;
-    kline.QuoteVolume = std::stod(ws.QuoteVolume);
-    kline.ActiveBuyVolume = std::stod(ws.ActiveBuyVolume);
-    kline.ActiveBuyQuoteVolume = std::stod(ws.ActiveBuyQuoteVolume);
+    kline.QuoteVolume = ws.QuoteVolume.toDouble();
+    kline.ActiveBuyVolume = ws.ActiveBuyVolume.toDouble();
+    kline.ActiveBuyQuoteVolume = ws.ActiveBuyQuoteVolume.toDouble();
     return kline;
 }
 
 // Serialization/Deserialization methods
+inline KlineResponseWs KlineResponseWs::fromRecord(const KlineRecord& r, std::string_view symbol) {
+    KlineResponseWs ws;
+    setFixedString(ws.EventType, "kline");
+    ws.EventTime = r.eventTime;
+    setFixedString(ws.Symbol, symbol);
+    ws.StartTime = r.startTime;
+    ws.EndTime = r.endTime;
+    const KlineInterval* interval = intervalById(r.intervalId);
+    setFixedString(ws.Interval, interval ? interval->name : "");
+    ws.FirstTradeID = r.firstTradeId;
+    ws.LastTradeID = r.lastTradeId;
+    ws.Open = r.decimal(KlineRecord::Open);
+    ws.Close = r.decimal(KlineRecord::Close);
+    ws.High = r.decimal(KlineRecord::High);
+    ws.Low = r.decimal(KlineRecord::Low);
+    ws.Volume = r.decimal(KlineRecord::Volume);
+    ws.TradeNum = r.tradeNum;
+    ws.IsFinal = r.isFinal();
+    ws.QuoteVolume = r.decimal(KlineRecord::QuoteVolume);
+    ws.ActiveBuyVolume = r.decimal(KlineRecord::ActiveBuyVolume);
+    ws.ActiveBuyQuoteVolume = r.decimal(KlineRecord::ActiveBuyQuoteVolume);
+    ws.IgnoreParam = 0;
+    return ws;
+}
+
+inline KlineRecord KlineResponseWs::toRecord(const KlineResponseWs& ws, uint32_t symbolId) {
+    KlineRecord r;
+    r.intervalId = intervalId(ws.Interval);
+    r.flags = ws.IsFinal ? KLINE_RECORD_FINAL : 0;
+    r.symbolId = symbolId;
+    r.eventTime = ws.EventTime;
+    r.startTime = ws.StartTime;
+    r.endTime = ws.EndTime;
+    r.firstTradeId = ws.FirstTradeID;
+    r.lastTradeId = ws.LastTradeID;
+    r.tradeNum = ws.TradeNum;
+    r.setDecimal(KlineRecord::Open, ws.Open);
+    r.setDecimal(KlineRecord::Close, ws.Close);
+    r.setDecimal(KlineRecord::High, ws.High);
+    r.setDecimal(KlineRecord::Low, ws.Low);
+    r.setDecimal(KlineRecord::Volume, ws.Volume);
+    r.setDecimal(KlineRecord::QuoteVolume, ws.QuoteVolume);
+    r.setDecimal(KlineRecord::ActiveBuyVolume, ws.ActiveBuyVolume);
+    r.setDecimal(KlineRecord::ActiveBuyQuoteVolume, ws.ActiveBuyQuoteVolume);
+    return r;
+}
+
 inline KlineResponseWs KlineResponseWs::deserializeFromJson(const nlohmann::json& j) {
     KlineResponseWs kline;
     
     try{
 
         if (j.contains("e") && j["e"].is_string()) {
-            kline.EventType = j["e"].get<std::string>();
-            // std::strncpy(kline.EventType, j["e"].get<std::string>().c_str(), sizeof(kline.EventType));
+            setFixedString(kline.EventType, j["e"].get_ref<const std::string&>());
         } else {
             std::cerr << "Missing or invalid type for 'e'" << std::endl;
         }
@@ -198,8 +265,7 @@ inline KlineResponseWs KlineResponseWs::deserializeFromJson(const nlohmann::json
         }
 
         if (j.contains("s") && j["s"].is_string()) {
-            kline.Symbol = j["s"].get<std::string>();
-            // std::strncpy(kline.Symbol, j["s"].get<std::string>().c_str(), sizeof(kline.Symbol));
+            setFixedString(kline.Symbol, j["s"].get_ref<const std::string&>());
         } else {
             std::cerr << "Missing or invalid type for 's'" << std::endl;
         }
@@ -220,8 +286,7 @@ inline KlineResponseWs KlineResponseWs::deserializeFromJson(const nlohmann::json
             }
 
             if (k.contains("i") && k["i"].is_string()) {
-                kline.Interval = k["i"].get<std::string>();
-                // std::strncpy(kline.Interval, k["i"].get<std::string>().c_str(), sizeof(kline.Interval));
+                setFixedString(kline.Interval, k["i"].get_ref<const std::string&>());
             } else {
                 std::cerr << "Missing or invalid type for 'i'" << std::endl;
             }
@@ -239,31 +304,31 @@ inline KlineResponseWs KlineResponseWs::deserializeFromJson(const nlohmann::json
             }
 
             if (k.contains("o") && k["o"].is_string()) {
-                kline.Open = k["o"].get<std::string>();
+                kline.Open = Decimal::fromString(k["o"].get_ref<const std::string&>());
             } else {
                 std::cerr << "Missing or invalid type for 'o'" << std::endl;
             }
 
             if (k.contains("c") && k["c"].is_string()) {
-                kline.Close = k["c"].get<std::string>();
+                kline.Close = Decimal::fromString(k["c"].get_ref<const std::string&>());
             } else {
                 std::cerr << "Missing or invalid type for 'c'" << std::endl;
             }
 
             if (k.contains("h") && k["h"].is_string()) {
-                kline.High = k["h"].get<std::string>();
+                kline.High = Decimal::fromString(k["h"].get_ref<const std::string&>());
             } else {
                 std::cerr << "Missing or invalid type for 'h'" << std::endl;
             }
 
             if (k.contains("l") && k["l"].is_string()) {
-                kline.Low = k["l"].get<std::string>();
+                kline.Low = Decimal::fromString(k["l"].get_ref<const std::string&>());
             } else {
                 std::cerr << "Missing or invalid type for 'l'" << std::endl;
             }
 
             if (k.contains("v") && k["v"].is_string()) {
-                kline.Volume = k["v"].get<std::string>();
+                kline.Volume = Decimal::fromString(k["v"].get_ref<const std::string&>());
             } else {
                 std::cerr << "Missing or invalid type for 'v'" << std::endl;
             }
@@ -281,19 +346,19 @@ inline KlineResponseWs KlineResponseWs::deserializeFromJson(const nlohmann::json
             }
 
             if (k.contains("q") && k["q"].is_string()) {
-                kline.QuoteVolume = k["q"].get<std::string>();
+                kline.QuoteVolume = Decimal::fromString(k["q"].get_ref<const std::string&>());
             } else {
                 std::cerr << "Missing or invalid type for 'q'" << std::endl;
             }
 
             if (k.contains("V") && k["V"].is_string()) {
-                kline.ActiveBuyVolume = k["V"].get<std::string>();
+                kline.ActiveBuyVolume = Decimal::fromString(k["V"].get_ref<const std::string&>());
             } else {
                 std::cerr << "Missing or invalid type for 'V'" << std::endl;
             }
 
             if (k.contains("Q") && k["Q"].is_string()) {
-                kline.ActiveBuyQuoteVolume = k["Q"].get<std::string>();
+                kline.ActiveBuyQuoteVolume = Decimal::fromString(k["Q"].get_ref<const std::string&>());
             } else {
                 std::cerr << "Missing or invalid type for 'Q'" << std::endl;
             }
@@ -322,18 +387,18 @@ inline KlineResponseWs KlineResponseWs::deserializeFromJsonRestArrary(const nloh
                 throw std::runtime_error("Invalid Kline data size");
             }
             
-            kline.EventType = "kline";
+            setFixedString(kline.EventType, "kline");
             kline.StartTime = j.at(0).get<uint64_t>();
-            kline.Open = j.at(1).get<std::string>();
-            kline.High = j.at(2).get<std::string>();
-            kline.Low = j.at(3).get<std::string>();
-            kline.Close = j.at(4).get<std::string>();
-            kline.Volume = j.at(5).get<std::string>();
+            kline.Open = Decimal::fromString(j.at(1).get_ref<const std::string&>());
+            kline.High = Decimal::fromString(j.at(2).get_ref<const std::string&>());
+            kline.Low = Decimal::fromString(j.at(3).get_ref<const std::string&>());
+            kline.Close = Decimal::fromString(j.at(4).get_ref<const std::string&>());
+            kline.Volume = Decimal::fromString(j.at(5).get_ref<const std::string&>());
             kline.EndTime = j.at(6).get<uint64_t>();
-            kline.QuoteVolume = j.at(7).get<std::string>();
+            kline.QuoteVolume = Decimal::fromString(j.at(7).get_ref<const std::string&>());
             kline.TradeNum = j.at(8).get<uint64_t>();
-            kline.ActiveBuyVolume = j.at(9).get<std::string>();
-            kline.ActiveBuyQuoteVolume = j.at(10).get<std::string>();
+            kline.ActiveBuyVolume = Decimal::fromString(j.at(9).get_ref<const std::string&>());
+            kline.ActiveBuyQuoteVolume = Decimal::fromString(j.at(10).get_ref<const std::string&>());
             kline.IsFinal = true;
 
             kline.EventTime = kline.StartTime;
@@ -352,8 +417,8 @@ inline void KlineResponseWs::parseKlineWs(const std::string& klineString, std::s
     auto jsonData = nlohmann::json::parse(klineString);
     for (const auto& klineJson : jsonData) {
         auto kline = KlineResponseWs::deserializeFromJsonRestArrary(klineJson); 
-        kline.Symbol = symbol;
-        kline.Interval = interval;
+        setFixedString(kline.Symbol, symbol);
+        setFixedString(kline.Interval, interval);
         klines.push_back(kline);
     }
 }
@@ -370,16 +435,16 @@ inline nlohmann::json KlineResponseWs::serializeToJson(const KlineResponseWs& kl
         {"i", kline.Interval},
         {"f", kline.FirstTradeID},
         {"L", kline.LastTradeID},
-        {"o", kline.Open},
-        {"c", kline.Close},
-        {"h", kline.High},
-        {"l", kline.Low},
-        {"v", kline.Volume},
+        {"o", kline.Open.toString()},
+        {"c", kline.Close.toString()},
+        {"h", kline.High.toString()},
+        {"l", kline.Low.toString()},
+        {"v", kline.Volume.toString()},
         {"n", kline.TradeNum},
         {"x", kline.IsFinal},
-        {"q", kline.QuoteVolume},
-        {"V", kline.ActiveBuyVolume},
-        {"Q", kline.ActiveBuyQuoteVolume},
+        {"q", kline.QuoteVolume.toString()},
+        {"V", kline.ActiveBuyVolume.toString()},
+        {"Q", kline.ActiveBuyQuoteVolume.toString()},
         // {"B", kline.IgnoreParam}
     };
     return j;
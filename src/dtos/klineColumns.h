@@ -0,0 +1,111 @@
+#ifndef KLINE_COLUMNS_H
+#define KLINE_COLUMNS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Fields of a kline range read. The values are bit positions of a field mask, the names are the stored BSON keys.
+enum class KlineField : uint32_t {
+    StartTime, EndTime, Open, High, Low, Close, Volume, QuoteVolume, TradeNum, ActiveBuyVolume, ActiveBuyQuoteVolume,
+    Count
+};
+
+constexpr uint32_t klineFieldBit(KlineField f) { return 1u << static_cast<uint32_t>(f); }
+
+inline constexpr uint32_t KLINE_FIELDS_OHLCV = klineFieldBit(KlineField::StartTime) | klineFieldBit(KlineField::Open)
+    | klineFieldBit(KlineField::High) | klineFieldBit(KlineField::Low) | klineFieldBit(KlineField::Close)
+    | klineFieldBit(KlineField::Volume);
+inline constexpr uint32_t KLINE_FIELDS_ALL = (1u << static_cast<uint32_t>(KlineField::Count)) - 1;
+
+inline const char* klineFieldName(KlineField f) {
+    static const char* const names[] = {
+        "starttime", "endtime", "open", "high", "low", "close", "volume", "quotevolume", "tradenum",
+        "activebuyvolume", "activebuyquotevolume" };
+    return names[static_cast<uint32_t>(f)];
+}
+
+// KlineField::Count if the key is not a kline field
+inline KlineField klineFieldOf(std::string_view key) {
+    for (uint32_t i = 0; i < static_cast<uint32_t>(KlineField::Count); ++i) {
+        if (key == klineFieldName(static_cast<KlineField>(i))) return static_cast<KlineField>(i);
+    }
+    return KlineField::Count;
+}
+
+// Klines of one series as struct of arrays, ascending by start time: element i of every column belongs to the
+// same kline. Only the columns in `fields` are filled, the others stay empty. startTime is always filled, it is
+// the time axis. Reads clear and refill the columns, so an instance reused across reads keeps its capacity.
+struct KlineColumns {
+    uint32_t fields = KLINE_FIELDS_OHLCV;
+
+    std::vector<int64_t> startTime;
+    std::vector<int64_t> endTime;
+    std::vector<double> open;
+    std::vector<double> high;
+    std::vector<double> low;
+    std::vector<double> close;
+    std::vector<double> volume;
+    std::vector<double> quoteVolume;
+    std::vector<int64_t> tradeNum;
+    std::vector<double> activeBuyVolume;
+    std::vector<double> activeBuyQuoteVolume;
+
+    bool has(KlineField f) const { return (fields & klineFieldBit(f)) != 0; }
+    size_t size() const { return startTime.size(); }
+    bool empty() const { return startTime.empty(); }
+
+    // the column of an integer field (StartTime, EndTime, TradeNum), nullptr for the others
+    std::vector<int64_t>* intColumn(KlineField f) {
+        switch (f) {
+        case KlineField::StartTime: return &startTime;
+        case KlineField::EndTime: return &endTime;
+        case KlineField::TradeNum: return &tradeNum;
+        default: return nullptr;
+        }
+    }
+
+    // the column of a price or volume field, nullptr for the others
+    std::vector<double>* numberColumn(KlineField f) {
+        switch (f) {
+        case KlineField::Open: return &open;
+        case KlineField::High: return &high;
+        case KlineField::Low: return &low;
+        case KlineField::Close: return &close;
+        case KlineField::Volume: return &volume;
+        case KlineField::QuoteVolume: return &quoteVolume;
+        case KlineField::ActiveBuyVolume: return &activeBuyVolume;
+        case KlineField::ActiveBuyQuoteVolume: return &activeBuyQuoteVolume;
+        default: return nullptr;
+        }
+    }
+
+    const std::vector<int64_t>* intColumn(KlineField f) const { return const_cast<KlineColumns*>(this)->intColumn(f); }
+    const std::vector<double>* numberColumn(KlineField f) const { return const_cast<KlineColumns*>(this)->numberColumn(f); }
+
+    // applies f to every selected column
+    template <typename F>
+    void forEachColumn(F&& f) {
+        for (uint32_t i = 0; i < static_cast<uint32_t>(KlineField::Count); ++i) {
+            auto field = static_cast<KlineField>(i);
+            if (!has(field)) continue;
+            if (auto* c = intColumn(field)) f(*c);
+            else f(*numberColumn(field));
+        }
+    }
+
+    // all columns, also the ones a previous read with other fields filled
+    void clear() {
+        fields |= klineFieldBit(KlineField::StartTime);
+        startTime.clear(); endTime.clear(); tradeNum.clear();
+        open.clear(); high.clear(); low.clear(); close.clear(); volume.clear();
+        quoteVolume.clear(); activeBuyVolume.clear(); activeBuyQuoteVolume.clear();
+    }
+    void reserve(size_t n) { forEachColumn([n](auto& c) { c.reserve(n); }); }
+    void resize(size_t n) { forEachColumn([n](auto& c) { c.resize(n); }); }
+    // drops the first n klines
+    void eraseFront(size_t n) { forEachColumn([n](auto& c) { c.erase(c.begin(), c.begin() + n); }); }
+};
+
+#endif
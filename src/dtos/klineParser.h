@@ -0,0 +1,323 @@
+#ifndef KLINE_PARSER_H
+#define KLINE_PARSER_H
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "dtos/kline.h"
+
+// Single-pass parsers for the two Binance kline payloads, the ws event object and the REST array of arrays.
+// The schema is fixed, so instead of building a DOM the scanner walks the bytes once, dispatches on the
+// one-letter keys and writes straight into KlineResponseWs. Unknown keys are skipped, and string scanning uses
+// memchr, which libc vectorizes.
+// Missing or mistyped fields are reported with the same messages as KlineResponseWs::deserializeFromJson.
+
+enum class KlineParseStatus {
+    Ok,              // a kline event, possibly with missing fields already reported
+    SubscriptionAck, // {"result":null,"id":n}, the reply to SUBSCRIBE
+    Invalid,         // not well formed
+};
+
+class KlineJsonScanner {
+public:
+    KlineJsonScanner(const char* begin, const char* end) : p_(begin), end_(end) {}
+
+    void skipWs() {
+        while (p_ < end_ && (*p_ == ' ' || *p_ == '\n' || *p_ == '\r' || *p_ == '\t')) ++p_;
+    }
+
+    bool consume(char c) {
+        skipWs();
+        if (p_ < end_ && *p_ == c) { ++p_; return true; }
+        return false;
+    }
+
+    char peek() {
+        skipWs();
+        return p_ < end_ ? *p_ : '\0';
+    }
+
+    // raw content between the quotes, escapes are kept as-is (none occur in kline payloads)
+    bool string(std::string_view& out) {
+        if (!consume('"')) return false;
+        const char* start = p_;
+        while (true) {
+            const char* q = static_cast<const char*>(std::memchr(p_, '"', static_cast<size_t>(end_ - p_)));
+            if (!q) return false;
+            // an escaped quote has an odd number of backslashes in front of it
+            const char* b = q;
+            while (b > start && *(b - 1) == '\\') --b;
+            p_ = q + 1;
+            if (((q - b) & 1) == 0) {
+                out = std::string_view(start, static_cast<size_t>(q - start));
+                return true;
+            }
+        }
+    }
+
+    // integral json number only, a fraction or exponent is a type mismatch
+    bool int64(int64_t& out) {
+        skipWs();
+        const char* s = p_;
+        bool neg = false;
+        if (p_ < end_ && *p_ == '-') { neg = true; ++p_; }
+        if (p_ >= end_ || *p_ < '0' || *p_ > '9') { p_ = s; return false; }
+        uint64_t v = 0;
+        while (p_ < end_ && *p_ >= '0' && *p_ <= '9') {
+            v = v * 10 + static_cast<uint64_t>(*p_ - '0');
+            ++p_;
+        }
+        if (p_ < end_ && (*p_ == '.' || *p_ == 'e' || *p_ == 'E')) { p_ = s; return false; }
+        out = neg ? -static_cast<int64_t>(v) : static_cast<int64_t>(v);
+        return true;
+    }
+
+    bool boolean(bool& out) {
+        skipWs();
+        if (end_ - p_ >= 4 && std::memcmp(p_, "true", 4) == 0) { p_ += 4; out = true; return true; }
+        if (end_ - p_ >= 5 && std::memcmp(p_, "false", 5) == 0) { p_ += 5; out = false; return true; }
+        return false;
+    }
+
+    bool null() {
+        skipWs();
+        if (end_ - p_ >= 4 && std::memcmp(p_, "null", 4) == 0) { p_ += 4; return true; }
+        return false;
+    }
+
+    // skip any value, nested containers included
+    bool skipValue() {
+        char c = peek();
+        if (c == '"') { std::string_view sv; return string(sv); }
+        if (c == '{' || c == '[') {
+            int depth = 0;
+            while (p_ < end_) {
+                char ch = *p_;
+                if (ch == '"') {
+                    std::string_view sv;
+                    if (!string(sv)) return false;
+                    continue;
+                }
+                ++p_;
+                if (ch == '{' || ch == '[') ++depth;
+                else if (ch == '}' || ch == ']') {
+                    if (--depth == 0) return true;
+                }
+            }
+            return false;
+        }
+        // number or literal
+        const char* s = p_;
+        while (p_ < end_ && *p_ != ',' && *p_ != '}' && *p_ != ']' && *p_ != ' ' && *p_ != '\n' && *p_ != '\r' && *p_ != '\t') ++p_;
+        return p_ > s;
+    }
+
+    // position to come back to when a value turns out to have the wrong type
+    const char* mark() const { return p_; }
+    void reset(const char* mark) { p_ = mark; }
+
+private:
+    const char* p_;
+    const char* end_;
+};
+
+namespace kline_parser_detail {
+
+// string value into a fixed char field
+template <size_t N>
+inline bool text(KlineJsonScanner& sc, char (&dst)[N]) {
+    std::string_view sv;
+    if (sc.peek() != '"' || !sc.string(sv)) return false;
+    setFixedString(dst, sv);
+    return true;
+}
+
+// quoted decimal like "16541.77000000", no allocation and no locale
+// a string that is not a number is a type error, the scanner is rewound so the caller can skip the value
+inline bool decimal(KlineJsonScanner& sc, Decimal& dst) {
+    std::string_view sv;
+    if (sc.peek() != '"') return false;
+    const char* mark = sc.mark();
+    if (!sc.string(sv)) return false;
+    if (!Decimal::parse(sv, dst)) {
+        sc.reset(mark);
+        return false;
+    }
+    return true;
+}
+
+// field bits of the ws event, used to report what is missing after the single pass
+enum : uint32_t {
+    F_e = 1u << 0, F_E = 1u << 1, F_s = 1u << 2, F_k = 1u << 3,
+    F_t = 1u << 4, F_T = 1u << 5, F_i = 1u << 6, F_f = 1u << 7, F_L = 1u << 8,
+    F_o = 1u << 9, F_c = 1u << 10, F_h = 1u << 11, F_l = 1u << 12, F_v = 1u << 13,
+    F_n = 1u << 14, F_x = 1u << 15, F_q = 1u << 16, F_V = 1u << 17, F_Q = 1u << 18,
+};
+
+inline bool parseKlineBody(KlineJsonScanner& sc, KlineResponseWs& kline, uint32_t& seen) {
+    if (!sc.consume('{')) return false;
+    if (sc.consume('}')) return true;
+
+    do {
+        std::string_view key;
+        if (!sc.string(key) || !sc.consume(':')) return false;
+
+        bool ok = false;
+        if (key.size() == 1) {
+            switch (key[0]) {
+            case 't': ok = sc.int64(kline.StartTime); if (ok) seen |= F_t; break;
+            case 'T': ok = sc.int64(kline.EndTime); if (ok) seen |= F_T; break;
+            case 'f': ok = sc.int64(kline.FirstTradeID); if (ok) seen |= F_f; break;
+            case 'L': ok = sc.int64(kline.LastTradeID); if (ok) seen |= F_L; break;
+            case 'n': ok = sc.int64(kline.TradeNum); if (ok) seen |= F_n; break;
+            case 'x': ok = sc.boolean(kline.IsFinal); if (ok) seen |= F_x; break;
+            case 'i': ok = text(sc, kline.Interval); if (ok) seen |= F_i; break;
+            case 'o': ok = decimal(sc, kline.Open); if (ok) seen |= F_o; break;
+            case 'c': ok = decimal(sc, kline.Close); if (ok) seen |= F_c; break;
+            case 'h': ok = decimal(sc, kline.High); if (ok) seen |= F_h; break;
+            case 'l': ok = decimal(sc, kline.Low); if (ok) seen |= F_l; break;
+            case 'v': ok = decimal(sc, kline.Volume); if (ok) seen |= F_v; break;
+            case 'q': ok = decimal(sc, kline.QuoteVolume); if (ok) seen |= F_q; break;
+            case 'V': ok = decimal(sc, kline.ActiveBuyVolume); if (ok) seen |= F_V; break;
+            case 'Q': ok = decimal(sc, kline.ActiveBuyQuoteVolume); if (ok) seen |= F_Q; break;
+            default: break; // "s", "B" and anything new
+            }
+        }
+        // unknown key or wrong type: skip the value, a wrong type is reported as missing below
+        if (!ok && !sc.skipValue()) return false;
+    } while (sc.consume(','));
+
+    return sc.consume('}');
+}
+
+inline void reportMissing(uint32_t seen) {
+    static const struct { uint32_t bit; const char* name; } fields[] = {
+        {F_e, "e"}, {F_E, "E"}, {F_s, "s"}, {F_k, "k"}, {F_t, "t"}, {F_T, "T"}, {F_i, "i"}, {F_f, "f"}, {F_L, "L"},
+        {F_o, "o"}, {F_c, "c"}, {F_h, "h"}, {F_l, "l"}, {F_v, "v"}, {F_n, "n"}, {F_x, "x"}, {F_q, "q"}, {F_V, "V"}, {F_Q, "Q"},
+    };
+    for (const auto& f : fields) {
+        // the kline body fields are only reported when "k" itself is there, like deserializeFromJson
+        if (f.bit >= F_t && !(seen & F_k)) break;
+        if (!(seen & f.bit)) {
+            std::cerr << "Missing or invalid type for '" << f.name << "'" << std::endl;
+        }
+    }
+}
+
+} // namespace kline_parser_detail
+
+// parse one ws kline event (or the subscription ack) into kline
+inline KlineParseStatus parseKlineEvent(std::string_view json, KlineResponseWs& kline) {
+    using namespace kline_parser_detail;
+    KlineJsonScanner sc(json.data(), json.data() + json.size());
+    if (!sc.consume('{')) return KlineParseStatus::Invalid;
+    if (sc.consume('}')) return KlineParseStatus::Invalid;
+
+    uint32_t seen = 0;
+    bool ack = false;
+    do {
+        std::string_view key;
+        if (!sc.string(key) || !sc.consume(':')) return KlineParseStatus::Invalid;
+
+        bool ok = false;
+        if (key == "e") {
+            ok = text(sc, kline.EventType);
+            if (ok) seen |= F_e;
+        } else if (key == "E") {
+            ok = sc.int64(kline.EventTime);
+            if (ok) seen |= F_E;
+        } else if (key == "s") {
+            ok = text(sc, kline.Symbol);
+            if (ok) seen |= F_s;
+        } else if (key == "k") {
+            if (sc.peek() == '{') {
+                if (!parseKlineBody(sc, kline, seen)) return KlineParseStatus::Invalid;
+                seen |= F_k;
+                ok = true;
+            }
+        } else if (key == "result") {
+            ok = sc.null();
+            ack = ok;
+        }
+        if (!ok && !sc.skipValue()) return KlineParseStatus::Invalid;
+    } while (sc.consume(','));
+
+    if (!sc.consume('}')) return KlineParseStatus::Invalid;
+    if (ack) return KlineParseStatus::SubscriptionAck;
+
+    reportMissing(seen);
+    return KlineParseStatus::Ok;
+}
+
+// parse the /api/v3/klines response, an array of
+// [openTime, "open", "high", "low", "close", "volume", closeTime, "quoteVolume", trades, "takerBase", "takerQuote", "ignore"]
+// throws std::runtime_error when the payload is not well formed, like nlohmann::json::parse
+inline void parseKlineRestArray(std::string_view json, const std::string& symbol, const std::string& interval, std::vector<KlineResponseWs>& klines) {
+    using namespace kline_parser_detail;
+    KlineJsonScanner sc(json.data(), json.data() + json.size());
+    if (!sc.consume('[')) throw std::runtime_error("parseKlineRestArray: expected '['");
+    if (sc.consume(']')) return;
+
+    do {
+        if (!sc.consume('[')) throw std::runtime_error("parseKlineRestArray: expected kline array");
+
+        KlineResponseWs& kline = klines.emplace_back();
+        setFixedString(kline.EventType, "kline");
+        setFixedString(kline.Symbol, symbol);
+        setFixedString(kline.Interval, interval);
+        kline.FirstTradeID = 0;
+        kline.LastTradeID = 0;
+        kline.IsFinal = true;
+        kline.IgnoreParam = 0;
+
+        size_t index = 0;
+        bool typeError = false;
+        if (!sc.consume(']')) {
+            do {
+                bool ok = true;
+                switch (index) {
+                case 0: ok = sc.int64(kline.StartTime); break;
+                case 1: ok = decimal(sc, kline.Open); break;
+                case 2: ok = decimal(sc, kline.High); break;
+                case 3: ok = decimal(sc, kline.Low); break;
+                case 4: ok = decimal(sc, kline.Close); break;
+                case 5: ok = decimal(sc, kline.Volume); break;
+                case 6: ok = sc.int64(kline.EndTime); break;
+                case 7: ok = decimal(sc, kline.QuoteVolume); break;
+                case 8: ok = sc.int64(kline.TradeNum); break;
+                case 9: ok = decimal(sc, kline.ActiveBuyVolume); break;
+                case 10: ok = decimal(sc, kline.ActiveBuyQuoteVolume); break;
+                default: ok = sc.skipValue(); break;
+                }
+                if (!ok) {
+                    if (!typeError) {
+                        std::cerr << "Error parsing Kline data: unexpected type at index " << index << std::endl;
+                    }
+                    typeError = true;
+                    if (!sc.skipValue()) throw std::runtime_error("parseKlineRestArray: malformed value");
+                }
+                ++index;
+            } while (sc.consume(','));
+            if (!sc.consume(']')) throw std::runtime_error("parseKlineRestArray: expected ']'");
+        }
+
+        if (index < 11) {
+            std::cerr << "General error: Invalid Kline data size" << std::endl;
+            typeError = true;
+        }
+        if (typeError) {
+            klines.pop_back(); // never hand out a half-filled kline
+            continue;
+        }
+        kline.EventTime = kline.StartTime;
+    } while (sc.consume(','));
+
+    if (!sc.consume(']')) throw std::runtime_error("parseKlineRestArray: expected ']'");
+}
+
+#endif
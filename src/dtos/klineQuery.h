@@ -0,0 +1,170 @@
+#ifndef KLINE_QUERY_H
+#define KLINE_QUERY_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "dtos/klineColumns.h"
+#include "dtos/klineRecord.h"
+
+// Wire format of the local kline query service (KlineQueryServer), header-only for the strategy processes.
+//
+// Every message is a frame: u32 length of the body, then the body, all little endian.
+// Request body, 32 bytes + series:
+//   id u32 | op u8 | series length u8 | reserved u16 | fields u32 | startTime i64 | endTime i64 | limit u32 | series
+// Response body, 20 bytes + columns:
+//   id u32 | status u8 | source u8 | reserved u16 | fields u32 | count u32 | reserved u32 | columns
+// The columns are the fields of the mask in KlineField order, each `count` values of 8 bytes, int64 or double,
+// ascending by start time. Requests on one connection are answered in order; id is echoed back.
+
+inline constexpr size_t KLINE_QUERY_REQUEST_SIZE = 32;
+inline constexpr size_t KLINE_QUERY_RESPONSE_SIZE = 20;
+inline constexpr size_t KLINE_QUERY_MAX_FRAME = 64 * 1024 * 1024;
+
+enum class KlineQueryOp : uint8_t {
+    Range = 1,  // start times in [startTime, endTime], the first `limit` (0: up to the server maximum)
+    Latest = 2, // the last `limit` start times at or before endTime (0: the newest)
+};
+
+enum class KlineQueryStatus : uint8_t { Ok = 0, BadRequest = 1, Error = 2 };
+enum class KlineQuerySource : uint8_t { Cache = 0, Mongo = 1 };
+
+struct KlineQuery {
+    uint32_t id = 0;
+    KlineQueryOp op = KlineQueryOp::Range;
+    uint32_t fields = KLINE_FIELDS_OHLCV;
+    int64_t startTime = 0;
+    int64_t endTime = INT64_MAX;
+    uint32_t limit = 0;
+    std::string series; // SYMBOL_INTERVAL_Binance
+};
+
+struct KlineQueryResponse {
+    uint32_t id = 0;
+    KlineQueryStatus status = KlineQueryStatus::Ok;
+    KlineQuerySource source = KlineQuerySource::Cache;
+    KlineColumns klines;
+};
+
+namespace kline_query_detail {
+
+inline void putFrameLength(std::string& out, size_t at) {
+    kline_record_detail::storeLe(&out[at], out.size() - at - 4, 4);
+}
+
+} // namespace kline_query_detail
+
+// appends the request frame to out
+inline void encodeKlineQuery(const KlineQuery& q, std::string& out) {
+    using namespace kline_record_detail;
+    size_t at = out.size();
+    out.resize(at + 4 + KLINE_QUERY_REQUEST_SIZE);
+    char* p = &out[at + 4];
+    std::memset(p, 0, KLINE_QUERY_REQUEST_SIZE);
+    storeLe(p, q.id, 4);
+    p[4] = static_cast<char>(q.op);
+    size_t seriesLen = q.series.size() < 255 ? q.series.size() : 255;
+    p[5] = static_cast<char>(seriesLen);
+    storeLe(p + 8, q.fields, 4);
+    storeLe(p + 12, static_cast<uint64_t>(q.startTime), 8);
+    storeLe(p + 20, static_cast<uint64_t>(q.endTime), 8);
+    storeLe(p + 28, q.limit, 4);
+    out.append(q.series, 0, seriesLen);
+    kline_query_detail::putFrameLength(out, at);
+}
+
+// body without the length prefix
+inline bool decodeKlineQuery(const char* body, size_t len, KlineQuery& q) {
+    using namespace kline_record_detail;
+    if (len < KLINE_QUERY_REQUEST_SIZE) return false;
+    size_t seriesLen = static_cast<uint8_t>(body[5]);
+    if (len != KLINE_QUERY_REQUEST_SIZE + seriesLen) return false;
+    q.id = static_cast<uint32_t>(loadLe(body, 4));
+    q.op = static_cast<KlineQueryOp>(body[4]);
+    q.fields = static_cast<uint32_t>(loadLe(body + 8, 4));
+    q.startTime = static_cast<int64_t>(loadLe(body + 12, 8));
+    q.endTime = static_cast<int64_t>(loadLe(body + 20, 8));
+    q.limit = static_cast<uint32_t>(loadLe(body + 28, 4));
+    q.series.assign(body + KLINE_QUERY_REQUEST_SIZE, seriesLen);
+    return q.op == KlineQueryOp::Range || q.op == KlineQueryOp::Latest;
+}
+
+// appends the response frame to out; the columns of klines.fields are sent
+inline void encodeKlineQueryResponse(uint32_t id, KlineQueryStatus status, KlineQuerySource source,
+    const KlineColumns& klines, std::string& out)
+{
+    using namespace kline_record_detail;
+    uint32_t fields = status == KlineQueryStatus::Ok ? klines.fields : 0;
+    size_t count = status == KlineQueryStatus::Ok ? klines.size() : 0;
+
+    size_t at = out.size();
+    out.resize(at + 4 + KLINE_QUERY_RESPONSE_SIZE);
+    char* p = &out[at + 4];
+    std::memset(p, 0, KLINE_QUERY_RESPONSE_SIZE);
+    storeLe(p, id, 4);
+    p[4] = static_cast<char>(status);
+    p[5] = static_cast<char>(source);
+    storeLe(p + 8, fields, 4);
+    storeLe(p + 12, count, 4);
+
+    for (uint32_t f = 0; f < static_cast<uint32_t>(KlineField::Count); ++f) {
+        auto field = static_cast<KlineField>(f);
+        if (!(fields & klineFieldBit(field))) continue;
+        size_t col = out.size();
+        out.resize(col + count * 8);
+        char* dst = &out[col];
+        if (auto* ints = klines.intColumn(field)) {
+            for (size_t i = 0; i < count; ++i) storeLe(dst + i * 8, static_cast<uint64_t>((*ints)[i]), 8);
+        } else {
+            const auto& numbers = *klines.numberColumn(field);
+            for (size_t i = 0; i < count; ++i) {
+                uint64_t bits;
+                std::memcpy(&bits, &numbers[i], 8);
+                storeLe(dst + i * 8, bits, 8);
+            }
+        }
+    }
+    kline_query_detail::putFrameLength(out, at);
+}
+
+// body without the length prefix
+inline bool decodeKlineQueryResponse(const char* body, size_t len, KlineQueryResponse& r) {
+    using namespace kline_record_detail;
+    if (len < KLINE_QUERY_RESPONSE_SIZE) return false;
+    r.id = static_cast<uint32_t>(loadLe(body, 4));
+    r.status = static_cast<KlineQueryStatus>(body[4]);
+    r.source = static_cast<KlineQuerySource>(body[5]);
+    r.klines.fields = static_cast<uint32_t>(loadLe(body + 8, 4)) & KLINE_FIELDS_ALL;
+    size_t count = static_cast<size_t>(loadLe(body + 12, 4));
+
+    size_t columns = 0;
+    for (uint32_t f = 0; f < static_cast<uint32_t>(KlineField::Count); ++f) {
+        if (r.klines.has(static_cast<KlineField>(f))) ++columns;
+    }
+    if (len != KLINE_QUERY_RESPONSE_SIZE + columns * count * 8) return false;
+
+    uint32_t fields = r.klines.fields;
+    r.klines.clear();
+    r.klines.fields = fields;
+    if (count && !r.klines.has(KlineField::StartTime)) return false;
+    r.klines.resize(count);
+    const char* src = body + KLINE_QUERY_RESPONSE_SIZE;
+    for (uint32_t f = 0; f < static_cast<uint32_t>(KlineField::Count); ++f) {
+        auto field = static_cast<KlineField>(f);
+        if (!r.klines.has(field)) continue;
+        if (auto* ints = r.klines.intColumn(field)) {
+            for (size_t i = 0; i < count; ++i) (*ints)[i] = static_cast<int64_t>(loadLe(src + i * 8, 8));
+        } else {
+            auto& numbers = *r.klines.numberColumn(field);
+            for (size_t i = 0; i < count; ++i) {
+                uint64_t bits = loadLe(src + i * 8, 8);
+                std::memcpy(&numbers[i], &bits, 8);
+            }
+        }
+        src += count * 8;
+    }
+    return true;
+}
+
+#endif
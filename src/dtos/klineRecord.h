@@ -0,0 +1,137 @@
+#ifndef KLINE_RECORD_H
+#define KLINE_RECORD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "dtos/decimal.h"
+#include "dtos/intervals.h"
+
+// Compact binary kline, the opt-in payload of the Redis kline streams (see `*_stream_encoding` in config.ini).
+// Header only and free of other project dependencies, so stream consumers can just copy this file, decimal.h
+// and intervals.h.
+//
+// Wire layout, 128 bytes, little-endian:
+//   0  u8  magic (0xCB, never the first byte of a json payload)   1  u8  version
+//   2  u8  interval id (intervals.h)                              3  u8  flags (bit 0: kline closed)
+//   4  u32 symbol id, interned in the Redis hash KLINE_SYMBOL_REGISTRY (symbol -> id)
+//   8  i64 event time, start time, end time, first trade id, last trade id, trade count
+//   56 i64 mantissas of open, close, high, low, volume, quote volume, taker buy volume, taker buy quote volume
+//   120 u8 scales of the same eight decimals
+// A new version may only append fields or use the flags; decoders reject versions they do not know.
+
+inline constexpr size_t KLINE_RECORD_SIZE = 128;
+inline constexpr uint8_t KLINE_RECORD_MAGIC = 0xCB;
+inline constexpr uint8_t KLINE_RECORD_VERSION = 1;
+inline constexpr uint8_t KLINE_RECORD_FINAL = 0x01;
+inline const char* const KLINE_SYMBOL_REGISTRY = "kline_symbol_ids";
+
+struct alignas(64) KlineRecord {
+    enum Field : size_t { Open, Close, High, Low, Volume, QuoteVolume, ActiveBuyVolume, ActiveBuyQuoteVolume, FieldCount };
+
+    uint8_t magic = KLINE_RECORD_MAGIC;
+    uint8_t version = KLINE_RECORD_VERSION;
+    uint8_t intervalId = 0;
+    uint8_t flags = 0;
+    uint32_t symbolId = 0;
+    int64_t eventTime = 0;
+    int64_t startTime = 0;
+    int64_t endTime = 0;
+    int64_t firstTradeId = 0;
+    int64_t lastTradeId = 0;
+    int64_t tradeNum = 0;
+    int64_t mantissa[FieldCount]{};
+    uint8_t scale[FieldCount]{};
+
+    bool isFinal() const { return (flags & KLINE_RECORD_FINAL) != 0; }
+    Decimal decimal(Field f) const { return Decimal{ mantissa[f], scale[f] }; }
+    void setDecimal(Field f, const Decimal& d) { mantissa[f] = d.mantissa; scale[f] = d.scale; }
+};
+
+static_assert(sizeof(KlineRecord) == KLINE_RECORD_SIZE, "KlineRecord must be exactly two cache lines");
+
+namespace kline_record_detail {
+
+inline void storeLe(char* p, uint64_t v, size_t n) {
+    for (size_t i = 0; i < n; ++i) p[i] = static_cast<char>((v >> (8 * i)) & 0xFF);
+}
+
+inline uint64_t loadLe(const char* p, size_t n) {
+    uint64_t v = 0;
+    for (size_t i = 0; i < n; ++i) v |= static_cast<uint64_t>(static_cast<uint8_t>(p[i])) << (8 * i);
+    return v;
+}
+
+} // namespace kline_record_detail
+
+// true if the payload looks like a binary record rather than json
+inline bool isKlineRecord(const char* data, size_t len) {
+    return len == KLINE_RECORD_SIZE && static_cast<uint8_t>(data[0]) == KLINE_RECORD_MAGIC;
+}
+
+// out must hold KLINE_RECORD_SIZE bytes
+inline void encodeKlineRecord(const KlineRecord& r, char* out) {
+    using namespace kline_record_detail;
+    out[0] = static_cast<char>(KLINE_RECORD_MAGIC);
+    out[1] = static_cast<char>(KLINE_RECORD_VERSION);
+    out[2] = static_cast<char>(r.intervalId);
+    out[3] = static_cast<char>(r.flags);
+    storeLe(out + 4, r.symbolId, 4);
+    const int64_t ints[] = { r.eventTime, r.startTime, r.endTime, r.firstTradeId, r.lastTradeId, r.tradeNum };
+    for (size_t i = 0; i < 6; ++i) storeLe(out + 8 + 8 * i, static_cast<uint64_t>(ints[i]), 8);
+    for (size_t i = 0; i < KlineRecord::FieldCount; ++i) {
+        storeLe(out + 56 + 8 * i, static_cast<uint64_t>(r.mantissa[i]), 8);
+        out[120 + i] = static_cast<char>(r.scale[i]);
+    }
+}
+
+// false if the payload is not a record of a known version
+inline bool decodeKlineRecord(const char* data, size_t len, KlineRecord& r) {
+    using namespace kline_record_detail;
+    if (!isKlineRecord(data, len) || static_cast<uint8_t>(data[1]) != KLINE_RECORD_VERSION) return false;
+    r.magic = KLINE_RECORD_MAGIC;
+    r.version = KLINE_RECORD_VERSION;
+    r.intervalId = static_cast<uint8_t>(data[2]);
+    r.flags = static_cast<uint8_t>(data[3]);
+    r.symbolId = static_cast<uint32_t>(loadLe(data + 4, 4));
+    int64_t* ints[] = { &r.eventTime, &r.startTime, &r.endTime, &r.firstTradeId, &r.lastTradeId, &r.tradeNum };
+    for (size_t i = 0; i < 6; ++i) *ints[i] = static_cast<int64_t>(loadLe(data + 8 + 8 * i, 8));
+    for (size_t i = 0; i < KlineRecord::FieldCount; ++i) {
+        r.mantissa[i] = static_cast<int64_t>(loadLe(data + 56 + 8 * i, 8));
+        r.scale[i] = static_cast<uint8_t>(data[120 + i]);
+    }
+    return true;
+}
+
+// symbol <-> id map, a local copy of the KLINE_SYMBOL_REGISTRY hash. Ids start at 1, 0 means unknown.
+class KlineSymbolTable {
+public:
+    void add(uint32_t id, std::string_view symbol) {
+        if (id == 0) return;
+        if (names_.size() <= id) names_.resize(id + 1);
+        names_[id].assign(symbol.data(), symbol.size());
+        ids_[names_[id]] = id;
+    }
+
+    uint32_t id(std::string_view symbol) const {
+        auto it = ids_.find(std::string(symbol));
+        return it == ids_.end() ? 0 : it->second;
+    }
+
+    // nullptr if the id is unknown
+    const std::string* name(uint32_t id) const {
+        return id < names_.size() && !names_[id].empty() ? &names_[id] : nullptr;
+    }
+
+    size_t size() const { return ids_.size(); }
+
+private:
+    std::vector<std::string> names_;
+    std::unordered_map<std::string, uint32_t> ids_;
+};
+
+#endif
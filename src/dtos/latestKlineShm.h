@@ -0,0 +1,128 @@
+#ifndef LATEST_KLINE_SHM_H
+#define LATEST_KLINE_SHM_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+
+#include "dtos/klineRecord.h"
+
+// Shared memory table of the latest kline, closed or in progress, of every subscribed series, published by
+// ChomoSyncer (LatestKlineTable, query.latest_shm_name in config.ini). Header only, together with klineRecord.h,
+// decimal.h and intervals.h, for the consumers on the same host.
+//
+// Layout, little endian:
+//   0     header, 64 bytes: magic[8] "KLNLAST1" | version u32 | slot size u32 | capacity u32 | count u32 |
+//         generation u64 (bumped whenever the publisher lays out the table again) | reserved
+//   64    directory, capacity names of 32 bytes, "SYMBOL_interval" (e.g. "BTCUSDT_1m"), zero padded
+//   slots capacity slots of 192 bytes, 64 byte aligned: sequence u64 | updates u64 | reserved up to 64 |
+//         the kline as a 128 byte KlineRecord (symbol id 0, the slot names the series)
+// A slot is written under a seqlock: the sequence is odd while the publisher writes the record, a reader copies
+// the record and retries if the sequence moved. The sequence and the record words are 8 byte atomics.
+
+inline constexpr char LATEST_KLINE_SHM_MAGIC[8] = { 'K', 'L', 'N', 'L', 'A', 'S', 'T', '1' };
+inline constexpr uint32_t LATEST_KLINE_SHM_VERSION = 1;
+inline constexpr size_t LATEST_KLINE_SHM_HEADER = 64;
+inline constexpr size_t LATEST_KLINE_SHM_NAME = 32;
+inline constexpr size_t LATEST_KLINE_SHM_SLOT = 192;
+inline constexpr size_t LATEST_KLINE_SHM_RECORD_OFFSET = 64;
+inline constexpr size_t LATEST_KLINE_SHM_RECORD_WORDS = KLINE_RECORD_SIZE / 8;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the shared slots need lock-free 64 bit atomics");
+
+namespace latest_kline_shm_detail {
+
+inline size_t slotsOffset(size_t capacity) {
+    size_t end = LATEST_KLINE_SHM_HEADER + capacity * LATEST_KLINE_SHM_NAME;
+    return (end + 63) / 64 * 64;
+}
+
+inline size_t tableSize(size_t capacity) {
+    return slotsOffset(capacity) + capacity * LATEST_KLINE_SHM_SLOT;
+}
+
+inline std::atomic<uint64_t>* word(char* base, size_t offset) {
+    return reinterpret_cast<std::atomic<uint64_t>*>(base + offset);
+}
+
+} // namespace latest_kline_shm_detail
+
+class LatestKlineReader {
+public:
+    // throws boost::interprocess::interprocess_exception if the publisher hasn't created the table
+    explicit LatestKlineReader(const std::string& shmName) :
+        shm_(boost::interprocess::open_only, shmName.c_str(), boost::interprocess::read_only),
+        region_(shm_, boost::interprocess::read_only)
+    {
+        base_ = static_cast<char*>(region_.get_address());
+        if (region_.get_size() < LATEST_KLINE_SHM_HEADER || std::memcmp(base_, LATEST_KLINE_SHM_MAGIC, 8) != 0 ||
+            kline_record_detail::loadLe(base_ + 8, 4) != LATEST_KLINE_SHM_VERSION ||
+            kline_record_detail::loadLe(base_ + 12, 4) != LATEST_KLINE_SHM_SLOT) {
+            base_ = nullptr;
+            return;
+        }
+        capacity_ = static_cast<size_t>(kline_record_detail::loadLe(base_ + 16, 4));
+        if (region_.get_size() < latest_kline_shm_detail::tableSize(capacity_)) base_ = nullptr;
+    }
+
+    bool valid() const { return base_ != nullptr; }
+
+    // Slot of a series, -1 if it is not published. Resolve once and read by slot; when read() reports a new
+    // layout, resolve again.
+    int32_t find(std::string_view symbol, std::string_view interval) {
+        if (!base_) return -1;
+        generation_ = generation();
+        std::string name;
+        name.append(symbol.data(), symbol.size()).append("_").append(interval.data(), interval.size());
+        size_t count = static_cast<size_t>(kline_record_detail::loadLe(base_ + 20, 4));
+        for (size_t i = 0; i < count && i < capacity_; ++i) {
+            const char* entry = base_ + LATEST_KLINE_SHM_HEADER + i * LATEST_KLINE_SHM_NAME;
+            if (name.size() < LATEST_KLINE_SHM_NAME && std::memcmp(entry, name.data(), name.size()) == 0 && entry[name.size()] == '\0') {
+                return static_cast<int32_t>(i);
+            }
+        }
+        return -1;
+    }
+
+    // The latest kline of a slot. False if the slot is still empty, or if the table was laid out again since
+    // find() (the slot may belong to another series now).
+    bool read(int32_t slot, KlineRecord& out, uint64_t* updates = nullptr) const {
+        using namespace latest_kline_shm_detail;
+        if (!base_ || slot < 0 || static_cast<size_t>(slot) >= capacity_) return false;
+        size_t at = slotsOffset(capacity_) + static_cast<size_t>(slot) * LATEST_KLINE_SHM_SLOT;
+        auto* seq = word(base_, at);
+
+        char record[KLINE_RECORD_SIZE];
+        uint64_t n = 0;
+        while (true) {
+            uint64_t before = seq->load(std::memory_order_acquire);
+            if (before & 1) continue; // the publisher is in the middle of this slot, a few nanoseconds
+            n = word(base_, at + 8)->load(std::memory_order_relaxed);
+            for (size_t w = 0; w < LATEST_KLINE_SHM_RECORD_WORDS; ++w) {
+                uint64_t v = word(base_, at + LATEST_KLINE_SHM_RECORD_OFFSET + w * 8)->load(std::memory_order_relaxed);
+                std::memcpy(record + w * 8, &v, 8);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq->load(std::memory_order_relaxed) == before) break;
+        }
+        if (generation() != generation_ || n == 0) return false;
+        if (updates) *updates = n;
+        return decodeKlineRecord(record, KLINE_RECORD_SIZE, out);
+    }
+
+private:
+    uint64_t generation() const { return latest_kline_shm_detail::word(base_, 24)->load(std::memory_order_acquire); }
+
+    boost::interprocess::shared_memory_object shm_;
+    boost::interprocess::mapped_region region_;
+    char* base_ = nullptr;
+    size_t capacity_ = 0;
+    uint64_t generation_ = 0;
+};
+
+#endif
@@ -54,7 +54,7 @@ void IndicatorManager::loadStates(const std::string& originDB, std::vector<std::
         for (const auto& interval : marketIntervals) {
             std::string key = makeSymbolKey(symbol, interval);
             
-            // step 1: fetch the latest origin klines in case some indicator need.
+            // step 1: fetch the latest origin klines in case some indicator need, served by the recent kline cache when it is on.
             std::vector<Kline> klines_window;
             int64_t start_time = 0;
             int64_t end_time = 0;
@@ -27,8 +27,6 @@ private:
     MongoManager& mongo_;
 
     std::unordered_map<std::string, std::vector<std::shared_ptr<IndicatorCalculator>>> calculatorsBySymbol_; // symbol_interval -> calculators
-    std::vector<Kline> window_; // klines for the history window
-    const int WINDOW_LIMIT = 100;
 
     // DB opt
     void persistIndicatorState(const IndicatorState& result);
@@ -4,12 +4,19 @@ import os
 from dataclasses import dataclass
 from typing import Iterable, List, Optional, Dict, Any
 
+from bson.decimal128 import Decimal128
 from pymongo import MongoClient
 from pymongo.collection import Collection
 from pymongo.errors import ServerSelectionTimeoutError
 from dotenv import load_dotenv
 import pandas as pd
 
+# array fields of a kline bucket document, element i of each belongs to the same kline
+BUCKET_COLUMNS = [
+    "starttime", "endtime", "eventtime", "firsttradeid", "lasttradeid", "tradenum",
+    "open", "high", "low", "close", "volume", "quotevolume", "activebuyvolume", "activebuyquotevolume",
+]
+
 # ------------------------------
 # Config & Client
 # ------------------------------
@@ -77,6 +84,11 @@ class MongoWrapper:
         col_name = self.kline_col(symbol, interval)
         col = self._col("market", col_name)
 
+        # bucket layout (database.kline_layout = buckets): one document per bucket with one array per field
+        sample = col.find_one({}, projection={"starttime": True})
+        if sample is not None and isinstance(sample.get("starttime"), list):
+            return self._fetch_bucketed_klines(col, start_ms, end_ms, limit)
+
         q: Dict[str, Any] = {}
         if start_ms is not None or end_ms is not None:
             time_range: Dict[str, Any] = {}
@@ -92,6 +104,38 @@ class MongoWrapper:
         docs = list(cursor)
         return docs
 
+    @staticmethod
+    def _fetch_bucketed_klines(
+        col: Collection,
+        start_ms: Optional[int],
+        end_ms: Optional[int],
+        limit: Optional[int],
+    ) -> List[Dict[str, Any]]:
+        """
+        unpack bucket documents into one dict per kline, same keys as the document layout.
+        """
+        lo = start_ms if start_ms is not None else 0
+        # the bucket holding start_ms starts at or before it
+        first = col.find_one({"_id": {"$lte": lo}}, projection={"_id": True}, sort=[("_id", -1)])
+        q: Dict[str, Any] = {"_id": {"$gte": first["_id"] if first else lo}}
+        if end_ms is not None:
+            q["_id"]["$lte"] = end_ms
+
+        docs: List[Dict[str, Any]] = []
+        for bucket in col.find(q).sort("_id", 1):
+            for i, st in enumerate(bucket.get("starttime", [])):
+                if st < lo or (end_ms is not None and st > end_ms):
+                    continue
+                doc: Dict[str, Any] = {"symbol": bucket.get("symbol"), "interval": bucket.get("interval"), "isfinal": True}
+                for field in BUCKET_COLUMNS:
+                    column = bucket.get(field)
+                    if column is not None and i < len(column):
+                        doc[field] = column[i]
+                docs.append(doc)
+                if limit and len(docs) >= limit:
+                    return docs
+        return docs
+
     # --------------------------
     # DataFrame helpers
     # --------------------------
@@ -103,11 +147,12 @@ class MongoWrapper:
         df = pd.DataFrame(klines)
         if df.empty:
             return df
-        # convert string columns to float
+        # convert price columns to float, stored as strings, doubles or decimal128 (database.kline_price_encoding)
         for col in ["open", "high", "low", "close", "volume", "quotevolume",
                     "activebuyvolume", "activebuyquotevolume"]:
             if col in df.columns:
-                df[col] = pd.to_numeric(df[col], errors="coerce")
+                values = df[col].map(lambda x: str(x) if isinstance(x, Decimal128) else x)
+                df[col] = pd.to_numeric(values, errors="coerce")
         # handle timestamps in milliseconds
         if "starttime" in df.columns:
             df = df.sort_values("starttime").reset_index(drop=True)
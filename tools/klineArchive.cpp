@@ -0,0 +1,66 @@
+// Fills the local kline archive (archive.dir) with the history already stored in MongoDB, e.g. after enabling
+// the archive or after a crash lost its latest writes. The series are the marketsub symbols x intervals.
+// Build with -DCHOMOSYNCER_BUILD_TOOLS=ON, then run ./klineArchive [config.ini] [start ms]
+// Klines are written to their slots, so running it again, or next to ChomoSyncer, only rewrites the same values.
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "config/config.h"
+#include "db/klineArchive.h"
+#include "db/mongoManager.h"
+
+int main(int argc, char** argv) {
+    std::string configPath = argc > 1 ? argv[1] : "config.ini";
+    Config cfg(configPath);
+    int64_t startMs = argc > 2 ? std::strtoll(argv[2], nullptr, 10) : 0;
+
+    if (cfg.getArchiveDir().empty()) {
+        std::cerr << "archive.dir is not set in " << configPath << std::endl;
+        return 1;
+    }
+    KlineArchiveWriter archive(cfg.getArchiveDir(), cfg.getArchiveSegmentBars(), cfg.getArchiveCompressSealed());
+
+    KlineStorageOptions storage;
+    storage.bucketBars = std::max<int64_t>(1, cfg.getDatabaseKlineBucketBars());
+    storage.readBatchSize = std::max(1, cfg.getDatabaseKlineReadBatchSize());
+    MongoManager mongo(cfg.getDatabaseUri(), storage);
+    const std::string dbName = "market_info";
+
+    KlineRangeQuery query;
+    query.limit = 50000;
+    KlineColumns columns;
+    columns.fields = KLINE_FIELDS_ALL;
+
+    int64_t total = 0;
+    size_t failed = 0;
+    for (auto symbol : cfg.getMarketSubInfo("marketsub.symbols")) {
+        std::transform(symbol.begin(), symbol.end(), symbol.begin(), ::toupper);
+        for (const auto& interval : cfg.getMarketSubInfo("marketsub.intervals")) {
+            std::string colName = symbol + "_" + interval + "_Binance";
+            int64_t archived = 0;
+            bool ok = true;
+            query.startTime = startMs;
+            while (true) {
+                int64_t read = mongo.ReadKlineColumns(dbName, colName, query, columns);
+                if (read < 0) {
+                    ok = false;
+                    break;
+                }
+                if (read == 0) break;
+                ok = archive.append(colName, columns) && ok;
+                archived += read;
+                query.startTime = columns.startTime.back() + 1;
+            }
+            if (!ok) ++failed;
+            std::cout << colName << ": " << archived << " klines archived" << (ok ? "" : ", with errors") << std::endl;
+            total += archived;
+        }
+    }
+
+    std::cout << "Done, " << total << " klines archived, " << failed << " series failed" << std::endl;
+    return failed == 0 ? 0 : 1;
+}
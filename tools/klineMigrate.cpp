@@ -0,0 +1,45 @@
+// Rewrites the price and volume fields of the kline collections in place, e.g. from the exchange strings to
+// decimal128 after switching database.kline_price_encoding. The collections are the marketsub symbols x intervals.
+// Build with -DCHOMOSYNCER_BUILD_TOOLS=ON, then run ./klineMigrate [config.ini] [string|double|decimal128] [batch size]
+// The encoding defaults to the configured one. Safe to interrupt and run again, and to run next to ChomoSyncer.
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "config/config.h"
+#include "db/mongoManager.h"
+
+int main(int argc, char** argv) {
+    std::string configPath = argc > 1 ? argv[1] : "config.ini";
+    Config cfg(configPath);
+
+    std::string encodingName = argc > 2 ? argv[2] : cfg.getDatabaseKlinePriceEncoding();
+    KlinePriceEncoding encoding = parseKlinePriceEncoding(encodingName);
+    size_t batchSize = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 1000;
+    if (batchSize == 0) batchSize = 1000;
+
+    MongoManager mongo(cfg.getDatabaseUri());
+    const std::string dbName = "market_info";
+
+    int64_t total = 0;
+    size_t failed = 0;
+    for (auto symbol : cfg.getMarketSubInfo("marketsub.symbols")) {
+        std::transform(symbol.begin(), symbol.end(), symbol.begin(), ::toupper);
+        for (const auto& interval : cfg.getMarketSubInfo("marketsub.intervals")) {
+            std::string colName = symbol + "_" + interval + "_Binance";
+            int64_t migrated = mongo.MigrateKlinePrices(dbName, colName, encoding, batchSize);
+            if (migrated < 0) {
+                ++failed;
+                continue;
+            }
+            std::cout << colName << ": " << migrated << " documents rewritten to " << encodingName << std::endl;
+            total += migrated;
+        }
+    }
+
+    std::cout << "Done, " << total << " documents rewritten, " << failed << " collections failed" << std::endl;
+    return failed == 0 ? 0 : 1;
+}